@@ -0,0 +1,358 @@
+// FluidSolver.h declares PI as a constant, fluid_nl.h as a macro, so the order matters
+#include "../FluidSolver_Parallel/FluidSolver.h"
+#include "../FluidSolver_Serial/fluid_nl.h"
+#include "../Common/elastictube_partition.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+   Benchmark of the fluid solvers without preCICE. Every case runs a number of time
+   windows with a fixed number of coupling iterations; between two solver calls of a
+   window, crossSectionLength is updated by the tube law A = 4/(2-p)^2 like the structure
+   solver does. The phases of the Newton iteration are taken from the workspace profile
+   (see fluid_profile.h), the results are written as CSV or JSON.
+
+   The serial solver runs on rank 0, the parallel solvers on all ranks of MPI_COMM_WORLD.
+*/
+
+enum BenchSolver {
+  BENCH_SERIAL,      // fluid_nl()
+  BENCH_DISTRIBUTED, // fluidComputeSolution()
+  BENCH_CENTRALIZED, // fluidComputeSolutionCentralized()
+  BENCH_SOLVER_COUNT
+};
+
+static const char* solverNames[BENCH_SOLVER_COUNT] = {"serial", "distributed", "centralized"};
+
+struct BenchOptions {
+  std::vector<int> N = {100, 1000, 10000, 100000, 1000000};
+  std::vector<double> kappa = {100};
+  std::vector<double> tau = {0.01};
+  bool solvers[BENCH_SOLVER_COUNT] = {true, true, true};
+  int steps = 10;    // time windows per case
+  int couplings = 3; // solver calls per time window
+  bool json = false;
+  std::string output;
+  FluidOptions fluid;
+};
+
+struct BenchResult {
+  BenchSolver solver;
+  int ranks;
+  int N;
+  double kappa;
+  double tau;
+  double wall;          // complete case, including the tube law and the time stepping
+  FluidProfile profile; // maximum over the ranks
+};
+
+template <typename T>
+static bool parseList(const std::string& value, std::vector<T>& result)
+{
+  std::stringstream stream(value);
+  std::string item;
+  result.clear();
+  while (std::getline(stream, item, ',')) {
+    std::stringstream itemStream(item);
+    T entry;
+    if (!(itemStream >> entry) || !itemStream.eof() || entry <= 0)
+      return false;
+    result.push_back(entry);
+  }
+  return !result.empty();
+}
+
+static bool parseSolvers(const std::string& value, bool* solvers)
+{
+  std::stringstream stream(value);
+  std::string item;
+  for (int s = 0; s < BENCH_SOLVER_COUNT; s++)
+    solvers[s] = false;
+  while (std::getline(stream, item, ',')) {
+    int s = 0;
+    while (s < BENCH_SOLVER_COUNT && item != solverNames[s])
+      s++;
+    if (s == BENCH_SOLVER_COUNT)
+      return false;
+    solvers[s] = true;
+  }
+  return true;
+}
+
+/* Benchmark options, all other arguments are passed to fluid_options_parse() */
+static bool parseArguments(BenchOptions& options, int argc, char** argv)
+{
+  std::vector<char*> fluidArguments;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string::size_type pos = arg.find('=');
+    std::string name = pos == std::string::npos ? arg : arg.substr(0, pos);
+    std::string value = pos == std::string::npos ? "" : arg.substr(pos + 1);
+    bool valid = true;
+
+    if (name == "--help")
+      return false;
+    else if (name == "--n")
+      valid = parseList(value, options.N);
+    else if (name == "--kappa")
+      valid = parseList(value, options.kappa);
+    else if (name == "--tau")
+      valid = parseList(value, options.tau);
+    else if (name == "--solvers")
+      valid = parseSolvers(value, options.solvers);
+    else if (name == "--steps")
+      valid = (options.steps = atoi(value.c_str())) > 0;
+    else if (name == "--couplings")
+      valid = (options.couplings = atoi(value.c_str())) > 0;
+    else if (name == "--format")
+      valid = (options.json = value == "json") || value == "csv";
+    else if (name == "--output")
+      valid = !(options.output = value).empty();
+    else
+      fluidArguments.push_back(argv[i]);
+
+    if (!valid) {
+      std::cout << "Invalid value " << value << " for option " << name << std::endl;
+      return false;
+    }
+  }
+
+  if (options.output.empty())
+    options.output = options.json ? "bench_elastictube.json" : "bench_elastictube.csv";
+  return fluid_options_parse(options.fluid, (int)fluidArguments.size(), fluidArguments.data(), 0);
+}
+
+static void usage(const char* program)
+{
+  std::cout << std::endl;
+  std::cout << "Usage: mpiexec -np <#procs> " << program << " [options]" << std::endl;
+  std::cout << std::endl;
+  std::cout << "  --n=<list>            Numbers of mesh elements (default 100,1000,10000,100000,1000000)." << std::endl;
+  std::cout << "  --kappa=<list>        Dimensionless structural stiffnesses (default 100)." << std::endl;
+  std::cout << "  --tau=<list>          Dimensionless time step sizes (default 0.01)." << std::endl;
+  std::cout << "  --solvers=<list>      Any of serial,distributed,centralized (default all)." << std::endl;
+  std::cout << "  --steps=<n>           Time windows per case (default 10)." << std::endl;
+  std::cout << "  --couplings=<n>       Solver calls per time window (default 3)." << std::endl;
+  std::cout << "  --format=csv|json     Format of the results (default csv)." << std::endl;
+  std::cout << "  --output=<file>       Result file (default bench_elastictube.csv or .json)." << std::endl;
+  std::cout << "The solver output is written to stdout, redirect it to /dev/null to keep it short." << std::endl;
+  std::cout << std::endl;
+  fluid_options_usage();
+}
+
+static void tubeLaw(int n, const double* pressure, double* crossSectionLength)
+{
+  for (int i = 0; i < n; i++)
+    crossSectionLength[i] = 4.0 / ((2.0 - pressure[i]) * (2.0 - pressure[i]));
+}
+
+/* Time windows of the serial solver, see fluid_solver.cpp */
+static void runSerial(const BenchOptions& options, int N, double kappa, double tau, BenchResult& result)
+{
+  TubeState state;
+  tube_state_allocate(state, N + 1);
+  tube_state_fill(state, 1.0 / kappa, 0.0, 1.0);
+  std::vector<double> crossSectionLength_previous(N + 1, 1.0);
+  double t = 0.0, dt = 0.01;
+
+  FluidWorkspace workspace;
+  fluid_workspace_allocate(workspace, N, options.fluid);
+
+  double start = fluid_clock();
+  for (int step = 0; step < options.steps; step++) {
+    for (int c = 0; c < options.couplings; c++) {
+      const double* crossSectionLength = tube_state_iterate(state).crossSectionLength;
+      double rtol = fluid_coupling_tolerance(options.fluid, crossSectionLength, crossSectionLength_previous.data(), N);
+      crossSectionLength_previous.assign(crossSectionLength, crossSectionLength + N + 1);
+      fluid_nl(state, t + dt, N, kappa, tau, workspace, options.fluid, rtol);
+      tubeLaw(N + 1, state.current.pressure, state.current.crossSectionLength);
+    }
+    t += dt;
+    tube_state_advance(state);
+  }
+  result.wall = fluid_clock() - start;
+  result.profile = workspace.profile;
+
+  fluid_workspace_free(workspace);
+  tube_state_free(state);
+}
+
+/* Time windows of the parallel solver, see FluidSolver.cpp */
+static void runParallel(const BenchOptions& options, bool distributed, int N, double kappa, double tau,
+                        const TubePartition& partition, int rank, int size, BenchResult& result)
+{
+  int chunkLength = partition.counts[rank];
+  TubeState state;
+  tube_state_allocate(state, chunkLength);
+  tube_state_fill(state, 1.0 / kappa, 0.0, 1.0);
+  double t = 0.0, dt = 0.01;
+
+  FluidWorkspace workspace;
+  if (distributed)
+    fluid_workspace_allocate_distributed(workspace, N, chunkLength, size, options.fluid);
+  else
+    fluid_workspace_allocate_centralized(workspace, partition, rank, options.fluid);
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  double start = fluid_clock();
+  for (int step = 0; step < options.steps; step++) {
+    for (int c = 0; c < options.couplings; c++) {
+      if (distributed)
+        fluidComputeSolution(rank, size, N, chunkLength, kappa, tau, 0.0, t + dt, state, workspace, options.fluid);
+      else
+        fluidComputeSolutionCentralized(rank, size, N, chunkLength, kappa, tau, 0.0, t + dt, state, workspace, options.fluid);
+      tubeLaw(chunkLength, state.current.pressure, state.current.crossSectionLength);
+    }
+    t += dt;
+    tube_state_advance(state);
+  }
+  double wall = fluid_clock() - start;
+
+  // Times are the maximum over the ranks, the counters are those of rank 0
+  FluidProfile& profile = workspace.profile;
+  double times[6] = {wall, profile.residual, profile.jacobian, profile.factor, profile.solve, profile.total};
+  MPI_Allreduce(MPI_IN_PLACE, times, 6, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  result.wall = times[0];
+  result.profile = profile;
+  result.profile.residual = times[1];
+  result.profile.jacobian = times[2];
+  result.profile.factor = times[3];
+  result.profile.solve = times[4];
+  result.profile.total = times[5];
+
+  fluid_workspace_free(workspace);
+  tube_state_free(state);
+}
+
+static void writeCSV(FILE* file, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+  fprintf(file, "solver,ranks,N,kappa,tau,steps,couplings,calls,unconverged,newton_iterations,factorizations,linear_iterations,"
+                "residual_s,jacobian_s,factor_s,solve_s,newton_s,wall_s,newton_us_per_iteration\n");
+  for (const BenchResult& r : results) {
+    const FluidProfile& p = r.profile;
+    fprintf(file, "%s,%d,%d,%g,%g,%d,%d,%ld,%ld,%ld,%ld,%ld,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.3f\n",
+            solverNames[r.solver], r.ranks, r.N, r.kappa, r.tau, options.steps, options.couplings,
+            p.calls, p.unconverged, p.iterations, p.factorizations, p.linearIterations,
+            p.residual, p.jacobian, p.factor, p.solve, p.total, r.wall, 1e6 * p.total / p.iterations);
+  }
+}
+
+static void writeJSON(FILE* file, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+  fprintf(file, "{\n  \"kernel\": \"%s\",\n  \"steps\": %d,\n  \"couplings\": %d,\n  \"results\": [\n",
+          fluid_kernel_isa(), options.steps, options.couplings);
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    const FluidProfile& p = r.profile;
+    fprintf(file, "    {\"solver\": \"%s\", \"ranks\": %d, \"N\": %d, \"kappa\": %g, \"tau\": %g, "
+                  "\"calls\": %ld, \"unconverged\": %ld, \"newton_iterations\": %ld, \"factorizations\": %ld, \"linear_iterations\": %ld, "
+                  "\"residual_s\": %.6e, \"jacobian_s\": %.6e, \"factor_s\": %.6e, \"solve_s\": %.6e, "
+                  "\"newton_s\": %.6e, \"wall_s\": %.6e}%s\n",
+            solverNames[r.solver], r.ranks, r.N, r.kappa, r.tau,
+            p.calls, p.unconverged, p.iterations, p.factorizations, p.linearIterations,
+            p.residual, p.jacobian, p.factor, p.solve, p.total, r.wall, i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  BenchOptions options;
+  if (!parseArguments(options, argc, argv)) {
+    if (rank == 0)
+      usage(argv[0]);
+    MPI_Finalize();
+    return -1;
+  }
+
+  // The benchmarked solvers are the ones of the partitioned run
+  if (options.fluid.engine == FLUID_ENGINE_EXPLICIT) {
+    if (rank == 0)
+      std::cerr << "--engine=explicit is only available in the MonolithicSolver." << std::endl;
+    MPI_Finalize();
+    return -1;
+  }
+
+  // Every sample is one solve of a time window of fixed size on the uniform mesh of the parallel solvers
+  if (options.fluid.dtTol > 0.0 || !options.fluid.mesh.empty() || options.fluid.refine > 0) {
+    if (rank == 0)
+      std::cerr << "--dt-tol, --mesh and --refine are only available in the serial solvers." << std::endl;
+    MPI_Finalize();
+    return -1;
+  }
+
+  if (rank == 0)
+    std::cerr << "Assembly kernel: " << fluid_kernel_isa() << ", ranks: " << size << std::endl;
+
+  std::vector<BenchResult> results;
+  for (int N : options.N) {
+    for (double kappa : options.kappa) {
+      for (double tau : options.tau) {
+        for (int s = 0; s < BENCH_SOLVER_COUNT; s++) {
+          BenchResult result;
+          result.solver = (BenchSolver)s;
+          result.ranks = s == BENCH_SERIAL ? 1 : size;
+          result.N = N;
+          result.kappa = kappa;
+          result.tau = tau;
+
+          if (!options.solvers[s])
+            continue;
+          if (s != BENCH_SERIAL && (options.fluid.engine != FLUID_ENGINE_NEWTON || options.fluid.predictor != FLUID_PREDICTOR_NONE ||
+                                    options.fluid.couplingForcing > 0.0))
+            continue;
+          TubePartition partition;
+          tube_partition_boundary(partition, N + 1, size, options.fluid.boundaryWeight);
+          if (s == BENCH_DISTRIBUTED && tube_partition_min_count(partition) < 4) {
+            if (rank == 0)
+              std::cerr << "Skipping distributed N=" << N << ", every rank needs at least 4 nodes" << std::endl;
+            continue;
+          }
+
+          if (s == BENCH_SERIAL) {
+            if (rank != 0)
+              continue;
+            runSerial(options, N, kappa, tau, result);
+          } else {
+            runParallel(options, s == BENCH_DISTRIBUTED, N, kappa, tau, partition, rank, size, result);
+          }
+
+          if (rank == 0) {
+            std::cerr << solverNames[s] << " N=" << N << " kappa=" << kappa << " tau=" << tau
+                      << ": " << result.profile.total << " s" << std::endl;
+            results.push_back(result);
+          }
+        }
+      }
+    }
+  }
+
+  if (rank == 0) {
+    FILE* file = fopen(options.output.c_str(), "w");
+    if (!file) {
+      std::cerr << "Cannot write " << options.output << std::endl;
+    } else {
+      if (options.json)
+        writeJSON(file, options, results);
+      else
+        writeCSV(file, options, results);
+      fclose(file);
+      std::cerr << "Results written to " << options.output << std::endl;
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
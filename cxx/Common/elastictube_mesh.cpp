@@ -0,0 +1,106 @@
+#include "elastictube_mesh.h"
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+
+void tube_mesh_uniform(TubeMesh& mesh, int N)
+{
+  mesh.elements = N;
+  mesh.length = N;
+  mesh.x.clear();
+  mesh.width.clear();
+}
+
+void tube_mesh_nodes(TubeMesh& mesh, const std::vector<double>& x)
+{
+  int n = (int)x.size();
+  mesh.elements = n - 1;
+  mesh.length = x[n - 1];
+  mesh.x = x;
+  mesh.width.resize(n);
+  mesh.width[0] = 0.5 * (x[1] - x[0]);
+  for (int i = 1; i < n - 1; i++)
+    mesh.width[i] = 0.5 * (x[i + 1] - x[i - 1]);
+  mesh.width[n - 1] = 0.5 * (x[n - 1] - x[n - 2]);
+}
+
+bool tube_mesh_read(TubeMesh& mesh, const char* path, int N)
+{
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    printf("Cannot open mesh file %s\n", path);
+    return false;
+  }
+
+  std::vector<double> x;
+  double position;
+  while (fscanf(file, "%lf", &position) == 1)
+    x.push_back(position);
+  bool complete = feof(file) != 0;
+  fclose(file);
+
+  if (!complete) {
+    printf("%s contains something else than node positions after node %d\n", path, (int)x.size());
+    return false;
+  }
+
+  // The boundary conditions extrapolate from the first and the last two elements
+  if (x.size() < 3) {
+    printf("%s holds %d nodes, at least 3 are needed\n", path, (int)x.size());
+    return false;
+  }
+  for (size_t i = 1; i < x.size(); i++) {
+    if (!(x[i] > x[i - 1])) {
+      printf("Node %d of %s is not behind node %d\n", (int)i, path, (int)i - 1);
+      return false;
+    }
+  }
+  if (x[0] != 0.0 || fabs(x.back() - N) > 1e-9 * N) {
+    printf("The nodes of %s span [%g, %g], expected [0, %d]\n", path, x[0], x.back(), N);
+    return false;
+  }
+  x.back() = N;
+
+  tube_mesh_nodes(mesh, x);
+  return true;
+}
+
+void tube_mesh_grid(const TubeMesh& mesh, double* grid, int dimensions)
+{
+  for (int i = 0; i <= mesh.elements; i++) {
+    for (int dim = 0; dim < dimensions; dim++)
+      grid[i * dimensions + dim] = dim == 0 ? tube_mesh_position(mesh, i) : 0.0;
+  }
+}
+
+void tube_mesh_interpolate(const TubeMesh& from, const double* values, const TubeMesh& to, double* result)
+{
+  int j = 0;
+  for (int i = 0; i <= to.elements; i++) {
+    double position = tube_mesh_position(to, i);
+    while (j < from.elements && tube_mesh_position(from, j + 1) <= position)
+      j++;
+    if (j == from.elements) {
+      result[i] = values[j];
+      continue;
+    }
+    double left = tube_mesh_position(from, j);
+    double s = (position - left) / (tube_mesh_position(from, j + 1) - left);
+    result[i] = values[j] + s * (values[j + 1] - values[j]);
+  }
+}
+
+bool tube_mesh_option(std::string& path, const std::string& name, const std::string& value, bool& valid)
+{
+  if (name != "mesh")
+    return false;
+  path = value;
+  valid = !value.empty();
+  return true;
+}
+
+void tube_mesh_usage()
+{
+  std::cout << "  --mesh=<file>         Serial solvers: node positions from 0 to N, see Common/elastictube_mesh.h" << std::endl;
+  std::cout << "                        (default uniform)." << std::endl;
+}
@@ -0,0 +1,59 @@
+#ifndef ELASTICTUBE_MESH_H_
+#define ELASTICTUBE_MESH_H_
+
+#include <string>
+#include <vector>
+
+/*
+   Node positions of the tube, used by the serial solvers. Positions are measured in
+   elements of the uniform reference mesh of N elements, the tube spans 0 <= x <= N for
+   any number of elements of the mesh, and the coupling meshes of fluid and structure
+   have their vertices at (x, 0). The uniform mesh x[i] = i stores no arrays, the
+   discretizations keep their uniform code path for it.
+
+   A mesh file (--mesh=<file>) lists the positions of all nodes as text, separated by
+   white space and increasing from 0 to N, e.g. finer elements where the pressure wave
+   enters the tube. Fluid and structure have to read the same file.
+*/
+struct TubeMesh {
+  int elements;              // mesh elements, elements+1 nodes
+  double length;             // N, the length of the tube in reference elements
+  std::vector<double> x;     // positions of the nodes, empty for the uniform mesh
+  std::vector<double> width; // control volume of every node in reference elements, empty for the uniform mesh
+};
+
+/* The uniform mesh of N elements */
+void tube_mesh_uniform(TubeMesh& mesh, int N);
+
+/* Mesh of the positions x, from 0 to the tube length x.back() */
+void tube_mesh_nodes(TubeMesh& mesh, const std::vector<double>& x);
+
+/* Reads the positions of path for a tube of N reference elements. Prints a message and returns false on error. */
+bool tube_mesh_read(TubeMesh& mesh, const char* path, int N);
+
+inline bool tube_mesh_is_uniform(const TubeMesh& mesh)
+{
+  return mesh.x.empty();
+}
+
+inline double tube_mesh_position(const TubeMesh& mesh, int i)
+{
+  return mesh.x.empty() ? (double)i : mesh.x[i];
+}
+
+/* Coordinates of the nodes for setMeshVertices() and the output, y and z are zero */
+void tube_mesh_grid(const TubeMesh& mesh, double* grid, int dimensions);
+
+/*
+   Linear interpolation of the nodal values of from to the nodes of to. Values at nodes
+   present in both meshes are copied exactly.
+*/
+void tube_mesh_interpolate(const TubeMesh& from, const double* values, const TubeMesh& to, double* result);
+
+/* Parses --mesh. Returns false if name is not mesh, otherwise sets valid. */
+bool tube_mesh_option(std::string& path, const std::string& name, const std::string& value, bool& valid);
+
+/* Prints the mesh option in the format of the solver usages */
+void tube_mesh_usage();
+
+#endif
@@ -0,0 +1,94 @@
+#include "elastictube_partition.h"
+#include <algorithm>
+#include <mpi.h>
+#include <math.h>
+
+void tube_partition_block(TubePartition& partition, int nodes, int size)
+{
+  tube_partition_weighted(partition, nodes, std::vector<double>(size, 1.0));
+}
+
+void tube_partition_weighted(TubePartition& partition, int nodes, const std::vector<double>& weights)
+{
+  int size = weights.size();
+  double total = 0.0;
+  for (int r = 0; r < size; r++)
+    total += weights[r];
+
+  partition.nodes = nodes;
+  partition.counts.assign(size, 0);
+  partition.offsets.assign(size, 0);
+
+  // Integer parts of the shares, the remaining nodes go to the largest fractional parts
+  std::vector<double> remainder(size);
+  int assigned = 0;
+  for (int r = 0; r < size; r++) {
+    double share = nodes * weights[r] / total;
+    partition.counts[r] = (int)floor(share);
+    remainder[r] = share - partition.counts[r];
+    assigned += partition.counts[r];
+  }
+  std::vector<int> order(size);
+  for (int r = 0; r < size; r++)
+    order[r] = r;
+  std::stable_sort(order.begin(), order.end(), [&remainder](int a, int b) { return remainder[a] > remainder[b]; });
+  for (int i = 0; assigned < nodes; i = (i + 1) % size, assigned++)
+    partition.counts[order[i]]++;
+
+  for (int r = 1; r < size; r++)
+    partition.offsets[r] = partition.offsets[r - 1] + partition.counts[r - 1];
+}
+
+void tube_partition_boundary(TubePartition& partition, int nodes, int size, double boundaryWeight)
+{
+  std::vector<double> weights(size, 1.0);
+  weights[0] = boundaryWeight;
+  weights[size - 1] = boundaryWeight;
+  tube_partition_weighted(partition, nodes, weights);
+}
+
+int tube_partition_min_count(const TubePartition& partition)
+{
+  return *std::min_element(partition.counts.begin(), partition.counts.end());
+}
+
+/* One node of fields arrays of length stride, with the extent of one value */
+static MPI_Datatype nodeType(int fields, int stride)
+{
+  MPI_Datatype vector, node;
+  MPI_Type_vector(fields, 1, stride, MPI_DOUBLE, &vector);
+  MPI_Type_create_resized(vector, 0, sizeof(double), &node);
+  MPI_Type_commit(&node);
+  MPI_Type_free(&vector);
+  return node;
+}
+
+void tube_partition_gather(const TubePartition& partition, int fields, const double* local,
+                           double* gathered, int root)
+{
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int count = partition.counts[rank];
+
+  MPI_Datatype localNode = nodeType(fields, count);
+  MPI_Datatype globalNode = nodeType(fields, partition.nodes);
+  MPI_Gatherv(local, count, localNode,
+              gathered, partition.counts.data(), partition.offsets.data(), globalNode, root, MPI_COMM_WORLD);
+  MPI_Type_free(&localNode);
+  MPI_Type_free(&globalNode);
+}
+
+void tube_partition_scatter(const TubePartition& partition, int fields, const double* gathered,
+                            double* local, int root)
+{
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int count = partition.counts[rank];
+
+  MPI_Datatype localNode = nodeType(fields, count);
+  MPI_Datatype globalNode = nodeType(fields, partition.nodes);
+  MPI_Scatterv(gathered, partition.counts.data(), partition.offsets.data(), globalNode,
+               local, count, localNode, root, MPI_COMM_WORLD);
+  MPI_Type_free(&localNode);
+  MPI_Type_free(&globalNode);
+}
@@ -0,0 +1,51 @@
+#ifndef ELASTICTUBE_PARTITION_H_
+#define ELASTICTUBE_PARTITION_H_
+
+#include <vector>
+
+/*
+   Decomposition of the N+1 nodes of the tube into contiguous chunks, one per rank, used
+   by the parallel fluid and structure solvers. Every rank gets a share of the nodes
+   proportional to its weight, rounded with the largest remainder method; equal weights
+   give the first (N+1) % size ranks one node more than the others.
+
+   The partition also moves the data of the centralized fluid solve: all fields of a
+   rank are packed node by node and exchanged with one MPI_Gatherv / MPI_Scatterv, the
+   receive side of rank 0 uses a derived datatype that places every node into the
+   separate field arrays directly.
+*/
+struct TubePartition {
+  int nodes;                // N+1
+  std::vector<int> counts;  // nodes of every rank
+  std::vector<int> offsets; // first node of every rank
+};
+
+/* Nodes split as evenly as possible over size ranks */
+void tube_partition_block(TubePartition& partition, int nodes, int size);
+
+/* Nodes split proportionally to the weights of the ranks */
+void tube_partition_weighted(TubePartition& partition, int nodes, const std::vector<double>& weights);
+
+/*
+   The first and the last rank weigh boundaryWeight, all others 1. The boundary ranks get
+   extra nodes with boundaryWeight > 1, fewer with boundaryWeight < 1, e.g. to compensate
+   for the assembly of the boundary conditions.
+*/
+void tube_partition_boundary(TubePartition& partition, int nodes, int size, double boundaryWeight);
+
+/* Smallest number of nodes of a rank */
+int tube_partition_min_count(const TubePartition& partition);
+
+/*
+   Gathers fields arrays to root of MPI_COMM_WORLD. local holds the fields arrays of the
+   counts[rank] local nodes one after another, gathered on root the fields arrays of all
+   nodes.
+*/
+void tube_partition_gather(const TubePartition& partition, int fields, const double* local,
+                           double* gathered, int root);
+
+/* Inverse of tube_partition_gather() */
+void tube_partition_scatter(const TubePartition& partition, int fields, const double* gathered,
+                            double* local, int root);
+
+#endif
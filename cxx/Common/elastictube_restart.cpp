@@ -0,0 +1,161 @@
+#include "elastictube_restart.h"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static bool parseInt(const std::string& value, int& result)
+{
+  char* end;
+  result = (int)strtol(value.c_str(), &end, 10);
+  return !value.empty() && *end == '\0';
+}
+
+bool tube_restart_option(TubeRestartOptions& options, const std::string& name, const std::string& value, bool& valid)
+{
+  if (name == "restart-interval") {
+    valid = parseInt(value, options.interval) && options.interval >= 0;
+  } else if (name == "restart") {
+    valid = parseInt(value, options.window) && options.window >= 0;
+  } else if (name == "restart-prefix") {
+    options.prefix = value;
+    valid = !value.empty();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool tube_restart_parse(TubeRestartOptions& options, int argc, char** argv, int first)
+{
+  for (int i = first; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string::size_type pos = arg.find('=');
+
+    if (arg.compare(0, 2, "--") != 0 || pos == std::string::npos) {
+      std::cout << "Invalid argument " << arg << ", expected --name=value" << std::endl;
+      return false;
+    }
+
+    std::string name = arg.substr(2, pos - 2);
+    std::string value = arg.substr(pos + 1);
+    bool valid;
+
+    if (!tube_restart_option(options, name, value, valid)) {
+      std::cout << "Unknown option --" << name << std::endl;
+      return false;
+    }
+    if (!valid) {
+      std::cout << "Invalid value " << value << " for option --" << name << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+void tube_restart_usage()
+{
+  std::cout << "  --restart-interval=<w>" << std::endl;
+  std::cout << "                        Write a restart file every w time windows (default 0, never)." << std::endl;
+  std::cout << "  --restart=<w>         Resume after time window w from the restart files of all participants." << std::endl;
+  std::cout << "  --restart-prefix=<p>  Restart files are <p>-<participant>-<window>.restart (default restart)." << std::endl;
+}
+
+std::string tube_restart_path(const TubeRestartOptions& options, const char* participant, int window)
+{
+  return options.prefix + "-" + participant + "-" + std::to_string(window) + ".restart";
+}
+
+bool tube_restart_write(const char* path, const char* participant, int window, double time, int points,
+                        int fields, const char* const* names, const double* const* data)
+{
+  for (int f = 0; f < fields; f++) {
+    if (strlen(names[f]) >= sizeof(TubeRestartHeader::names[0])) {
+      printf("Field name %s of %s is too long\n", names[f], path);
+      return false;
+    }
+  }
+
+  std::string temporary = std::string(path) + ".tmp";
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (!file) {
+    printf("Cannot write %s\n", temporary.c_str());
+    return false;
+  }
+
+  TubeRestartHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TUBE_RESTART_MAGIC, sizeof(header.magic));
+  header.version = TUBE_RESTART_VERSION;
+  header.fields = fields;
+  header.points = points;
+  header.window = window;
+  header.time = time;
+  strncpy(header.participant, participant, sizeof(header.participant) - 1);
+  for (int f = 0; f < fields; f++)
+    strncpy(header.names[f], names[f], sizeof(header.names[f]) - 1);
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (int f = 0; f < fields && written; f++)
+    written = fwrite(data[f], sizeof(double), points, file) == (size_t)points;
+  written = fflush(file) == 0 && written;
+  written = fsync(fileno(file)) == 0 && written;
+  written = fclose(file) == 0 && written;
+
+  // the file of the window only appears when it is complete
+  if (!written || rename(temporary.c_str(), path) != 0) {
+    printf("Cannot write %s\n", path);
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool tube_restart_read(const char* path, const char* participant, int points,
+                       int fields, const char* const* names, double* const* data, int& window, double& time)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    printf("Cannot open restart file %s\n", path);
+    return false;
+  }
+
+  TubeRestartHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, TUBE_RESTART_MAGIC, sizeof(header.magic)) == 0 &&
+               header.version == TUBE_RESTART_VERSION;
+  if (!valid) {
+    printf("%s is not a restart file of version %d\n", path, TUBE_RESTART_VERSION);
+    fclose(file);
+    return false;
+  }
+
+  header.participant[sizeof(header.participant) - 1] = '\0';
+  if (strcmp(header.participant, participant) != 0 || header.fields != (uint32_t)fields || header.points != (uint64_t)points) {
+    printf("%s holds %u fields of %s on %lu points, expected %d fields of %s on %d points\n", path, header.fields,
+           header.participant, (unsigned long)header.points, fields, participant, points);
+    fclose(file);
+    return false;
+  }
+  for (int f = 0; f < fields; f++) {
+    header.names[f][sizeof(header.names[f]) - 1] = '\0';
+    if (strcmp(header.names[f], names[f]) != 0) {
+      printf("%s holds the field %s, expected %s\n", path, header.names[f], names[f]);
+      fclose(file);
+      return false;
+    }
+  }
+
+  for (int f = 0; f < fields && valid; f++)
+    valid = fread(data[f], sizeof(double), points, file) == (size_t)points;
+  fclose(file);
+  if (!valid) {
+    printf("%s is truncated\n", path);
+    return false;
+  }
+
+  window = header.window;
+  time = header.time;
+  return true;
+}
@@ -0,0 +1,96 @@
+#ifndef ELASTICTUBE_RESTART_H_
+#define ELASTICTUBE_RESTART_H_
+
+#include <stdint.h>
+#include <string>
+
+/*
+   Restart files of the solvers. Every interval time windows, each participant writes the
+   fields it needs to continue after the window into <prefix>-<participant>-<window>.restart,
+   the parallel solvers gather them to rank 0 and write one file with the values of all
+   N+1 nodes, so a run can resume on another number of ranks. All values are stored in
+   native byte order, the layout is
+
+     TubeRestartHeader                 120 bytes
+     field 0     double[points]
+     field 1     ...
+
+   A file is written to <path>.tmp and renamed when complete, a crash while writing leaves
+   the previous restart files intact.
+
+   Resuming with --restart=<window> loads the files of that window in all participants
+   before preCICE is initialized. The state of preCICE itself (extrapolation, IQN-ILS
+   history) is not part of the files, so the first windows after a restart converge like
+   at the start of a run. The coupling restarts at time 0 for preCICE, max-time of the
+   configuration has to be the remaining time.
+*/
+
+#define TUBE_RESTART_MAGIC "TUBERSTR"
+#define TUBE_RESTART_VERSION 1
+#define TUBE_RESTART_MAX_FIELDS 4
+
+struct TubeRestartHeader {
+  char magic[8];        // TUBE_RESTART_MAGIC, not null-terminated
+  uint32_t version;     // TUBE_RESTART_VERSION
+  uint32_t fields;      // fields in the file, at most TUBE_RESTART_MAX_FIELDS
+  uint64_t points;      // N+1
+  uint64_t window;      // completed time windows
+  double time;          // time after the last completed window
+  char participant[16]; // "FLUID", "STRUCTURE", ...
+  char names[TUBE_RESTART_MAX_FIELDS][16]; // at most 15 characters
+};
+
+/* Command line arguments of the restart, shared by all solvers */
+struct TubeRestartOptions {
+  int interval = 0;               // write a restart file every interval windows, 0 never
+  int window = -1;                // resume after this window, -1 start at time 0
+  std::string prefix = "restart"; // path prefix of the files
+};
+
+/*
+   Parses --restart-interval, --restart and --restart-prefix. Returns false if name is none
+   of them, otherwise sets valid.
+*/
+bool tube_restart_option(TubeRestartOptions& options, const std::string& name, const std::string& value, bool& valid);
+
+/* Parses argv[first..argc-1], which may only contain restart options. Prints a message and returns false on error. */
+bool tube_restart_parse(TubeRestartOptions& options, int argc, char** argv, int first);
+
+/* Prints the restart options in the format of the solver usages */
+void tube_restart_usage();
+
+std::string tube_restart_path(const TubeRestartOptions& options, const char* participant, int window);
+
+/* True if a restart file is due after window completed windows */
+inline bool tube_restart_due(const TubeRestartOptions& options, int window)
+{
+  return options.interval > 0 && window % options.interval == 0;
+}
+
+/* Writes fields arrays of points values, data[f] is named names[f]. False on error. */
+bool tube_restart_write(const char* path, const char* participant, int window, double time, int points,
+                        int fields, const char* const* names, const double* const* data);
+
+/*
+   Reads the file written by tube_restart_write() with the same participant, points and
+   names into data, and the window and time it was written after. Prints a message and
+   returns false if the file does not exist or does not match.
+*/
+bool tube_restart_read(const char* path, const char* participant, int points,
+                       int fields, const char* const* names, double* const* data, int& window, double& time);
+
+/*
+   Parallel solvers, in elastictube_restart_parallel.cpp: the fields of the local nodes of
+   all ranks are gathered to rank 0, which writes the file, or read on rank 0 and scattered.
+   The result of the read is returned on all ranks.
+*/
+struct TubePartition;
+
+bool tube_restart_write_partitioned(const TubePartition& partition, const char* path, const char* participant,
+                                    int window, double time, int fields, const char* const* names,
+                                    const double* const* data);
+
+bool tube_restart_read_partitioned(const TubePartition& partition, const char* path, const char* participant,
+                                   int fields, const char* const* names, double* const* data, int& window, double& time);
+
+#endif
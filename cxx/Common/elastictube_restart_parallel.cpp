@@ -0,0 +1,65 @@
+#include "elastictube_partition.h"
+#include "elastictube_restart.h"
+#include <mpi.h>
+
+/*
+   The fields of a rank are packed one after another, the gathered fields of all nodes
+   on rank 0 as well, see tube_partition_gather().
+*/
+
+bool tube_restart_write_partitioned(const TubePartition& partition, const char* path, const char* participant,
+                                    int window, double time, int fields, const char* const* names,
+                                    const double* const* data)
+{
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int count = partition.counts[rank];
+
+  std::vector<double> local(fields * count);
+  for (int f = 0; f < fields; f++)
+    for (int i = 0; i < count; i++)
+      local[f * count + i] = data[f][i];
+  std::vector<double> gathered(rank == 0 ? fields * partition.nodes : 0);
+  tube_partition_gather(partition, fields, local.data(), gathered.data(), 0);
+
+  int written = 1;
+  if (rank == 0) {
+    const double* gatheredFields[TUBE_RESTART_MAX_FIELDS];
+    for (int f = 0; f < fields; f++)
+      gatheredFields[f] = gathered.data() + f * partition.nodes;
+    written = tube_restart_write(path, participant, window, time, partition.nodes, fields, names, gatheredFields);
+  }
+  MPI_Bcast(&written, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  return written != 0;
+}
+
+bool tube_restart_read_partitioned(const TubePartition& partition, const char* path, const char* participant,
+                                   int fields, const char* const* names, double* const* data, int& window, double& time)
+{
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int count = partition.counts[rank];
+
+  std::vector<double> gathered(rank == 0 ? fields * partition.nodes : 0);
+  double header[3] = {0.0, 0.0, 0.0}; // read, window, time
+  if (rank == 0) {
+    double* gatheredFields[TUBE_RESTART_MAX_FIELDS];
+    for (int f = 0; f < fields; f++)
+      gatheredFields[f] = gathered.data() + f * partition.nodes;
+    header[0] = tube_restart_read(path, participant, partition.nodes, fields, names, gatheredFields, window, time);
+    header[1] = window;
+    header[2] = time;
+  }
+  MPI_Bcast(header, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if (header[0] == 0.0)
+    return false;
+
+  std::vector<double> local(fields * count);
+  tube_partition_scatter(partition, fields, gathered.data(), local.data(), 0);
+  for (int f = 0; f < fields; f++)
+    for (int i = 0; i < count; i++)
+      data[f][i] = local[f * count + i];
+  window = (int)header[1];
+  time = header[2];
+  return true;
+}
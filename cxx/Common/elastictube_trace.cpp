@@ -0,0 +1,102 @@
+#include "elastictube_trace.h"
+
+#ifdef ELASTICTUBE_TRACE
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+struct TraceEvent {
+  const char* name;
+  char phase;   // 'X' complete event, 'C' counter
+  double start; // seconds
+  double value; // duration in seconds, or the counter value
+  int window;
+  int iteration;
+};
+
+static struct {
+  const char* participant = NULL;
+  int rank = 0;
+  int window = 0;
+  int iteration = 0;
+  std::vector<TraceEvent> events;
+} trace;
+
+/* Process id of the participant in the merged timeline */
+static int participantId(const char* participant)
+{
+  unsigned int hash = 5381;
+  for (const char* c = participant; *c; c++)
+    hash = hash * 33 + (unsigned char)*c;
+  return (int)(hash % 100000);
+}
+
+double trace_clock()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_begin(const char* participant, int rank)
+{
+  trace.participant = participant;
+  trace.rank = rank;
+  trace.events.reserve(1 << 16);
+}
+
+void trace_window(int window, int iteration)
+{
+  trace.window = window;
+  trace.iteration = iteration;
+}
+
+void trace_complete(const char* name, double start, double end)
+{
+  if (trace.participant)
+    trace.events.push_back({name, 'X', start, end - start, trace.window, trace.iteration});
+}
+
+void trace_counter(const char* name, double value)
+{
+  if (trace.participant)
+    trace.events.push_back({name, 'C', trace_clock(), value, trace.window, trace.iteration});
+}
+
+void trace_end()
+{
+  if (!trace.participant)
+    return;
+
+  char filename[256];
+  snprintf(filename, sizeof(filename), "trace-%s-%d.json", trace.participant, trace.rank);
+  FILE* file = fopen(filename, "w");
+  if (!file) {
+    fprintf(stderr, "Cannot write trace %s\n", filename);
+    return;
+  }
+
+  // One process per participant, one thread per rank
+  int pid = participantId(trace.participant);
+  fprintf(file, "{\"traceEvents\": [\n");
+  fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}},\n",
+          pid, trace.rank, trace.participant);
+  fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"rank %d\"}}",
+          pid, trace.rank, trace.rank);
+  for (const TraceEvent& event : trace.events) {
+    if (event.phase == 'X')
+      fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, "
+                    "\"args\": {\"window\": %d, \"iteration\": %d}}",
+              event.name, 1e6 * event.start, 1e6 * event.value, pid, trace.rank, event.window, event.iteration);
+    else
+      fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d, "
+                    "\"args\": {\"value\": %.17g}}",
+              event.name, 1e6 * event.start, pid, trace.rank, event.value);
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+
+  trace.participant = NULL;
+  trace.events.clear();
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef ELASTICTUBE_TRACE_H_
+#define ELASTICTUBE_TRACE_H_
+
+/*
+   Timeline of the solver processes in the Chrome trace event format, which can be opened
+   in chrome://tracing or https://ui.perfetto.dev. Every rank of every participant writes
+   trace-<participant>-<rank>.json at the end of the run. All events carry the time window
+   and the coupling iteration in which they were recorded. The timestamps are taken from
+   the monotonic system clock, so the files of all processes on one machine share a time
+   axis and can be loaded together.
+
+   Tracing is only compiled in with ELASTICTUBE_TRACE defined (cmake -DELASTICTUBE_TRACE=ON
+   or scons trace=1), otherwise all TRACE_* macros expand to nothing. Event names have to
+   be string literals, they are stored by pointer until the file is written.
+*/
+
+#ifdef ELASTICTUBE_TRACE
+
+void trace_begin(const char* participant, int rank);
+void trace_end();
+void trace_window(int window, int iteration);
+void trace_complete(const char* name, double start, double end);
+void trace_counter(const char* name, double value);
+
+/* Monotonic wall clock in seconds, the same clock as fluid_clock() */
+double trace_clock();
+
+/* Records the lifetime of the object as one event */
+class TraceScope {
+public:
+  explicit TraceScope(const char* name) : name(name), start(trace_clock()) {}
+  ~TraceScope() { trace_complete(name, start, trace_clock()); }
+
+private:
+  const char* name;
+  double start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_BEGIN(participant, rank) trace_begin(participant, rank)
+#define TRACE_END() trace_end()
+#define TRACE_WINDOW(window, iteration) trace_window(window, iteration)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_COMPLETE(name, start, end) trace_complete(name, start, end)
+#define TRACE_COUNTER(name, value) trace_counter(name, value)
+
+#else
+
+#define TRACE_BEGIN(participant, rank) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_WINDOW(window, iteration) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COMPLETE(name, start, end) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+#include "fluid_banded.h"
+#include "fluid_memory.h"
+#include <cfloat>
+#include <cmath>
+
+/*
+   LAPACK DGBTRF computes the LU factorization of a band matrix with KL subdiagonals and
+   KU superdiagonals, DGBTRS solves A * X = B with these factors. SGBTRF and SGBTRS are
+   the same in single precision.
+*/
+extern "C" {
+void dgbtrf_(
+    int* m,
+    int* n,
+    int* kl,
+    int* ku,
+    double* ab,
+    int* ldab,
+    int* ipiv,
+    int* info);
+
+void dgbtrs_(
+    char* trans,
+    int* n,
+    int* kl,
+    int* ku,
+    int* nrhs,
+    double* ab,
+    int* ldab,
+    int* ipiv,
+    double* b,
+    int* ldb,
+    int* info);
+
+void sgbtrf_(
+    int* m,
+    int* n,
+    int* kl,
+    int* ku,
+    float* ab,
+    int* ldab,
+    int* ipiv,
+    int* info);
+
+void sgbtrs_(
+    char* trans,
+    int* n,
+    int* kl,
+    int* ku,
+    int* nrhs,
+    float* ab,
+    int* ldab,
+    int* ipiv,
+    float* b,
+    int* ldb,
+    int* info);
+}
+
+// Refinement steps before a solve falls back to double precision, as in DSGESV
+static const int FLUID_BAND_MAX_REFINEMENTS = 30;
+
+void fluid_band_allocate(FluidBand& band, int N, bool mixed)
+{
+  band.N    = N;
+  band.n    = 2 * N + 2;
+  band.kl   = 4;
+  band.ku   = 4;
+  band.ldab = 2 * band.kl + band.ku + 1;
+  band.ab   = fluid_alloc<double>(band.ldab * band.n);
+  band.x    = fluid_alloc<double>(band.n);
+  band.ipiv = fluid_alloc<int>(band.n);
+
+  band.abf         = NULL;
+  band.xf          = NULL;
+  band.r           = NULL;
+  band.single      = false;
+  band.norm        = 0.0;
+  band.refinements = 0;
+  band.fallbacks   = 0;
+  if (mixed) {
+    band.abf = fluid_alloc<float>(band.ldab * band.n);
+    band.xf  = fluid_alloc<float>(band.n);
+    band.r   = fluid_alloc<double>(band.n);
+  }
+}
+
+void fluid_band_free(FluidBand& band)
+{
+  fluid_free(band.ab);
+  fluid_free(band.x);
+  fluid_free(band.ipiv);
+  fluid_free(band.abf);
+  fluid_free(band.xf);
+  fluid_free(band.r);
+  band.ab   = NULL;
+  band.x    = NULL;
+  band.ipiv = NULL;
+  band.abf  = NULL;
+  band.xf   = NULL;
+  band.r    = NULL;
+}
+
+void fluid_band_zero(FluidBand& band)
+{
+  for (int i = 0; i < band.ldab * band.n; i++)
+    band.ab[i] = 0.0;
+}
+
+/* Single precision copy and factorization of the assembled band, false if it does not fit or is singular in single precision */
+static bool fluid_band_factor_single(FluidBand& band)
+{
+  int n = band.n, ldab = band.ldab;
+  double largest = 0.0;
+  for (int i = 0; i < ldab * n; i++) {
+    largest = std::fmax(largest, std::fabs(band.ab[i]));
+    band.abf[i] = (float)band.ab[i];
+  }
+  if (!(largest <= FLT_MAX))
+    return false;
+
+  // Infinity norm of the band for the stopping criterion of the refinement, row sums in band.r
+  for (int r = 0; r < n; r++)
+    band.r[r] = 0.0;
+  for (int c = 0; c < n; c++) {
+    const double* column = band.ab + c * ldab + band.kl + band.ku - c;
+    int first = c - band.ku > 0 ? c - band.ku : 0;
+    int last = c + band.kl < n - 1 ? c + band.kl : n - 1;
+    for (int r = first; r <= last; r++)
+      band.r[r] += std::fabs(column[r]);
+  }
+  band.norm = 0.0;
+  for (int r = 0; r < n; r++)
+    band.norm = std::fmax(band.norm, band.r[r]);
+
+  int info;
+  sgbtrf_(&band.n, &band.n, &band.kl, &band.ku, band.abf, &band.ldab, band.ipiv, &info);
+  return info == 0;
+}
+
+int fluid_band_factor(FluidBand& band)
+{
+  band.single = band.abf && fluid_band_factor_single(band);
+  if (band.single)
+    return 0;
+  if (band.abf)
+    band.fallbacks++;
+
+  int info;
+  dgbtrf_(&band.n, &band.n, &band.kl, &band.ku, band.ab, &band.ldab, band.ipiv, &info);
+  return info;
+}
+
+/* Iterative refinement of band.x from the single precision factors, false if it does not converge */
+static bool fluid_band_refine(FluidBand& band)
+{
+  int n = band.n;
+  int nrhs = 1;
+  int info;
+  char trans = 'N';
+  double tolerance = band.norm * DBL_EPSILON * std::sqrt((double)n);
+  double previous = HUGE_VAL;
+
+  // The first step solves for the complete right hand side, starting from zero
+  for (int i = 0; i < n; i++) {
+    band.x[i] = 0.0;
+    band.xf[i] = (float)band.r[i];
+  }
+
+  for (int step = 0; step < FLUID_BAND_MAX_REFINEMENTS; step++) {
+    sgbtrs_(&trans, &n, &band.kl, &band.ku, &nrhs, band.abf, &band.ldab, band.ipiv, band.xf, &n, &info);
+    if (step > 0)
+      band.refinements++;
+
+    double xNorm = 0.0;
+    for (int i = 0; i < n; i++) {
+      band.x[i] += band.xf[i];
+      xNorm = std::fmax(xNorm, std::fabs(band.x[i]));
+    }
+
+    // Residual of the double precision band, rounded to single precision for the next correction.
+    // Row r holds the entries (r, c) at ab[kl + ku + r + c * (ldab - 1)].
+    double residualNorm = 0.0;
+    for (int r = 0; r < n; r++) {
+      int first = r - band.kl > 0 ? r - band.kl : 0;
+      int last = r + band.ku < n - 1 ? r + band.ku : n - 1;
+      const double* row = band.ab + band.kl + band.ku + r;
+      double residual = band.r[r];
+      for (int c = first; c <= last; c++)
+        residual -= row[c * (band.ldab - 1)] * band.x[c];
+      residualNorm = std::fmax(residualNorm, std::fabs(residual));
+      band.xf[r] = (float)residual;
+    }
+
+    if (residualNorm <= tolerance * xNorm)
+      return true;
+
+    // Stalled, e.g. for an ill-conditioned band
+    if (!(residualNorm < 0.5 * previous))
+      return false;
+    previous = residualNorm;
+  }
+  return false;
+}
+
+int fluid_band_substitute(FluidBand& band, double* b)
+{
+  int N = band.N;
+  int nrhs = 1;
+  int info = 0;
+  char trans = 'N';
+
+  if (band.single) {
+    for (int k = 0; k < band.n; k++)
+      band.r[fluid_band_index(k, N)] = b[k];
+
+    if (fluid_band_refine(band)) {
+      for (int k = 0; k < band.n; k++)
+        b[k] = band.x[fluid_band_index(k, N)];
+      return 0;
+    }
+
+    // Fall back to double precision, the assembled band is still in ab
+    band.single = false;
+    band.fallbacks++;
+    dgbtrf_(&band.n, &band.n, &band.kl, &band.ku, band.ab, &band.ldab, band.ipiv, &info);
+    if (info != 0)
+      return info;
+  }
+
+  for (int k = 0; k < band.n; k++)
+    band.x[fluid_band_index(k, N)] = b[k];
+
+  dgbtrs_(&trans, &band.n, &band.kl, &band.ku, &nrhs, band.ab, &band.ldab, band.ipiv, band.x, &band.n, &info);
+
+  for (int k = 0; k < band.n; k++)
+    b[k] = band.x[fluid_band_index(k, N)];
+
+  return info;
+}
+
+int fluid_band_solve(FluidBand& band, double* b)
+{
+  int info = fluid_band_factor(band);
+  if (info != 0)
+    return info;
+  return fluid_band_substitute(band, b);
+}
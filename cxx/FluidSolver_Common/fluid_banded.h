@@ -0,0 +1,81 @@
+#ifndef FLUID_BANDED_H_
+#define FLUID_BANDED_H_
+
+/*
+   Banded storage of the Newton Jacobian of the 1D tube.
+
+   The 2N+2 unknowns are interleaved per node, i.e. (u_0, p_0, u_1, p_1, ..., u_N, p_N),
+   such that every row of the Jacobian only couples the nodes i-1, i and i+1. The
+   boundary rows (pressure inlet and velocity outlet are extrapolated over three nodes)
+   fit into the same band, which has KL = KU = 4 sub- and superdiagonals.
+
+   The solvers keep assembling with the block index k that they use for their residual
+   (velocity rows/columns 0..N, pressure rows/columns N+1..2N+1), fluid_band_index()
+   maps it to the interleaved position. The matrix is stored in the general band format
+   of LAPACK (see DGBSV), which reserves KL additional rows for the fill-in of the LU
+   factorization. Memory and work are therefore O(N) instead of O(N^2) and O(N^3).
+
+   In mixed precision, the band is factorized in single precision (SGBTRF) and the
+   assembled band is kept in ab. Every solve starts from the single precision solution
+   and refines it with the residual of the double precision band, like DSGESV of LAPACK,
+   until the residual is at the level of the rounding errors of double precision. If the
+   band does not fit into single precision, SGBTRF fails or the refinement stalls, the
+   band is factorized in double precision and solved as usual; the factors are then
+   reused like all others.
+*/
+
+struct FluidBand {
+  int N;       // number of mesh elements, the system has 2N+2 unknowns
+  int n;       // order of the system
+  int kl;      // number of subdiagonals
+  int ku;      // number of superdiagonals
+  int ldab;    // leading dimension of ab, 2*kl+ku+1
+  double* ab;  // band matrix in LAPACK band storage, ldab x n, column-major
+  double* x;   // right hand side / solution in interleaved ordering
+  int* ipiv;   // pivot indices of the LU factorization
+
+  // mixed precision, NULL in double precision
+  float* abf;       // single precision LU factors, ldab x n
+  float* xf;        // single precision right hand side / correction
+  double* r;        // right hand side in interleaved ordering
+  bool single;      // the current factors are the ones in abf, ab holds the assembled band
+  double norm;      // infinity norm of the assembled band
+  long refinements; // refinement steps of all solves
+  long fallbacks;   // factorizations that fell back to double precision
+};
+
+/* Band for N mesh elements, in mixed precision if mixed */
+void fluid_band_allocate(FluidBand& band, int N, bool mixed);
+
+void fluid_band_free(FluidBand& band);
+
+void fluid_band_zero(FluidBand& band);
+
+/* Solves band * x = b in place, b is given in block ordering. Returns the LAPACK info. */
+int fluid_band_solve(FluidBand& band, double* b);
+
+/* LU factorization in place, the assembled entries are overwritten */
+int fluid_band_factor(FluidBand& band);
+
+/* Solves with the factors of fluid_band_factor, b is given in block ordering */
+int fluid_band_substitute(FluidBand& band, double* b);
+
+/* Interleaved position of block index k (velocity: k = i, pressure: k = N+1+i) */
+inline int fluid_band_index(int k, int N)
+{
+  return k <= N ? 2 * k : 2 * (k - N - 1) + 1;
+}
+
+/* Entry (r, c) of the Jacobian, both given as interleaved positions */
+inline double& fluid_band_at(FluidBand& band, int r, int c)
+{
+  return band.ab[band.kl + band.ku + r - c + c * band.ldab];
+}
+
+/* Entry (row, col) of the Jacobian, both given as block indices */
+inline double& fluid_band_entry(FluidBand& band, int row, int col)
+{
+  return fluid_band_at(band, fluid_band_index(row, band.N), fluid_band_index(col, band.N));
+}
+
+#endif
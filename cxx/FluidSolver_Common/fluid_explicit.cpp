@@ -0,0 +1,125 @@
+#include "fluid_explicit.h"
+#include "fluid_memory.h"
+#include <math.h>
+
+void fluid_explicit_allocate(FluidExplicit& engine, int N)
+{
+  int n = N + 1;
+  engine.n = n;
+  engine.A = fluid_alloc<double>(n);
+  engine.Q = fluid_alloc<double>(n);
+  engine.AP = fluid_alloc<double>(n);
+  engine.QP = fluid_alloc<double>(n);
+  engine.FA = fluid_alloc<double>(n);
+  engine.FQ = fluid_alloc<double>(n);
+}
+
+void fluid_explicit_free(FluidExplicit& engine)
+{
+  fluid_free(engine.A);
+  fluid_free(engine.Q);
+  fluid_free(engine.AP);
+  fluid_free(engine.QP);
+  fluid_free(engine.FA);
+  fluid_free(engine.FQ);
+  engine.A = engine.Q = NULL;
+  engine.AP = engine.QP = NULL;
+  engine.FA = engine.FQ = NULL;
+}
+
+/* Inverse of the tube law A = 4/(2-p)^2 */
+static inline double tube_pressure(double A)
+{
+  return 2.0 - 2.0 / sqrt(A);
+}
+
+/* Fluxes of A and Q, returns the largest wave speed |u| + c */
+static double fluxes(const double* A, const double* Q, double* FA, double* FQ, int n, int threads)
+{
+  double speed = 0.0;
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static) reduction(max : speed)
+  for (int i = 0; i < n; i++) {
+    double root = sqrt(A[i]);
+    double u = Q[i] / A[i];
+    FA[i] = Q[i];
+    FQ[i] = Q[i] * u + 2.0 * root;
+    speed = fmax(speed, fabs(u) + 1.0 / sqrt(root));
+  }
+  return speed;
+}
+
+/*
+   Boundary nodes of A and Q from their interior neighbours. The outlet keeps u + 4c of
+   AN, QN, its values at the beginning of the substep.
+*/
+static void boundary(double* A, double* Q, int N, double inletVelocity, double AN, double QN)
+{
+  // Velocity inlet is prescribed, pressure inlet is linearly extrapolated
+  double p0 = 2.0 * tube_pressure(A[1]) - tube_pressure(A[2]);
+  A[0] = 4.0 / ((2.0 - p0) * (2.0 - p0));
+  Q[0] = A[0] * inletVelocity;
+
+  // Velocity outlet is linearly extrapolated, pressure outlet is non-reflecting
+  double u = 2.0 * Q[N - 1] / A[N - 1] - Q[N - 2] / A[N - 2];
+  double c = 1.0 / sqrt(sqrt(AN)) - (u - QN / AN) / 4.0;
+  A[N] = 1.0 / (c * c * c * c);
+  Q[N] = A[N] * u;
+}
+
+int fluid_explicit_window(FluidExplicit& engine, TubeState& state, double dx, double inletVelocity, double cfl, int threads)
+{
+  int n = engine.n, N = n - 1;
+  double *A = engine.A, *Q = engine.Q, *AP = engine.AP, *QP = engine.QP, *FA = engine.FA, *FQ = engine.FQ;
+
+  const TubeFields& previous = state.previous;
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+  for (int i = 0; i < n; i++) {
+    A[i] = previous.crossSectionLength[i];
+    Q[i] = previous.crossSectionLength[i] * previous.velocity[i];
+  }
+
+  double window = 1.0 / dx;
+  double time = 0.0;
+  double inletPrevious = previous.velocity[0];
+  int substeps = 0;
+
+  while (time < window) {
+    double speed = fluxes(A, Q, FA, FQ, n, threads);
+    double dt = cfl / speed;
+    bool last = time + dt >= window * (1.0 - 1e-12); // no tiny substep at the end
+    if (last)
+      dt = window - time;
+    time = last ? window : time + dt;
+    double inlet = inletPrevious + (time / window) * (inletVelocity - inletPrevious);
+    double AN = A[N], QN = Q[N];
+
+    // Predictor with forward differences
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+    for (int i = 1; i < N; i++) {
+      AP[i] = A[i] - dt * (FA[i + 1] - FA[i]);
+      QP[i] = Q[i] - dt * (FQ[i + 1] - FQ[i]);
+    }
+    boundary(AP, QP, N, inlet, AN, QN);
+    fluxes(AP, QP, FA, FQ, n, threads);
+
+    // Corrector with backward differences
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+    for (int i = 1; i < N; i++) {
+      A[i] = 0.5 * (A[i] + AP[i] - dt * (FA[i] - FA[i - 1]));
+      Q[i] = 0.5 * (Q[i] + QP[i] - dt * (FQ[i] - FQ[i - 1]));
+    }
+    boundary(A, Q, N, inlet, AN, QN);
+    substeps++;
+  }
+
+  TubeFields& current = state.current;
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+  for (int i = 0; i < n; i++) {
+    current.velocity[i] = Q[i] / A[i];
+    current.pressure[i] = tube_pressure(A[i]);
+    current.crossSectionLength[i] = A[i];
+  }
+  current.velocity[0] = inletVelocity;
+  state.advanced = false;
+  return substeps;
+}
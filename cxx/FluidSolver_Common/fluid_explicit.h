@@ -0,0 +1,51 @@
+#ifndef FLUID_EXPLICIT_H_
+#define FLUID_EXPLICIT_H_
+
+#include "fluid_state.h"
+
+/*
+   Explicit engine of the monolithic tube (--engine=explicit).
+
+   With the tube law A = 4/(2-p)^2, i.e. p = 2 - 2/sqrt(A), the equations of fluid_nl are
+   the hyperbolic system of the cross section A and the flow rate Q = A u
+
+     dA/dt + dQ/dx = 0
+     dQ/dt + d(Q^2/A + 2 sqrt(A))/dx = 0
+
+   in the units of the discretization of fluid_nl: a mesh width of 1 and a time window of
+   1/dx = N kappa tau. Pressure waves travel at u +- c with c = A^(-1/4). The window is
+   advanced in substeps of max(|u| + c) * dt <= cfl, each one predictor and one corrector
+   sweep of the MacCormack scheme over the nodes. Every substep applies the boundary
+   conditions of fluid_nl: the inlet velocity is interpolated linearly from the previous
+   window to the new one, inlet pressure and outlet velocity are extrapolated linearly and
+   the outlet keeps the Riemann invariant u + 4c of the incoming wave, which is the
+   "non-reflecting" pressure outlet.
+
+   The scheme is of second order in space and time and has no pressure stabilization, its
+   solution agrees with the implicit Euler steps of the Newton engine up to their
+   discretization errors. A substep costs a few operations per node, a window about
+   N kappa tau / cfl substeps. The engine is therefore cheaper than the Newton iteration
+   only if N kappa tau is small, i.e. a wave crosses few cells per window.
+*/
+struct FluidExplicit {
+  int n;      // nodes, N+1
+  double* A;  // cross section and flow rate of the substep
+  double* Q;
+  double* AP; // predicted cross section and flow rate
+  double* QP;
+  double* FA; // fluxes of A and Q
+  double* FQ;
+};
+
+void fluid_explicit_allocate(FluidExplicit& engine, int N);
+
+void fluid_explicit_free(FluidExplicit& engine);
+
+/*
+   Advances the previous level of state by one time window of length 1/dx into the current
+   level, with inletVelocity at the end of the window. The loops are split over threads.
+   Returns the number of substeps.
+*/
+int fluid_explicit_window(FluidExplicit& engine, TubeState& state, double dx, double inletVelocity, double cfl, int threads);
+
+#endif
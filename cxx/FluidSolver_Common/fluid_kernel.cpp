@@ -0,0 +1,279 @@
+#include "fluid_kernel.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+   The kernel body is a template over the vector type, GCC vector extensions provide the
+   arithmetic for double vectors and plain doubles alike. It is inlined into one entry
+   point per instruction set, which is compiled with the matching target attribute.
+*/
+typedef double fluid_v4d __attribute__((vector_size(32)));
+typedef double fluid_v8d __attribute__((vector_size(64)));
+
+#define FLUID_INLINE inline __attribute__((always_inline))
+
+// Loads and stores go through memcpy, which compiles to unaligned vector moves
+template <typename V>
+static FLUID_INLINE void load(V& v, const double* ptr)
+{
+  memcpy(&v, ptr, sizeof(V));
+}
+
+template <typename V>
+static FLUID_INLINE void store(double* ptr, const V& v)
+{
+  memcpy(ptr, &v, sizeof(V));
+}
+
+template <typename V>
+static FLUID_INLINE void storeStrided(double* ptr, int stride, const V& v)
+{
+  double lanes[sizeof(V) / sizeof(double)];
+  memcpy(lanes, &v, sizeof(V));
+  for (size_t l = 0; l < sizeof(V) / sizeof(double); l++)
+    ptr[l * stride] = lanes[l];
+}
+
+template <typename V, bool withJacobian, bool nonUniform, bool weighted>
+static FLUID_INLINE void assemble(const FluidKernelArgs& args, int begin, int end,
+                                  double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  const int W = sizeof(V) / sizeof(double);
+  const double *A = args.crossSectionLength, *u = args.velocity, *p = args.pressure;
+  const double alpha = args.alpha, dx = args.dx, gammaDx = args.gamma * args.dx, theta = args.theta;
+
+  for (int i = begin; i + W <= end; i += W) {
+    V aW, aC, aE, uW, uC, uE, pW, pC, pE, uN, aN, pOld;
+    load(aW, A + i - 1);
+    load(aC, A + i);
+    load(aE, A + i + 1);
+    load(uW, u + i - 1);
+    load(uC, u + i);
+    load(uE, u + i + 1);
+    load(pW, p + i - 1);
+    load(pC, p + i);
+    load(pE, p + i + 1);
+    load(uN, args.velocity_n + i);
+    load(aN, args.crossSectionLength_n + i);
+    load(pOld, args.pressure_old + i);
+
+    // Products shared by residual and Jacobian, dx is scaled to the control volume on a non-uniform mesh
+    V Adx, dAdx;
+    if (nonUniform) {
+      V w;
+      load(w, args.width + i);
+      Adx = aC * (w * dx);
+      dAdx = (aN - aC) * (w * dx);
+    } else {
+      Adx = aC * dx;
+      dAdx = (aN - aC) * dx;
+    }
+    V sW = 0.25 * (aW + aC); // 0.25 * (A[i-1] + A[i])
+    V sE = 0.25 * (aC + aE); // 0.25 * (A[i] + A[i+1])
+    V dA = 0.25 * (aW - aE); // 0.25 * (A[i-1] - A[i+1])
+
+    V resMomentum, resContinuity;
+    if (weighted) {
+      // Theta scheme: the fluxes of node i weighted by theta, plus the given fluxes of the previous level
+      V fluxU_n, fluxP_n;
+      load(fluxU_n, args.fluxU_n + i);
+      load(fluxP_n, args.fluxP_n + i);
+      resMomentum = Adx * (uN - uC) + theta * (-sE * uC * (uE + uC) + sW * uW * (uC + uW) + sW * pW - dA * pC - sE * pE) + fluxU_n;
+      resContinuity = dAdx + gammaDx * (pOld - pC) + theta * (sW * uW + dA * uC - sE * uE) + fluxP_n + alpha * (pW - 2.0 * pC + pE);
+    } else {
+      // Momentum
+      resMomentum = Adx * (uN - uC) - sE * uC * (uE + uC) + sW * uW * (uC + uW) + sW * pW - dA * pC - sE * pE;
+
+      // Continuity
+      resContinuity = dAdx + gammaDx * (pOld - pC) + sW * uW + dA * uC - sE * uE + alpha * (pW - 2.0 * pC + pE);
+    }
+
+    if (resStride == 1) {
+      store(resU + i, resMomentum);
+      store(resP + i, resContinuity);
+    } else {
+      storeStrided(resU + i * resStride, resStride, resMomentum);
+      storeStrided(resP + i * resStride, resStride, resContinuity);
+    }
+
+    if (withJacobian && weighted) {
+      store(jac + FLUID_JAC_UU_W * jacStride + i, -theta * sW * (2.0 * uW + uC));
+      store(jac + FLUID_JAC_UU_C * jacStride + i, theta * (sE * (uE + 2.0 * uC) - sW * uW) + Adx);
+      store(jac + FLUID_JAC_UU_E * jacStride + i, theta * sE * uC);
+      store(jac + FLUID_JAC_UP_W * jacStride + i, -theta * sW);
+      store(jac + FLUID_JAC_UP_C * jacStride + i, theta * dA);
+      store(jac + FLUID_JAC_UP_E * jacStride + i, theta * sE);
+    } else if (withJacobian) {
+      store(jac + FLUID_JAC_UU_W * jacStride + i, -sW * (2.0 * uW + uC));
+      store(jac + FLUID_JAC_UU_C * jacStride + i, sE * (uE + 2.0 * uC) + Adx - sW * uW);
+      store(jac + FLUID_JAC_UU_E * jacStride + i, sE * uC);
+      store(jac + FLUID_JAC_UP_W * jacStride + i, -sW);
+      store(jac + FLUID_JAC_UP_C * jacStride + i, dA);
+      store(jac + FLUID_JAC_UP_E * jacStride + i, sE);
+    }
+  }
+}
+
+/* Full vectors from begin, the remainder with the scalar body */
+template <typename V, bool withJacobian, bool nonUniform>
+static FLUID_INLINE void assembleSplit(const FluidKernelArgs& args, int begin, int end,
+                                       double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  const int W = sizeof(V) / sizeof(double);
+  int vectorEnd = begin + (end - begin) / W * W;
+
+  if (args.fluxU_n) {
+    assemble<V, withJacobian, nonUniform, true>(args, begin, vectorEnd, resU, resP, resStride, jac, jacStride);
+    assemble<double, withJacobian, nonUniform, true>(args, vectorEnd, end, resU, resP, resStride, jac, jacStride);
+  } else {
+    assemble<V, withJacobian, nonUniform, false>(args, begin, vectorEnd, resU, resP, resStride, jac, jacStride);
+    assemble<double, withJacobian, nonUniform, false>(args, vectorEnd, end, resU, resP, resStride, jac, jacStride);
+  }
+}
+
+template <typename V>
+static FLUID_INLINE void assembleRange(const FluidKernelArgs& args, int begin, int end,
+                                       double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  if (args.width) {
+    if (jac)
+      assembleSplit<V, true, true>(args, begin, end, resU, resP, resStride, jac, jacStride);
+    else
+      assembleSplit<V, false, true>(args, begin, end, resU, resP, resStride, jac, jacStride);
+  } else if (jac) {
+    assembleSplit<V, true, false>(args, begin, end, resU, resP, resStride, jac, jacStride);
+  } else {
+    assembleSplit<V, false, false>(args, begin, end, resU, resP, resStride, jac, jacStride);
+  }
+}
+
+__attribute__((target("avx512f")))
+static void assembleAVX512(const FluidKernelArgs& args, int begin, int end,
+                           double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  assembleRange<fluid_v8d>(args, begin, end, resU, resP, resStride, jac, jacStride);
+}
+
+__attribute__((target("avx2,fma")))
+static void assembleAVX2(const FluidKernelArgs& args, int begin, int end,
+                         double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  assembleRange<fluid_v4d>(args, begin, end, resU, resP, resStride, jac, jacStride);
+}
+
+static void assembleScalar(const FluidKernelArgs& args, int begin, int end,
+                           double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  assembleRange<double>(args, begin, end, resU, resP, resStride, jac, jacStride);
+}
+
+typedef void (*FluidAssembleFunction)(const FluidKernelArgs&, int, int, double*, double*, int, double*, int);
+
+/* Widest instruction set of the CPU, the environment variable FLUID_KERNEL_ISA=avx2|scalar limits it */
+static FluidAssembleFunction selectKernel(const char** isa)
+{
+  const char* limit = getenv("FLUID_KERNEL_ISA");
+  bool allowAVX512 = !limit || strcmp(limit, "avx512") == 0;
+  bool allowAVX2 = allowAVX512 || strcmp(limit, "avx2") == 0;
+
+  __builtin_cpu_init();
+  if (allowAVX512 && __builtin_cpu_supports("avx512f")) {
+    *isa = "avx512";
+    return assembleAVX512;
+  }
+  if (allowAVX2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    *isa = "avx2";
+    return assembleAVX2;
+  }
+  *isa = "scalar";
+  return assembleScalar;
+}
+
+static const char* kernelIsa = NULL;
+static FluidAssembleFunction kernel = selectKernel(&kernelIsa);
+
+void fluid_kernel_assemble(const FluidKernelArgs& args, int begin, int end,
+                           double* resU, double* resP, int resStride, double* jac, int jacStride)
+{
+  kernel(args, begin, end, resU, resP, resStride, jac, jacStride);
+}
+
+const char* fluid_kernel_isa()
+{
+  return kernelIsa;
+}
+
+void fluid_kernel_flux(const double* crossSectionLength, const double* velocity, const double* pressure, double weight,
+                       int begin, int end, double* fluxU, double* fluxP)
+{
+  // Without the time derivatives and the stabilization, the residual is the sum of the fluxes
+  FluidKernelArgs args = {crossSectionLength, crossSectionLength, velocity, velocity, pressure, pressure,
+                          0.0, 0.0, 0.0, NULL, 1.0, NULL, NULL};
+  kernel(args, begin, end, fluxU, fluxP, 1, NULL, 0);
+  for (int i = begin; i < end; i++) {
+    fluxU[i] *= weight;
+    fluxP[i] *= weight;
+  }
+}
+
+/* Velocity and pressure column of node i, the rows of the nodes i-1, i, i+1 are set if present */
+static FLUID_INLINE void bandColumns(double* ab, int ldab, const double* jac, int jacStride, int i,
+                                     bool previous, bool current, bool next, double alpha, double gammaDx)
+{
+  const double* uuW = jac + FLUID_JAC_UU_W * jacStride;
+  const double* uuC = jac + FLUID_JAC_UU_C * jacStride;
+  const double* uuE = jac + FLUID_JAC_UU_E * jacStride;
+  const double* upW = jac + FLUID_JAC_UP_W * jacStride;
+  const double* upC = jac + FLUID_JAC_UP_C * jacStride;
+  const double* upE = jac + FLUID_JAC_UP_E * jacStride;
+  const int d = 8; // kl + ku, position of the diagonal within a column
+  double* velocityColumn = ab + 2 * i * ldab;
+  double* pressureColumn = velocityColumn + ldab;
+
+  for (int r = 0; r < 2 * ldab; r++)
+    velocityColumn[r] = 0.0;
+
+  // Rows of node i-1: momentum 2i-2, continuity 2i-1
+  if (previous) {
+    velocityColumn[d - 2] = uuE[i - 1];
+    velocityColumn[d - 1] = upE[i - 1];
+    pressureColumn[d - 3] = upE[i - 1];
+    pressureColumn[d - 2] = -alpha;
+  }
+  // Rows of node i: momentum 2i, continuity 2i+1
+  if (current) {
+    velocityColumn[d] = uuC[i];
+    velocityColumn[d + 1] = -upC[i];
+    pressureColumn[d - 1] = upC[i];
+    pressureColumn[d] = 2 * alpha + gammaDx;
+  }
+  // Rows of node i+1: momentum 2i+2, continuity 2i+3
+  if (next) {
+    velocityColumn[d + 2] = uuW[i + 1];
+    velocityColumn[d + 3] = upW[i + 1];
+    pressureColumn[d + 1] = upW[i + 1];
+    pressureColumn[d + 2] = -alpha;
+  }
+}
+
+void fluid_kernel_band(double* ab, int ldab, const double* jac, int jacStride, int nodes, int begin, int end,
+                       double alpha, double gamma, double dx)
+{
+  fluid_kernel_band_range(ab, ldab, jac, jacStride, 0, nodes, begin, end, alpha, gamma, dx);
+}
+
+void fluid_kernel_band_range(double* ab, int ldab, const double* jac, int jacStride, int first, int last, int begin, int end,
+                             double alpha, double gamma, double dx)
+{
+  double gammaDx = gamma * dx;
+  auto inside = [begin, end](int i) { return i >= begin && i < end; };
+
+  // The columns of begin < i < end-1 have the rows of all three nodes
+  for (int i = first; i < last; i++) {
+    if (i > begin && i + 1 < end)
+      bandColumns(ab, ldab, jac, jacStride, i, true, true, true, alpha, gammaDx);
+    else
+      bandColumns(ab, ldab, jac, jacStride, i, inside(i - 1), inside(i), inside(i + 1), alpha, gammaDx);
+  }
+}
@@ -0,0 +1,132 @@
+#ifndef FLUID_KERNEL_H_
+#define FLUID_KERNEL_H_
+
+/*
+   Fused assembly of the residual and the Jacobian of the interior nodes of the tube.
+
+   One pass over structure-of-arrays inputs loads crossSectionLength, velocity and
+   pressure of the nodes i-1, i, i+1 once, forms the products shared by residual and
+   Jacobian and stores the momentum and continuity residual together with the Jacobian
+   coefficients of the node. The loop is written with explicit SIMD vectors, the widest
+   instruction set of the CPU (AVX-512, AVX2, or a scalar fallback) is selected at
+   program start, FLUID_KERNEL_ISA=avx2|scalar in the environment restricts the choice.
+
+   The Jacobian is the Newton matrix LHS = -dRes/dx of the solvers. Per node, only six
+   coefficients depend on the state, they are stored in jac[c * jacStride + i] with
+   c = FLUID_JAC_*. The remaining entries follow from them (continuity/velocity) or are
+   constant (continuity/pressure). fluid_kernel_band() writes all of them column by
+   column into LAPACK band storage, fluid_kernel_scatter() writes single nodes through an
+   accessor, e.g. for the coupling blocks of the SPIKE partitions.
+*/
+
+enum {
+  FLUID_JAC_UU_W, // momentum/velocity, node i-1
+  FLUID_JAC_UU_C, // momentum/velocity, node i
+  FLUID_JAC_UU_E, // momentum/velocity, node i+1
+  FLUID_JAC_UP_W, // momentum/pressure, node i-1, continuity/velocity is the same
+  FLUID_JAC_UP_C, // momentum/pressure, node i, continuity/velocity is the negative
+  FLUID_JAC_UP_E, // momentum/pressure, node i+1, continuity/velocity is the same
+  FLUID_JAC_COUNT
+};
+
+/*
+   Inputs of the kernel. crossSectionLength, velocity and pressure are read at i-1 and
+   i+1, all other arrays only at i. pressure_old and gamma are the pressure stabilization
+   of the parallel solver, the serial solver passes gamma = 0.
+
+   width scales the time derivatives of node i to its control volume on a non-uniform
+   mesh (see Common/elastictube_mesh.h), NULL for the uniform mesh. The fluxes across the
+   faces do not depend on the spacing. The non-uniform mesh is only used with gamma = 0.
+
+   fluxU_n and fluxP_n select the theta scheme (FluidOptions::theta): the fluxes of node i
+   are weighted by theta and the momentum and continuity fluxes of the previous time level,
+   weighted by 1 - theta with fluid_kernel_flux(), are added. The Jacobian coefficients
+   of the fluxes are scaled by theta, the time derivatives are not. As in
+   python/thetaScheme.py, the stabilization acts on the new pressure only, the solvers
+   pass alpha weighted by theta. NULL for implicit Euler, theta is then ignored.
+*/
+struct FluidKernelArgs {
+  const double* crossSectionLength;
+  const double* crossSectionLength_n;
+  const double* velocity;
+  const double* velocity_n;
+  const double* pressure;
+  const double* pressure_old;
+  double alpha;
+  double gamma;
+  double dx;
+  const double* width;
+  double theta;
+  const double* fluxU_n;
+  const double* fluxP_n;
+};
+
+/*
+   Assembles the nodes begin <= i < end. The momentum residual of node i is stored at
+   resU[i * resStride], the continuity residual at resP[i * resStride]. jac may be NULL if
+   only the residual is needed.
+*/
+void fluid_kernel_assemble(const FluidKernelArgs& args, int begin, int end,
+                           double* resU, double* resP, int resStride, double* jac, int jacStride);
+
+/* Instruction set used by fluid_kernel_assemble: "avx512", "avx2" or "scalar" */
+const char* fluid_kernel_isa();
+
+/*
+   Momentum and continuity fluxes of the nodes begin <= i < end of a state, times weight,
+   stored at fluxU[i] and fluxP[i]. These are the residuals of fluid_kernel_assemble()
+   without the time derivatives and the stabilization.
+*/
+void fluid_kernel_flux(const double* crossSectionLength, const double* velocity, const double* pressure, double weight,
+                       int begin, int end, double* fluxU, double* fluxP);
+
+/*
+   Writes the columns of the nodes 0 <= i < nodes of the interleaved Jacobian in LAPACK band
+   storage with KL = KU = 4 (see fluid_banded.h), including the zero entries and the rows
+   reserved for the fill-in. Only the rows of the nodes begin <= i < end are set, the rows
+   of all other nodes are zero and have to be assembled afterwards.
+*/
+void fluid_kernel_band(double* ab, int ldab, const double* jac, int jacStride, int nodes, int begin, int end,
+                       double alpha, double gamma, double dx);
+
+/* Same, but only the columns of the nodes first <= i < last, e.g. for a split over threads */
+void fluid_kernel_band_range(double* ab, int ldab, const double* jac, int jacStride, int first, int last, int begin, int end,
+                             double alpha, double gamma, double dx);
+
+/*
+   Writes the Jacobian of the nodes begin <= i < end into a band. entry(row, col) returns
+   the matrix entry for interleaved indices, velocity of node i is 2i, pressure is 2i+1.
+*/
+template <typename Entry>
+inline void fluid_kernel_scatter(Entry entry, const double* jac, int jacStride, int begin, int end,
+                                 double alpha, double gamma, double dx)
+{
+  const double* uuW = jac + FLUID_JAC_UU_W * jacStride;
+  const double* uuC = jac + FLUID_JAC_UU_C * jacStride;
+  const double* uuE = jac + FLUID_JAC_UU_E * jacStride;
+  const double* upW = jac + FLUID_JAC_UP_W * jacStride;
+  const double* upC = jac + FLUID_JAC_UP_C * jacStride;
+  const double* upE = jac + FLUID_JAC_UP_E * jacStride;
+
+  for (int i = begin; i < end; i++) {
+    int U = 2 * i, P = 2 * i + 1;
+
+    // Momentum
+    entry(U, U - 2) = uuW[i];
+    entry(U, U) = uuC[i];
+    entry(U, U + 2) = uuE[i];
+    entry(U, P - 2) = upW[i];
+    entry(U, P) = upC[i];
+    entry(U, P + 2) = upE[i];
+
+    // Continuity
+    entry(P, U - 2) = upW[i];
+    entry(P, U) = -upC[i];
+    entry(P, U + 2) = upE[i];
+    entry(P, P - 2) = -alpha;
+    entry(P, P) = 2 * alpha + gamma * dx;
+    entry(P, P + 2) = -alpha;
+  }
+}
+
+#endif
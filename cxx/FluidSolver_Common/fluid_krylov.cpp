@@ -0,0 +1,151 @@
+#include "fluid_krylov.h"
+#include "fluid_memory.h"
+#include <math.h>
+
+static double dot(int n, const double* x, const double* y)
+{
+  double sum = 0.0;
+  for (int i = 0; i < n; i++)
+    sum += x[i] * y[i];
+  return sum;
+}
+
+void fluid_krylov_allocate(FluidKrylov& krylov, int n, int restart)
+{
+  krylov.n       = n;
+  krylov.restart = restart;
+  krylov.V       = fluid_alloc<double>((restart + 1) * n);
+  krylov.H       = fluid_alloc<double>((restart + 1) * restart);
+  krylov.cs      = fluid_alloc<double>(restart);
+  krylov.sn      = fluid_alloc<double>(restart);
+  krylov.s       = fluid_alloc<double>(restart + 1);
+  krylov.w       = fluid_alloc<double>(n);
+  krylov.z       = fluid_alloc<double>(n);
+}
+
+void fluid_krylov_free(FluidKrylov& krylov)
+{
+  fluid_free(krylov.V);
+  fluid_free(krylov.H);
+  fluid_free(krylov.cs);
+  fluid_free(krylov.sn);
+  fluid_free(krylov.s);
+  fluid_free(krylov.w);
+  fluid_free(krylov.z);
+  krylov.V = krylov.H = krylov.cs = krylov.sn = krylov.s = krylov.w = krylov.z = NULL;
+}
+
+int fluid_gmres(
+    FluidKrylov& krylov,
+    FluidOperator apply,
+    FluidOperator precondition,
+    void* context,
+    const double* b,
+    double* x,
+    double rtol,
+    int maxIterations)
+{
+  int n = krylov.n, m = krylov.restart;
+  double* V = krylov.V;
+  double* H = krylov.H;
+  double* w = krylov.w;
+  double* z = krylov.z;
+  double *cs = krylov.cs, *sn = krylov.sn, *s = krylov.s;
+
+  double normB = sqrt(dot(n, b, b));
+  if (normB == 0.0) {
+    for (int i = 0; i < n; i++)
+      x[i] = 0.0;
+    return 0;
+  }
+  double tolerance = rtol * normB;
+
+  int iterations = 0;
+  while (1) {
+    // r = b - A x, first basis vector
+    apply(context, x, w);
+    for (int i = 0; i < n; i++)
+      V[i] = b[i] - w[i];
+    double beta = sqrt(dot(n, V, V));
+    if (beta <= tolerance)
+      return iterations;
+    if (iterations >= maxIterations)
+      return -1;
+
+    for (int i = 0; i < n; i++)
+      V[i] /= beta;
+    for (int i = 0; i <= m; i++)
+      s[i] = 0.0;
+    s[0] = beta;
+
+    // Arnoldi with modified Gram-Schmidt, the least squares problem is kept triangular by Givens rotations
+    bool converged = false;
+    int j;
+    for (j = 0; j < m && iterations < maxIterations; j++) {
+      double* vj = V + j * n;
+      double* vNext = V + (j + 1) * n;
+      double* h = H + j * (m + 1);
+
+      if (precondition) {
+        precondition(context, vj, z);
+        apply(context, z, vNext);
+      } else {
+        apply(context, vj, vNext);
+      }
+
+      for (int i = 0; i <= j; i++) {
+        h[i] = dot(n, vNext, V + i * n);
+        for (int l = 0; l < n; l++)
+          vNext[l] -= h[i] * V[i * n + l];
+      }
+      h[j + 1] = sqrt(dot(n, vNext, vNext));
+      if (h[j + 1] != 0.0)
+        for (int l = 0; l < n; l++)
+          vNext[l] /= h[j + 1];
+
+      for (int i = 0; i < j; i++) {
+        double tmp = cs[i] * h[i] + sn[i] * h[i + 1];
+        h[i + 1] = -sn[i] * h[i] + cs[i] * h[i + 1];
+        h[i] = tmp;
+      }
+      double r = sqrt(h[j] * h[j] + h[j + 1] * h[j + 1]);
+      cs[j] = h[j] / r;
+      sn[j] = h[j + 1] / r;
+      h[j] = r;
+      h[j + 1] = 0.0;
+      s[j + 1] = -sn[j] * s[j];
+      s[j] = cs[j] * s[j];
+
+      iterations++;
+      if (fabs(s[j + 1]) <= tolerance) {
+        converged = true;
+        j++;
+        break;
+      }
+    }
+
+    // Back substitution H y = s, the update is M^-1 V y
+    for (int i = j - 1; i >= 0; i--) {
+      for (int l = i + 1; l < j; l++)
+        s[i] -= H[i + l * (m + 1)] * s[l];
+      s[i] /= H[i + i * (m + 1)];
+    }
+    for (int l = 0; l < n; l++)
+      w[l] = 0.0;
+    for (int i = 0; i < j; i++)
+      for (int l = 0; l < n; l++)
+        w[l] += s[i] * V[i * n + l];
+    if (precondition) {
+      precondition(context, w, z);
+      for (int l = 0; l < n; l++)
+        x[l] += z[l];
+    } else {
+      for (int l = 0; l < n; l++)
+        x[l] += w[l];
+    }
+
+    // The recurrence is trusted, a finite difference operator may not reproduce it on restart
+    if (converged)
+      return iterations;
+  }
+}
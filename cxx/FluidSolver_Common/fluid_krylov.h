@@ -0,0 +1,50 @@
+#ifndef FLUID_KRYLOV_H_
+#define FLUID_KRYLOV_H_
+
+/*
+   Restarted GMRES for matrix-free operators, used by the Jacobian-free Newton-Krylov
+   engine of the fluid solver. The operator and the preconditioner are only given as
+   functions y = A x and y = M^-1 x, the matrix is never formed. The preconditioner is
+   applied from the right, so the residual that is minimized is the true residual
+   b - A x and the stopping criterion does not depend on the preconditioner.
+
+   Memory is (restart + 3) vectors of length n and O(restart^2) for the Hessenberg matrix.
+*/
+
+/* y = op(x) for vectors of length n, context is passed through from fluid_gmres */
+typedef void (*FluidOperator)(void* context, const double* x, double* y);
+
+struct FluidKrylov {
+  int n;        // order of the system
+  int restart;  // dimension of the Krylov space before a restart
+  double* V;    // orthonormal basis, (restart+1) x n
+  double* H;    // Hessenberg matrix, (restart+1) x restart, column-major
+  double* cs;   // Givens rotations
+  double* sn;
+  double* s;    // rotated right hand side of the least squares problem
+  double* w;    // scratch vectors of length n
+  double* z;
+};
+
+void fluid_krylov_allocate(FluidKrylov& krylov, int n, int restart);
+
+void fluid_krylov_free(FluidKrylov& krylov);
+
+/*
+   Solves A x = b. x holds the initial guess on entry and the solution on exit. Iterates
+   until ||b - A x|| <= rtol ||b|| or maxIterations are reached, the residual norm is the
+   one of the least squares problem, it is only recomputed on restart. precondition may
+   be NULL.
+   Returns the number of iterations, or -1 if the tolerance was not reached.
+*/
+int fluid_gmres(
+    FluidKrylov& krylov,
+    FluidOperator apply,
+    FluidOperator precondition,
+    void* context,
+    const double* b,
+    double* x,
+    double rtol,
+    int maxIterations);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef FLUID_MEMORY_H_
+#define FLUID_MEMORY_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Alignment of all solver buffers, one cache line, sufficient for AVX-512 loads */
+#define FLUID_ALIGNMENT 64
+
+/*
+   Zero-initialized array of n elements aligned to FLUID_ALIGNMENT, release with fluid_free.
+   Aborts if the memory is not available, the solvers cannot continue without their buffers.
+*/
+template <typename T>
+T* fluid_alloc(int n)
+{
+  void* ptr = NULL;
+  size_t bytes = (n > 0 ? n : 1) * sizeof(T);
+  if (posix_memalign(&ptr, FLUID_ALIGNMENT, bytes) != 0) {
+    fprintf(stderr, "Cannot allocate %zu bytes for the fluid solver\n", bytes);
+    abort();
+  }
+  memset(ptr, 0, bytes);
+  return (T*)ptr;
+}
+
+inline void fluid_free(void* ptr)
+{
+  free(ptr);
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include "fluid_network.h"
+#include "fluid_memory.h"
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+
+/* LAPACK DGETRF and DGETRS, LU factorization of a dense matrix and substitution */
+extern "C" {
+void dgetrf_(
+    int* m,
+    int* n,
+    double* a,
+    int* lda,
+    int* ipiv,
+    int* info);
+
+void dgetrs_(
+    char* trans,
+    int* n,
+    int* nrhs,
+    double* a,
+    int* lda,
+    int* ipiv,
+    double* b,
+    int* ldb,
+    int* info);
+}
+
+bool fluid_network_read(FluidNetwork& network, const char* path)
+{
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    printf("Cannot open network file %s\n", path);
+    return false;
+  }
+
+  network.segments.clear();
+  network.junctions.clear();
+  char line[1024];
+  int number = 0;
+  bool valid = true;
+  while (valid && fgets(line, sizeof(line), file)) {
+    number++;
+    char* comment = strchr(line, '#');
+    if (comment)
+      *comment = '\0';
+    char extra;
+    if (sscanf(line, " %c", &extra) != 1)
+      continue; // blank line or comment
+
+    FluidSegment segment;
+    int fields = sscanf(line, "%d %d %lf %d %c", &segment.from, &segment.to, &segment.length, &segment.elements, &extra);
+
+    // The boundary conditions extrapolate from the first and the last two elements
+    valid = fields == 4 && segment.from >= 0 && segment.to >= 0 && segment.from != segment.to &&
+            segment.length > 0.0 && segment.elements >= 2;
+    if (!valid)
+      printf("Line %d of %s is not a segment \"from to length elements\" of two different vertices, "
+             "a positive length and at least 2 elements\n", number, path);
+    network.segments.push_back(segment);
+  }
+  fclose(file);
+  if (!valid)
+    return false;
+
+  // Segment ends of every vertex, the junctions are numbered in the order of their vertices
+  std::map<int, std::vector<int> > vertices;
+  for (size_t s = 0; s < network.segments.size(); s++) {
+    vertices[network.segments[s].from].push_back(2 * (int)s);
+    vertices[network.segments[s].to].push_back(2 * (int)s + 1);
+  }
+  network.inlets = 0;
+  network.outlets = 0;
+  for (std::map<int, std::vector<int> >::const_iterator vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
+    const std::vector<int>& ends = vertex->second;
+    int junction = -1;
+    if (ends.size() == 1) {
+      if (ends[0] % 2 == 0)
+        network.inlets++;
+      else
+        network.outlets++;
+    } else {
+      junction = (int)network.junctions.size();
+      network.junctions.push_back(FluidJunction());
+      network.junctions.back().ends = ends;
+    }
+    for (size_t e = 0; e < ends.size(); e++)
+      network.segments[ends[e] / 2].junction[ends[e] % 2] = junction;
+  }
+
+  if (network.inlets == 0) {
+    printf("%s has no inlet, a vertex where a single segment starts\n", path);
+    return false;
+  }
+  return true;
+}
+
+void fluid_network_allocate(FluidNetwork& network, const FluidOptions& options, double velocity)
+{
+  // Every segment is solved by a single thread
+  FluidOptions segmentOptions = options;
+  segmentOptions.threads = 1;
+
+  network.elements = 0;
+  for (size_t s = 0; s < network.segments.size(); s++) {
+    FluidSegment& segment = network.segments[s];
+    int N = segment.elements;
+    tube_state_allocate(segment.state, N + 1);
+    tube_state_fill(segment.state, velocity, 0.0, 1.0);
+    fluid_workspace_allocate(segment.workspace, N, segmentOptions);
+    segment.coupling = fluid_alloc<double>(2 * (2 * N + 2));
+    segment.sums[0] = segment.sums[1] = 0.0;
+    network.elements += N;
+  }
+
+  int J = (int)network.junctions.size();
+  network.pressure = fluid_alloc<double>(J);
+  network.mass = fluid_alloc<double>(J);
+  network.schur = fluid_alloc<double>(J * J);
+  network.ipiv = fluid_alloc<int>(J);
+  for (int j = 0; j < J; j++)
+    network.pressure[j] = 0.5 * velocity * velocity;
+  fluid_profile_reset(network.profile);
+
+  // Longest segment first to the thread with the fewest elements
+  std::vector<int> order(network.segments.size());
+  for (size_t s = 0; s < order.size(); s++)
+    order[s] = (int)s;
+  std::stable_sort(order.begin(), order.end(), [&network](int a, int b) {
+    return network.segments[a].elements > network.segments[b].elements;
+  });
+  int teams = std::min(options.threads, (int)network.segments.size());
+  std::vector<long> load(teams, 0);
+  network.teams.assign(teams, std::vector<int>());
+  for (size_t k = 0; k < order.size(); k++) {
+    int team = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+    network.teams[team].push_back(order[k]);
+    load[team] += network.segments[order[k]].elements;
+  }
+}
+
+void fluid_network_free(FluidNetwork& network)
+{
+  for (size_t s = 0; s < network.segments.size(); s++) {
+    FluidSegment& segment = network.segments[s];
+    tube_state_free(segment.state);
+    fluid_workspace_free(segment.workspace);
+    fluid_free(segment.coupling);
+  }
+  fluid_free(network.pressure);
+  fluid_free(network.mass);
+  fluid_free(network.schur);
+  fluid_free(network.ipiv);
+  network.segments.clear();
+  network.junctions.clear();
+  network.teams.clear();
+}
+
+void fluid_network_advance(FluidNetwork& network)
+{
+  for (size_t s = 0; s < network.segments.size(); s++)
+    tube_state_advance(network.segments[s].state);
+}
+
+void fluid_network_grid(const FluidNetwork& network, double* grid, std::vector<int>& first)
+{
+  first.clear();
+  int node = 0;
+  for (size_t s = 0; s < network.segments.size(); s++) {
+    const FluidSegment& segment = network.segments[s];
+    first.push_back(node);
+    for (int i = 0; i <= segment.elements; i++, node++) {
+      grid[2 * node + 0] = i * segment.length / segment.elements;
+      grid[2 * node + 1] = (double)s;
+    }
+  }
+}
+
+int fluid_network_junction_solve(FluidNetwork& network)
+{
+  int J = (int)network.junctions.size();
+  int info = 0, nrhs = 1;
+  char trans = 'N';
+  if (J == 0)
+    return 0;
+  dgetrf_(&J, &J, network.schur, &J, network.ipiv, &info);
+  if (info == 0)
+    dgetrs_(&trans, &J, &nrhs, network.schur, &J, network.ipiv, network.mass, &J, &info);
+  return info;
+}
@@ -0,0 +1,93 @@
+#ifndef FLUID_NETWORK_H_
+#define FLUID_NETWORK_H_
+
+#include "fluid_options.h"
+#include "fluid_profile.h"
+#include "fluid_state.h"
+#include "fluid_workspace.h"
+#include <vector>
+
+/*
+   Network of tube segments of the NetworkSolver, e.g. an arterial tree, solved as one
+   system with the tube law of the MonolithicSolver (see fluid_nl_network()).
+
+   The topology file lists one segment per line as "from to length elements", '#' starts
+   a comment. from and to number the vertices, the flow runs from from to to. length is
+   measured in tubes of the single tube solvers and elements is the number of mesh
+   elements of the segment, so "0 1 1 100" is the tube of MonolithicSolver 100. A vertex
+   with one segment end is an inlet, if the segment starts there, with the inlet velocity
+   of the single tube, or an outlet with its non-reflecting pressure. A vertex with two
+   or more segment ends is a junction.
+
+   At a junction, the flow A u into the junction equals the flow out of it and all ends
+   share the total pressure p + u^2/2, an unknown P of the junction. Every end
+   extrapolates the velocity from its segment, like the outlet of the single tube, and
+   its pressure row becomes p + u^2/2 = P.
+
+   The Newton matrix is block diagonal with the band of every segment (see
+   fluid_banded.h), bordered by the columns of P and the mass rows of the junctions.
+   Every segment solves its band for the residual and for the columns of the junctions
+   at its ends, which leaves the Schur complement, a dense system of one row per
+   junction. The segments are distributed over options.threads threads by their number
+   of elements, every segment is solved by one thread.
+*/
+
+struct FluidSegment {
+  int from, to;     // vertices
+  double length;    // in tubes of the single tube solvers
+  int elements;     // mesh elements
+  int junction[2];  // junction of the start and the end, -1 for an inlet or outlet
+
+  TubeState state;
+  FluidWorkspace workspace; // band and residual of the segment
+  double* coupling; // solutions of the band for the junction columns of the start and the end, 2 x (2 elements + 2)
+  double sums[2];   // squared residual and state norm of the last residual evaluation
+};
+
+struct FluidJunction {
+  std::vector<int> ends; // 2s for the start of segment s, 2s+1 for its end
+};
+
+struct FluidNetwork {
+  std::vector<FluidSegment> segments;
+  std::vector<FluidJunction> junctions;
+  int inlets, outlets;
+  int elements;                          // of all segments
+  std::vector<std::vector<int> > teams;  // segments of every thread
+
+  double* pressure; // total pressure P of every junction
+  double* mass;     // mass residual of every junction, then the Newton step of P
+  double* schur;    // Schur complement of the junctions, column major
+  int* ipiv;        // pivots of its LU factorization
+
+  FluidProfile profile; // phases of fluid_nl_network(), see fluid_profile.h
+};
+
+/* Reads the segments of path. Prints a message and returns false on error. */
+bool fluid_network_read(FluidNetwork& network, const char* path);
+
+/*
+   Allocates the states and workspaces of all segments with the constant velocity, zero
+   pressure and crossSectionLength 1, and distributes the segments over options.threads
+   threads, longest first to the least loaded thread.
+*/
+void fluid_network_allocate(FluidNetwork& network, const FluidOptions& options, double velocity);
+
+void fluid_network_free(FluidNetwork& network);
+
+/* Accepts the current level of all segments, see tube_state_advance() */
+void fluid_network_advance(FluidNetwork& network);
+
+/*
+   Coordinates of the nodes of all segments one after the other for the output, segment
+   s at y = s, and the index of the first node of every segment
+*/
+void fluid_network_grid(const FluidNetwork& network, double* grid, std::vector<int>& first);
+
+/*
+   Solves the Schur complement for the right hand side network.mass, which is replaced by
+   the solution. Returns the LAPACK info.
+*/
+int fluid_network_junction_solve(FluidNetwork& network);
+
+#endif
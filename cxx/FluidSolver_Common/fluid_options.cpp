@@ -0,0 +1,206 @@
+#include "fluid_options.h"
+#include "../Common/elastictube_mesh.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+
+static bool parseBool(const std::string& value, bool& result)
+{
+  if (value == "1" || value == "on" || value == "true") {
+    result = true;
+    return true;
+  }
+  if (value == "0" || value == "off" || value == "false") {
+    result = false;
+    return true;
+  }
+  return false;
+}
+
+static bool parseInt(const std::string& value, int& result)
+{
+  char* end;
+  result = (int)strtol(value.c_str(), &end, 10);
+  return !value.empty() && *end == '\0';
+}
+
+static bool parseDouble(const std::string& value, double& result)
+{
+  char* end;
+  result = strtod(value.c_str(), &end);
+  return !value.empty() && *end == '\0';
+}
+
+bool fluid_options_parse(FluidOptions& options, int argc, char** argv, int first)
+{
+  bool newtonRtolGiven = false;
+  for (int i = first; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string::size_type pos = arg.find('=');
+
+    if (arg.compare(0, 2, "--") != 0 || pos == std::string::npos) {
+      std::cout << "Invalid argument " << arg << ", expected --name=value" << std::endl;
+      return false;
+    }
+
+    std::string name = arg.substr(2, pos - 2);
+    std::string value = arg.substr(pos + 1);
+    bool valid;
+
+    if (name == "ampl") {
+      valid = parseDouble(value, options.ampl) && options.ampl > 0.0;
+    } else if (name == "distributed") {
+      valid = parseBool(value, options.distributed);
+    } else if (name == "boundary-weight") {
+      valid = parseDouble(value, options.boundaryWeight) && options.boundaryWeight > 0.0;
+    } else if (name == "chord") {
+      valid = parseBool(value, options.chord);
+    } else if (name == "chord-rate") {
+      valid = parseDouble(value, options.chordRate) && options.chordRate > 0.0;
+    } else if (name == "newton-rtol") {
+      valid = parseDouble(value, options.newtonRtol) && options.newtonRtol > 0.0 && options.newtonRtol < 1.0;
+      newtonRtolGiven = true;
+    } else if (name == "coupling-forcing") {
+      valid = parseDouble(value, options.couplingForcing) && options.couplingForcing >= 0.0;
+    } else if (name == "engine") {
+      valid = value == "newton" || value == "jfnk" || value == "explicit";
+      options.engine = value == "jfnk" ? FLUID_ENGINE_JFNK : value == "explicit" ? FLUID_ENGINE_EXPLICIT : FLUID_ENGINE_NEWTON;
+    } else if (name == "krylov-rtol") {
+      valid = parseDouble(value, options.krylovRtol) && options.krylovRtol > 0.0 && options.krylovRtol < 1.0;
+    } else if (name == "krylov-restart") {
+      valid = parseInt(value, options.krylovRestart) && options.krylovRestart > 0;
+    } else if (name == "cfl") {
+      valid = parseDouble(value, options.cfl) && options.cfl > 0.0 && options.cfl <= 1.0;
+    } else if (name == "forcing") {
+      valid = value == "fixed" || value == "ew";
+      options.forcing = value == "ew" ? FLUID_FORCING_EW : FLUID_FORCING_FIXED;
+    } else if (name == "predictor") {
+      valid = value == "none" || value == "linear" || value == "quadratic";
+      options.predictor = value == "linear" ? FLUID_PREDICTOR_LINEAR : value == "quadratic" ? FLUID_PREDICTOR_QUADRATIC : FLUID_PREDICTOR_NONE;
+    } else if (name == "threads") {
+      valid = parseInt(value, options.threads) && options.threads > 0;
+#ifndef _OPENMP
+      if (valid && options.threads > 1) {
+        std::cout << "--threads needs a build with OpenMP" << std::endl;
+        return false;
+      }
+#endif
+    } else if (name == "theta") {
+      valid = parseDouble(value, options.theta) && options.theta >= 0.5 && options.theta <= 1.0;
+    } else if (name == "dt-tol") {
+      valid = parseDouble(value, options.dtTol) && options.dtTol >= 0.0;
+    } else if (name == "dt-min") {
+      valid = parseDouble(value, options.dtMin) && options.dtMin > 0.0;
+    } else if (name == "dt-max") {
+      valid = parseDouble(value, options.dtMax) && options.dtMax > 0.0;
+    } else if (tube_mesh_option(options.mesh, name, value, valid)) {
+      // node positions, see elastictube_mesh.h
+    } else if (name == "refine") {
+      valid = parseInt(value, options.refine) && options.refine >= 0 && options.refine < 16;
+    } else if (name == "refine-tol") {
+      valid = parseDouble(value, options.refineTol) && options.refineTol > 0.0;
+    } else if (name == "precision") {
+      valid = value == "double" || value == "mixed";
+      options.precision = value == "mixed" ? FLUID_PRECISION_MIXED : FLUID_PRECISION_DOUBLE;
+    } else if (name == "output") {
+      valid = value == "vtu" || value == "vtk" || value == "series";
+      options.output = value == "vtk" ? FLUID_OUTPUT_VTK : value == "series" ? FLUID_OUTPUT_SERIES : FLUID_OUTPUT_VTU;
+    } else if (name == "log") {
+      valid = parseBool(value, options.log);
+    } else if (tube_restart_option(options.restart, name, value, valid)) {
+      // restart files, see elastictube_restart.h
+    } else {
+      std::cout << "Unknown option --" << name << std::endl;
+      return false;
+    }
+
+    if (!valid) {
+      std::cout << "Invalid value " << value << " for option --" << name << std::endl;
+      return false;
+    }
+  }
+
+  if (options.dtMin > options.dtMax) {
+    std::cout << "--dt-min has to be at most --dt-max" << std::endl;
+    return false;
+  }
+
+  // The fluxes of the previous level add rounding errors that the Newton iteration cannot remove
+  if (options.theta < 1.0 && !newtonRtolGiven && options.newtonRtol < FLUID_THETA_NEWTON_RTOL)
+    options.newtonRtol = FLUID_THETA_NEWTON_RTOL;
+
+  // So does the tube law, its solves keep the relaxed default unless the tolerance is given
+  if (newtonRtolGiven)
+    options.tubeLawNewtonRtol = options.newtonRtol;
+
+  // The error estimate of the step size control assumes implicit Euler steps
+  if (options.theta < 1.0 && options.dtTol > 0.0) {
+    std::cout << "--dt-tol needs --theta=1" << std::endl;
+    return false;
+  }
+
+  // The explicit engine has its own time integration
+  if (options.theta < 1.0 && options.engine == FLUID_ENGINE_EXPLICIT) {
+    std::cout << "--engine=explicit cannot be combined with --theta" << std::endl;
+    return false;
+  }
+
+  // The adaptive mesh starts from the uniform mesh
+  if (options.refine > 0 && !options.mesh.empty()) {
+    std::cout << "--refine cannot be combined with --mesh" << std::endl;
+    return false;
+  }
+
+  // The substeps of the explicit engine assume the uniform mesh
+  if (options.engine == FLUID_ENGINE_EXPLICIT && (options.refine > 0 || !options.mesh.empty())) {
+    std::cout << "--engine=explicit needs the uniform mesh, without --mesh and --refine" << std::endl;
+    return false;
+  }
+
+  // The threads solve the band with SPIKE in double precision
+  if (options.precision == FLUID_PRECISION_MIXED && options.threads > 1) {
+    std::cout << "--precision=mixed needs --threads=1" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void fluid_options_usage()
+{
+  std::cout << "Options:" << std::endl;
+  std::cout << "  --ampl=<a>            Inlet velocity (1 + sin^2(pi t) / a) / kappa (default 100)." << std::endl;
+  std::cout << "  --distributed=on|off  Parallel solver: solve distributed (default) or gather on rank 0." << std::endl;
+  std::cout << "  --boundary-weight=<w> Parallel solver: nodes of the first and last rank relative to the others (default 1)." << std::endl;
+  std::cout << "  --chord=on|off        Reuse the Jacobian factorization within a time window (default off)." << std::endl;
+  std::cout << "  --chord-rate=<r>      Refactorize if the residual norm decreases by less than r per iteration (default 0.5)." << std::endl;
+  std::cout << "  --newton-rtol=<r>     Relative residual norm at which the Newton iteration stops (default 1e-15," << std::endl;
+  std::cout << "                        1e-13 with --theta < 1 and with the tube law of the Monolithic- and NetworkSolver)." << std::endl;
+  std::cout << "  --coupling-forcing=<c>" << std::endl;
+  std::cout << "                        Serial solver: stop at c times the relative change of crossSectionLength since" << std::endl;
+  std::cout << "                        the previous call if that is larger than newton-rtol (default 0, off)." << std::endl;
+  std::cout << "  --engine=<e>          Serial solver: newton, assembled Jacobian (default), jfnk, Jacobian-free Newton-Krylov," << std::endl;
+  std::cout << "                        or explicit, MacCormack substeps of the monolithic solver." << std::endl;
+  std::cout << "  --krylov-rtol=<r>     Relative tolerance of the GMRES solve of the jfnk engine (default 1e-4)." << std::endl;
+  std::cout << "  --krylov-restart=<m>  GMRES restart length of the jfnk engine (default 50)." << std::endl;
+  std::cout << "  --cfl=<c>             CFL number of the substeps of the explicit engine, at most 1 (default 0.9)." << std::endl;
+  std::cout << "  --forcing=fixed|ew    Tolerance of the jfnk linear solves: krylov-rtol (default) or Eisenstat-Walker." << std::endl;
+  std::cout << "  --predictor=<p>       Serial solver: initial guess none (default), linear or quadratic in time." << std::endl;
+  std::cout << "  --threads=<t>         Serial and distributed solver: threads of the Newton iteration per process (default 1)." << std::endl;
+  std::cout << "  --theta=<t>           Weight of the new time level in the fluxes, 0.5 <= t <= 1: 1, implicit Euler (default)," << std::endl;
+  std::cout << "                        or 0.5, Crank-Nicolson, second order in time." << std::endl;
+  std::cout << "  --dt-tol=<e>          Serial solvers: step sizes with a local error of e relative to the solution" << std::endl;
+  std::cout << "                        (default 0, fixed time windows), see --dt-min and --dt-max." << std::endl;
+  std::cout << "  --dt-min=<h>          Smallest step size of --dt-tol (default 1e-5)." << std::endl;
+  std::cout << "  --dt-max=<h>          Largest step size of --dt-tol (default 0.1)." << std::endl;
+  tube_mesh_usage();
+  std::cout << "  --refine=<l>          MonolithicSolver: adaptive mesh with elements of up to 2^l reference elements" << std::endl;
+  std::cout << "                        (default 0, off), N has to be a multiple of 2^l and at least 2^(l+1)." << std::endl;
+  std::cout << "  --refine-tol=<e>      Largest pressure difference of an element of --refine relative to the pressure range" << std::endl;
+  std::cout << "                        of the tube (default 0.05)." << std::endl;
+  std::cout << "  --precision=<p>       Band solve in double (default) or mixed precision, single precision factors" << std::endl;
+  std::cout << "                        refined to double precision (serial solver and --distributed=off)." << std::endl;
+  std::cout << "  --output=<format>     Serial solver: vtu, binary files with a .pvd index (default), vtk, ASCII legacy files," << std::endl;
+  std::cout << "                        or series, all time steps in one memory-mappable file <prefix>.tube." << std::endl;
+  std::cout << "  --log=on|off          Print the iterations of every Newton solve (default on)." << std::endl;
+  tube_restart_usage();
+}
@@ -0,0 +1,84 @@
+#ifndef FLUID_OPTIONS_H_
+#define FLUID_OPTIONS_H_
+
+#include "../Common/elastictube_restart.h"
+
+/* Nonlinear engine of the serial fluid solver */
+enum FluidEngine {
+  FLUID_ENGINE_NEWTON, // Newton with the assembled band Jacobian
+  FLUID_ENGINE_JFNK,   // Jacobian-free Newton-Krylov, see fluid_krylov.h
+  FLUID_ENGINE_EXPLICIT // monolithic solver: MacCormack substeps, see fluid_explicit.h
+};
+
+/* Initial guess of the Newton iteration of the serial fluid solver, see fluid_predictor.h */
+enum FluidPredictor {
+  FLUID_PREDICTOR_NONE,     // start from the last solution
+  FLUID_PREDICTOR_LINEAR,   // extrapolate from the last two windows
+  FLUID_PREDICTOR_QUADRATIC // extrapolate from the last three windows
+};
+
+/* Tolerance of the linear solves of the JFNK engine */
+enum FluidForcing {
+  FLUID_FORCING_FIXED, // krylovRtol in every Newton iteration
+  FLUID_FORCING_EW     // Eisenstat-Walker: from the contraction of the nonlinear residual
+};
+
+/* Arithmetic of the band solve, see fluid_banded.h */
+enum FluidPrecision {
+  FLUID_PRECISION_DOUBLE, // DGBTRF and DGBTRS
+  FLUID_PRECISION_MIXED   // SGBTRF with iterative refinement in double precision
+};
+
+/* Format of the output of the serial solvers, see fluid_output.h */
+enum FluidOutputFormat {
+  FLUID_OUTPUT_VTU,    // binary XML files and a .pvd time series
+  FLUID_OUTPUT_VTK,    // ASCII legacy VTK files
+  FLUID_OUTPUT_SERIES  // all time steps in one binary file, see fluid_series.h
+};
+
+/* Default newtonRtol with theta < 1, the residual of the theta scheme stalls above 1e-15 */
+#define FLUID_THETA_NEWTON_RTOL 1e-13
+
+/* Default newtonRtol of the solves with the tube law, their residual stalls at a few 1e-15 */
+#define FLUID_TUBE_LAW_NEWTON_RTOL 1e-13
+
+/*
+   Optional command line arguments of the fluid solvers, given as --name=value after
+   the positional arguments.
+*/
+struct FluidOptions {
+  double ampl = 100.0;     // inlet velocity (1 + sin^2(pi t) / ampl) / kappa
+  bool distributed = true; // parallel solver: distributed solve instead of gathering on rank 0
+  double boundaryWeight = 1.0; // parallel solver: share of nodes of the first and last rank relative to the others
+  bool chord = false;      // modified Newton, reuse the Jacobian factors within a time window
+  double chordRate = 0.5;  // refactorize if the residual contracts by less than this factor
+  double newtonRtol = 1e-15;    // relative residual norm at which the Newton iteration stops, see FLUID_THETA_NEWTON_RTOL
+  double tubeLawNewtonRtol = FLUID_TUBE_LAW_NEWTON_RTOL; // newtonRtol of fluid_nl_monolithic() and fluid_nl_network(), --newton-rtol sets both
+  double couplingForcing = 0.0; // serial solver: > 0 relaxes newtonRtol to this factor times the coupling residual
+  FluidEngine engine = FLUID_ENGINE_NEWTON;
+  double krylovRtol = 1e-4; // relative tolerance of the linear solve in every JFNK iteration
+  int krylovRestart = 50;   // GMRES restart length
+  double cfl = 0.9;         // CFL number of the substeps of the explicit engine
+  FluidForcing forcing = FLUID_FORCING_FIXED;
+  FluidPredictor predictor = FLUID_PREDICTOR_NONE;
+  int threads = 1;         // OpenMP threads of the Newton iteration per process, see fluid_threads.h
+  double theta = 1.0;       // time integration of the fluxes, 1 implicit Euler, 0.5 Crank-Nicolson, see fluid_kernel.h
+  double dtTol = 0.0;       // serial solvers: step size control, see fluid_timestep.h, 0 for fixed time windows
+  double dtMin = 1e-5;      // bounds of the controlled step size
+  double dtMax = 0.1;
+  std::string mesh;         // serial solvers: file of the node positions, see elastictube_mesh.h, empty for the uniform mesh
+  int refine = 0;           // MonolithicSolver: levels of the adaptive mesh, see fluid_refine.h, 0 for a fixed mesh
+  double refineTol = 0.05;  // pressure difference of an element of the adaptive mesh relative to the pressure range
+  FluidPrecision precision = FLUID_PRECISION_DOUBLE; // band solve of the serial and the centralized solver
+  FluidOutputFormat output = FLUID_OUTPUT_VTU;
+  bool log = true;         // print the iterations of every Newton solve
+  TubeRestartOptions restart; // restart files, see elastictube_restart.h
+};
+
+/* Parses argv[first..argc-1] into options. Prints a message and returns false on error. */
+bool fluid_options_parse(FluidOptions& options, int argc, char** argv, int first);
+
+/* Prints the list of optional arguments */
+void fluid_options_usage();
+
+#endif
@@ -0,0 +1,127 @@
+#include "fluid_predictor.h"
+#include "fluid_memory.h"
+
+void fluid_predictor_allocate(FluidHistory& history, int N)
+{
+  int n = N + 1;
+  history.n = n;
+  history.windows = 0;
+  history.time = 0.0;
+  history.times[0] = history.times[1] = 0.0;
+  history.velocity = fluid_alloc<double>(2 * n);
+  history.pressure = fluid_alloc<double>(2 * n);
+  history.calls = 0;
+  history.velocityPrevious = fluid_alloc<double>(n);
+  history.pressurePrevious = fluid_alloc<double>(n);
+  history.velocityStart = fluid_alloc<double>(n);
+  history.pressureStart = fluid_alloc<double>(n);
+  history.area = fluid_alloc<double>(n);
+  history.areaStep = fluid_alloc<double>(n);
+}
+
+void fluid_predictor_free(FluidHistory& history)
+{
+  fluid_free(history.velocity);
+  fluid_free(history.pressure);
+  fluid_free(history.velocityPrevious);
+  fluid_free(history.pressurePrevious);
+  fluid_free(history.velocityStart);
+  fluid_free(history.pressureStart);
+  fluid_free(history.area);
+  fluid_free(history.areaStep);
+  history.velocity = history.pressure = NULL;
+  history.velocityPrevious = history.pressurePrevious = NULL;
+  history.velocityStart = history.pressureStart = NULL;
+  history.area = history.areaStep = NULL;
+}
+
+/* Lagrange polynomial through (times[j], values[j]) for j < points, evaluated at t */
+static void extrapolate(int n, int points, const double* times, const double* const* values, double t, double* result)
+{
+  double weights[3];
+  for (int j = 0; j < points; j++) {
+    weights[j] = 1.0;
+    for (int l = 0; l < points; l++) {
+      if (l != j)
+        weights[j] *= (t - times[l]) / (times[j] - times[l]);
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    double value = 0.0;
+    for (int j = 0; j < points; j++)
+      value += weights[j] * values[j][i];
+    result[i] = value;
+  }
+}
+
+void fluid_predictor_predict(FluidHistory& history, FluidPredictor predictor, double t, const double* crossSectionLength,
+                             const double* velocity_n, const double* pressure_n, double* velocity, double* pressure)
+{
+  int n = history.n;
+  for (int i = 0; i < n; i++) {
+    history.velocityStart[i] = velocity[i];
+    history.pressureStart[i] = pressure[i];
+  }
+
+  if (history.calls == 0 || t != history.time) {
+    // First call of a window, velocity_n / pressure_n is the solution of the previous window
+    if (history.calls > 0) {
+      int order = predictor == FLUID_PREDICTOR_QUADRATIC ? 2 : 1;
+      int points = 1 + (history.windows < order ? history.windows : order);
+      if (points > 1) {
+        double times[3] = {history.time, history.times[0], history.times[1]};
+        const double* velocities[3] = {velocity_n, history.velocity, history.velocity + n};
+        const double* pressures[3] = {pressure_n, history.pressure, history.pressure + n};
+        extrapolate(n, points, times, velocities, t, velocity);
+        extrapolate(n, points, times, pressures, t, pressure);
+      }
+
+      for (int i = 0; i < n; i++) {
+        history.velocity[n + i] = history.velocity[i];
+        history.pressure[n + i] = history.pressure[i];
+        history.velocity[i] = velocity_n[i];
+        history.pressure[i] = pressure_n[i];
+      }
+      history.times[1] = history.times[0];
+      history.times[0] = history.time;
+      if (history.windows < 2)
+        history.windows++;
+    }
+    history.time = t;
+    history.calls = 0;
+    return;
+  }
+
+  // Coupling iteration, secant step along the previous change of the solution
+  if (history.calls < 2)
+    return;
+  double projection = 0.0, length = 0.0;
+  for (int i = 0; i < n; i++) {
+    projection += (crossSectionLength[i] - history.area[i]) * history.areaStep[i];
+    length += history.areaStep[i] * history.areaStep[i];
+  }
+  if (length == 0.0)
+    return;
+  double omega = projection / length;
+  for (int i = 0; i < n; i++) {
+    velocity[i] += omega * (velocity[i] - history.velocityPrevious[i]);
+    pressure[i] += omega * (pressure[i] - history.pressurePrevious[i]);
+  }
+}
+
+void fluid_predictor_store(FluidHistory& history, const double* crossSectionLength)
+{
+  int n = history.n;
+  double* swap = history.velocityPrevious;
+  history.velocityPrevious = history.velocityStart;
+  history.velocityStart = swap;
+  swap = history.pressurePrevious;
+  history.pressurePrevious = history.pressureStart;
+  history.pressureStart = swap;
+
+  for (int i = 0; i < n; i++) {
+    history.areaStep[i] = crossSectionLength[i] - history.area[i];
+    history.area[i] = crossSectionLength[i];
+  }
+  history.calls++;
+}
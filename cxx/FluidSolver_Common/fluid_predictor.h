@@ -0,0 +1,48 @@
+#ifndef FLUID_PREDICTOR_H_
+#define FLUID_PREDICTOR_H_
+
+#include "fluid_options.h"
+
+/*
+   Initial guess of the Newton iteration of the serial fluid solver.
+
+   On the first call of a time window, velocity and pressure are extrapolated from the
+   converged solutions of the last two (linear) or three (quadratic) time windows to the
+   new time. The previous window is velocity_n / pressure_n of the caller, the older ones
+   are kept in the history. The extrapolation uses the times of the windows, so it also
+   holds for varying time step sizes.
+
+   On the following calls of the same window (coupling iterations), the change of the
+   solution between the two previous calls is scaled by the projection of the current
+   change of crossSectionLength onto the previous one: a secant step that follows the
+   fixed-point iteration of the coupling.
+*/
+struct FluidHistory {
+  int n;            // nodes, N+1
+  int windows;      // converged windows in velocity / pressure, 0..2
+  double time;      // time of the current window
+  double times[2];  // times of the windows in velocity / pressure, most recent first
+  double* velocity; // 2 levels of n values, most recent first
+  double* pressure;
+
+  int calls;                 // calls in the current window
+  double* velocityPrevious;  // solution of the second last call of the window
+  double* pressurePrevious;
+  double* velocityStart;     // solution of the last call, the initial value of this call
+  double* pressureStart;
+  double* area;              // crossSectionLength of the last call
+  double* areaStep;          // change of crossSectionLength between the last two calls
+};
+
+void fluid_predictor_allocate(FluidHistory& history, int N);
+
+void fluid_predictor_free(FluidHistory& history);
+
+/* Overwrites velocity and pressure with the initial guess of the call at time t */
+void fluid_predictor_predict(FluidHistory& history, FluidPredictor predictor, double t, const double* crossSectionLength,
+                             const double* velocity_n, const double* pressure_n, double* velocity, double* pressure);
+
+/* Records the crossSectionLength of the finished call */
+void fluid_predictor_store(FluidHistory& history, const double* crossSectionLength);
+
+#endif
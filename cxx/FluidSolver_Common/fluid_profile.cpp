@@ -0,0 +1,21 @@
+#include "fluid_profile.h"
+#include <chrono>
+
+void fluid_profile_reset(FluidProfile& profile)
+{
+  profile.residual         = 0.0;
+  profile.jacobian         = 0.0;
+  profile.factor           = 0.0;
+  profile.solve            = 0.0;
+  profile.total            = 0.0;
+  profile.calls            = 0;
+  profile.iterations       = 0;
+  profile.factorizations   = 0;
+  profile.linearIterations = 0;
+  profile.unconverged      = 0;
+}
+
+double fluid_clock()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,53 @@
+#ifndef FLUID_PROFILE_H_
+#define FLUID_PROFILE_H_
+
+#include "../Common/elastictube_trace.h"
+
+/*
+   Wall time spent in the phases of the Newton iteration of the fluid solvers, accumulated
+   over all calls of fluid_nl() / fluidComputeSolution() with the same workspace. The
+   phases are timed with a lap clock, every fluid_profile_lap() charges the time since the
+   previous lap to one phase. Communication of the distributed solve is charged to the
+   phase it belongs to, everything not covered by a phase (norms, updates) only counts
+   in total. With ELASTICTUBE_TRACE, every lap is also recorded as a trace event.
+*/
+struct FluidProfile {
+  double residual;  // residual and Jacobian coefficients of the fused kernel, boundary rows, halo exchange
+  double jacobian;  // band (or SPIKE partition) assembly, JFNK preconditioner setup
+  double factor;    // LU factorization of the band, SPIKE reduced system
+  double solve;     // forward/backward substitution, GMRES
+  double total;     // complete calls, including all of the above
+
+  long calls;            // calls of the solver
+  long iterations;       // Newton iterations, i.e. residual evaluations, or explicit substeps
+  long factorizations;   // Jacobian factorizations
+  long linearIterations; // GMRES iterations of the JFNK engine
+  long unconverged;      // calls stopped by the iteration limit above the Newton tolerance
+};
+
+/* Newton iteration of the last call of the serial fluid solver */
+struct FluidCallStats {
+  double rtol;          // tolerance of the relative residual norm
+  double initialNorm;   // relative residual norm of the initial guess
+  double norm;          // relative residual norm at the end
+  int iterations;       // residual evaluations, substeps of the explicit engine
+  int factorizations;   // Jacobian factorizations
+  int linearIterations; // GMRES iterations of the JFNK engine
+  bool converged;       // norm < rtol, false if the iteration limit was reached
+};
+
+void fluid_profile_reset(FluidProfile& profile);
+
+/* Monotonic wall clock in seconds */
+double fluid_clock();
+
+/* Adds the time since clock to phase and restarts clock, name is the trace event */
+inline void fluid_profile_lap(double& phase, double& clock, const char* name)
+{
+  double now = fluid_clock();
+  phase += now - clock;
+  TRACE_COMPLETE(name, clock, now);
+  clock = now;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "fluid_refine.h"
+#include <algorithm>
+#include <math.h>
+
+bool fluid_refine_valid(int N, int levels)
+{
+  int block = 1 << levels;
+  return N % block == 0 && N / block >= 2;
+}
+
+bool fluid_refine_mesh(const TubeMesh& mesh, const TubeFields& fields, int levels, double tol, double window,
+                       TubeMesh& adapted)
+{
+  const double* p = fields.pressure;
+  const double* u = fields.velocity;
+  const double* A = fields.crossSectionLength;
+  int N = (int)mesh.length;
+  int block = 1 << levels, blocks = N / block;
+
+  // Pressure range and the largest wave speed |u| + c of the tube
+  double pMin = p[0], pMax = p[0], speed = 0.0;
+  for (int i = 0; i <= mesh.elements; i++) {
+    pMin = std::min(pMin, p[i]);
+    pMax = std::max(pMax, p[i]);
+    speed = std::max(speed, fabs(u[i]) + 1.0 / sqrt(sqrt(A[i])));
+  }
+  double allowed = tol * (pMax - pMin);
+
+  // Level of every block from the pressure differences of the elements it overlaps
+  std::vector<int> level(blocks, levels);
+  for (int e = 0; e < mesh.elements && allowed > 0.0; e++) {
+    double left = tube_mesh_position(mesh, e), right = tube_mesh_position(mesh, e + 1);
+    double gradient = fabs(p[e + 1] - p[e]) / (right - left); // per reference element
+    int j = 0;
+    while (j < levels && ldexp(gradient, j + 1) <= allowed)
+      j++;
+    for (int b = (int)(left / block); b < blocks && b * block < right; b++)
+      level[b] = std::min(level[b], j);
+  }
+
+  // Finest level within the distance of a window, counted with the blocks of level <= k before every block
+  int reach = (int)ceil(speed * window / block);
+  std::vector<int> reached(blocks, levels);
+  std::vector<int> count(blocks + 1, 0);
+  for (int k = 0; k < levels; k++) {
+    for (int b = 0; b < blocks; b++)
+      count[b + 1] = count[b] + (level[b] <= k ? 1 : 0);
+    for (int b = 0; b < blocks; b++) {
+      int first = std::max(0, b - reach), last = std::min(blocks, b + reach + 1);
+      if (reached[b] > k && count[last] > count[first])
+        reached[b] = k;
+    }
+  }
+
+  // Neighbours differ by at most one level
+  for (int b = 1; b < blocks; b++)
+    reached[b] = std::min(reached[b], reached[b - 1] + 1);
+  for (int b = blocks - 2; b >= 0; b--)
+    reached[b] = std::min(reached[b], reached[b + 1] + 1);
+
+  std::vector<double> x;
+  for (int b = 0; b < blocks; b++) {
+    for (int k = b * block; k < (b + 1) * block; k += 1 << reached[b])
+      x.push_back(k);
+  }
+  x.push_back(N);
+
+  if ((int)x.size() == N + 1)
+    tube_mesh_uniform(adapted, N);
+  else
+    tube_mesh_nodes(adapted, x);
+
+  if (adapted.elements != mesh.elements)
+    return true;
+  for (int i = 0; i <= mesh.elements; i++) {
+    if (tube_mesh_position(adapted, i) != tube_mesh_position(mesh, i))
+      return true;
+  }
+  return false;
+}
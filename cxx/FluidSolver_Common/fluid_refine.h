@@ -0,0 +1,35 @@
+#ifndef FLUID_REFINE_H_
+#define FLUID_REFINE_H_
+
+#include "../Common/elastictube_mesh.h"
+#include "fluid_state.h"
+
+/*
+   Adaptive mesh of the MonolithicSolver (--refine=<levels>).
+
+   The tube of N reference elements is split into blocks of 2^levels reference elements,
+   every block is meshed uniformly with elements of 2^j reference elements, 0 <= j <=
+   levels, so all nodes are nodes of the reference mesh. Between two time windows, the
+   level of a block follows from the pressure gradient of the solution: the pressure
+   difference across an element should be at most refineTol times the pressure range of
+   the tube. The pressure wave travels up to max(|u| + c) times the length of a window,
+   c = A^(-1/4), so every block gets the finest level of the blocks within this distance,
+   and neighbouring blocks differ by at most one level.
+
+   The mesh thus follows the wave fronts and is coarse elsewhere. This pays off if a wave
+   crosses a small part of the tube per window, i.e. for long tubes with a small
+   N kappa tau; otherwise the distance covers the whole tube and the mesh stays fine.
+*/
+
+/* True if N reference elements form at least two blocks of 2^levels elements */
+bool fluid_refine_valid(int N, int levels);
+
+/*
+   Adapted mesh for the solution fields on mesh and a next time window of the given length
+   in the time units of the discretization, 1/dx (see fluid_explicit.h). Returns false if
+   it equals mesh.
+*/
+bool fluid_refine_mesh(const TubeMesh& mesh, const TubeFields& fields, int levels, double tol, double window,
+                       TubeMesh& adapted);
+
+#endif
@@ -0,0 +1,274 @@
+#include "fluid_spike.h"
+#include "fluid_memory.h"
+
+extern "C" {
+void dgbtrf_(
+    int* m,
+    int* n,
+    int* kl,
+    int* ku,
+    double* ab,
+    int* ldab,
+    int* ipiv,
+    int* info);
+
+void dgbtrs_(
+    char* trans,
+    int* n,
+    int* kl,
+    int* ku,
+    int* nrhs,
+    double* ab,
+    int* ldab,
+    int* ipiv,
+    double* b,
+    int* ldb,
+    int* info);
+}
+
+void fluid_spike_allocate(FluidSpike& spike, int m, int P)
+{
+  spike.m    = m;
+  spike.k    = 4;
+  spike.kl   = 4;
+  spike.ku   = 4;
+  spike.ldab = 2 * spike.kl + spike.ku + 1;
+  spike.ab   = fluid_alloc<double>(spike.ldab * m);
+  spike.ipiv = fluid_alloc<int>(m);
+  spike.B    = fluid_alloc<double>(spike.k * spike.k);
+  spike.C    = fluid_alloc<double>(spike.k * spike.k);
+  spike.V    = fluid_alloc<double>(m * spike.k);
+  spike.W    = fluid_alloc<double>(m * spike.k);
+  spike.g    = fluid_alloc<double>(m);
+
+  int n = 2 * spike.k * P, kl = 3 * spike.k - 1, ku = 3 * spike.k - 1;
+  spike.P           = P;
+  spike.reducedAb   = fluid_alloc<double>((2 * kl + ku + 1) * n);
+  spike.reducedIpiv = fluid_alloc<int>(n);
+}
+
+void fluid_spike_free(FluidSpike& spike)
+{
+  fluid_free(spike.ab);
+  fluid_free(spike.ipiv);
+  fluid_free(spike.B);
+  fluid_free(spike.C);
+  fluid_free(spike.V);
+  fluid_free(spike.W);
+  fluid_free(spike.g);
+  fluid_free(spike.reducedAb);
+  fluid_free(spike.reducedIpiv);
+  spike.ab = spike.B = spike.C = spike.V = spike.W = spike.g = spike.reducedAb = NULL;
+  spike.ipiv = spike.reducedIpiv = NULL;
+}
+
+void fluid_spike_zero_coupling(FluidSpike& spike)
+{
+  for (int i = 0; i < spike.k * spike.k; i++) {
+    spike.B[i] = 0.0;
+    spike.C[i] = 0.0;
+  }
+}
+
+void fluid_spike_copy_band(FluidSpike& spike, const double* ab, int ldab, int n, int first)
+{
+  int m = spike.m, k = spike.k, kl = spike.kl, ku = spike.ku;
+
+  // Entry (r, c) of the matrix, zero outside of the band
+  auto entry = [=](int r, int c) -> double {
+    if (r < 0 || r >= n || c < 0 || c >= n || r - c > kl || c - r > ku)
+      return 0.0;
+    return ab[kl + ku + r - c + c * ldab];
+  };
+
+  // The rows of the fill-in and the rows outside of the partition are zero
+  for (int c = 0; c < m; c++) {
+    for (int pos = 0; pos < spike.ldab; pos++) {
+      int r = c + pos - kl - ku;
+      spike.ab[pos + c * spike.ldab] = pos >= kl && r >= 0 && r < m ? entry(first + r, first + c) : 0.0;
+    }
+  }
+
+  for (int j = 0; j < k; j++) {
+    for (int i = 0; i < k; i++) {
+      spike.C[i + j * k] = entry(first + i, first - k + j);
+      spike.B[i + j * k] = entry(first + m - k + i, first + m + j);
+    }
+  }
+}
+
+int fluid_spike_factor(FluidSpike& spike, bool hasPrevious, bool hasNext, int threads)
+{
+  int m = spike.m, k = spike.k;
+  int info, infoV = 0, infoW = 0;
+  char trans = 'N';
+
+  dgbtrf_(&spike.m, &spike.m, &spike.kl, &spike.ku, spike.ab, &spike.ldab, spike.ipiv, &info);
+  if (info != 0)
+    return info;
+
+  // The two spikes only read the factors
+#pragma omp parallel sections num_threads(2) if (threads > 1)
+  {
+#pragma omp section
+    {
+      // V = A^-1 [0; B]
+      for (int i = 0; i < m * k; i++)
+        spike.V[i] = 0.0;
+      if (hasNext) {
+        for (int j = 0; j < k; j++)
+          for (int i = 0; i < k; i++)
+            spike.V[(m - k + i) + j * m] = spike.B[i + j * k];
+        dgbtrs_(&trans, &spike.m, &spike.kl, &spike.ku, &spike.k, spike.ab, &spike.ldab, spike.ipiv, spike.V, &spike.m, &infoV);
+      }
+    }
+#pragma omp section
+    {
+      // W = A^-1 [C; 0]
+      for (int i = 0; i < m * k; i++)
+        spike.W[i] = 0.0;
+      if (hasPrevious) {
+        for (int j = 0; j < k; j++)
+          for (int i = 0; i < k; i++)
+            spike.W[i + j * m] = spike.C[i + j * k];
+        dgbtrs_(&trans, &spike.m, &spike.kl, &spike.ku, &spike.k, spike.ab, &spike.ldab, spike.ipiv, spike.W, &spike.m, &infoW);
+      }
+    }
+  }
+  return infoV != 0 ? infoV : infoW;
+}
+
+int fluid_spike_solve_local(FluidSpike& spike, const double* f)
+{
+  int nrhs = 1;
+  int info;
+  char trans = 'N';
+
+  for (int i = 0; i < spike.m; i++)
+    spike.g[i] = f[i];
+
+  dgbtrs_(&trans, &spike.m, &spike.kl, &spike.ku, &nrhs, spike.ab, &spike.ldab, spike.ipiv, spike.g, &spike.m, &info);
+  return info;
+}
+
+void fluid_spike_pack(const FluidSpike& spike, double* buffer)
+{
+  int m = spike.m, k = spike.k;
+  int pos = 0;
+
+  // Vt, Vb, Wt, Wb, each k x k column-major
+  for (int j = 0; j < k; j++)
+    for (int i = 0; i < k; i++)
+      buffer[pos++] = spike.V[i + j * m];
+  for (int j = 0; j < k; j++)
+    for (int i = 0; i < k; i++)
+      buffer[pos++] = spike.V[(m - k + i) + j * m];
+  for (int j = 0; j < k; j++)
+    for (int i = 0; i < k; i++)
+      buffer[pos++] = spike.W[i + j * m];
+  for (int j = 0; j < k; j++)
+    for (int i = 0; i < k; i++)
+      buffer[pos++] = spike.W[(m - k + i) + j * m];
+
+  // gt, gb
+  for (int i = 0; i < k; i++)
+    buffer[pos++] = spike.g[i];
+  for (int i = 0; i < k; i++)
+    buffer[pos++] = spike.g[m - k + i];
+}
+
+void fluid_spike_pack_rhs(const FluidSpike& spike, double* buffer)
+{
+  int m = spike.m, k = spike.k;
+
+  for (int i = 0; i < k; i++)
+    buffer[i] = spike.g[i];
+  for (int i = 0; i < k; i++)
+    buffer[k + i] = spike.g[m - k + i];
+}
+
+int fluid_spike_reduced_factor(FluidSpike& spike, const double* packed)
+{
+  /*
+     Unknowns are ordered (x_0^t, x_0^b, x_1^t, x_1^b, ...), every partition contributes
+       x_p^t + V_p^t x_{p+1}^t + W_p^t x_{p-1}^b = g_p^t
+       x_p^b + V_p^b x_{p+1}^t + W_p^b x_{p-1}^b = g_p^b
+     which is a band matrix with 3k-1 sub- and superdiagonals.
+  */
+  int P = spike.P, k = spike.k;
+  int n = 2 * k * P;
+  int kl = 3 * k - 1, ku = 3 * k - 1;
+  int ldab = 2 * kl + ku + 1;
+  int info;
+
+  double* ab = spike.reducedAb;
+  for (int i = 0; i < ldab * n; i++)
+    ab[i] = 0.0;
+
+  for (int p = 0; p < P; p++) {
+    const double* Vt = packed + p * fluid_spike_pack_size(k);
+    const double* Vb = Vt + k * k;
+    const double* Wt = Vb + k * k;
+    const double* Wb = Wt + k * k;
+
+    int top = 2 * p * k;
+    int bottom = top + k;
+    int nextTop = top + 2 * k;
+    int previousBottom = top - k;
+
+    for (int a = 0; a < k; a++) {
+      ab[kl + ku + (top + a) * ldab] = 1.0;
+      ab[kl + ku + (bottom + a) * ldab] = 1.0;
+
+      for (int b = 0; b < k; b++) {
+        if (p < P - 1) {
+          int col = nextTop + b;
+          ab[kl + ku + (top + a) - col + col * ldab] += Vt[a + b * k];
+          ab[kl + ku + (bottom + a) - col + col * ldab] += Vb[a + b * k];
+        }
+        if (p > 0) {
+          int col = previousBottom + b;
+          ab[kl + ku + (top + a) - col + col * ldab] += Wt[a + b * k];
+          ab[kl + ku + (bottom + a) - col + col * ldab] += Wb[a + b * k];
+        }
+      }
+    }
+  }
+
+  dgbtrf_(&n, &n, &kl, &ku, ab, &ldab, spike.reducedIpiv, &info);
+  return info;
+}
+
+int fluid_spike_reduced_substitute(FluidSpike& spike, const double* rhs, int stride, double* y)
+{
+  int P = spike.P, k = spike.k;
+  int n = 2 * k * P;
+  int kl = 3 * k - 1, ku = 3 * k - 1;
+  int ldab = 2 * kl + ku + 1;
+  int nrhs = 1;
+  int info;
+  char trans = 'N';
+
+  for (int p = 0; p < P; p++)
+    for (int i = 0; i < 2 * k; i++)
+      y[2 * p * k + i] = rhs[p * stride + i];
+
+  dgbtrs_(&trans, &n, &kl, &ku, &nrhs, spike.reducedAb, &ldab, spike.reducedIpiv, y, &n, &info);
+  return info;
+}
+
+void fluid_spike_recover(FluidSpike& spike, const double* nextTop, const double* previousBottom)
+{
+  int m = spike.m, k = spike.k;
+
+  for (int j = 0; j < k; j++) {
+    if (nextTop) {
+      for (int i = 0; i < m; i++)
+        spike.g[i] -= spike.V[i + j * m] * nextTop[j];
+    }
+    if (previousBottom) {
+      for (int i = 0; i < m; i++)
+        spike.g[i] -= spike.W[i + j * m] * previousBottom[j];
+    }
+  }
+}
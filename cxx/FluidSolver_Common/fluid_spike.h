@@ -0,0 +1,96 @@
+#ifndef FLUID_SPIKE_H_
+#define FLUID_SPIKE_H_
+
+/*
+   Partitioned solution of the banded Newton system with the SPIKE algorithm.
+
+   The interleaved system of fluid_banded.h is split into P consecutive row blocks, one
+   per partition. Partition p owns the local band A_p and the k x k coupling blocks
+   C_p (first k rows, last k columns of partition p-1) and B_p (last k rows, first k
+   columns of partition p+1), with k = max(KL, KU) = 4. Every partition factorizes its
+   own band and computes the spikes V_p = A_p^-1 [0; B_p], W_p = A_p^-1 [C_p; 0] and
+   g_p = A_p^-1 f_p. Only the top and bottom k rows of those (fluid_spike_pack) are
+   needed to set up the reduced system for the interface unknowns, which is of size
+   2kP, factorized with a band solver by fluid_spike_reduced_factor and solved by
+   fluid_spike_reduced_substitute, also for further right hand sides with the same
+   factors (fluid_spike_pack_rhs). Every partition then recovers its part of the
+   solution with fluid_spike_recover.
+
+   Apart from the reduced system, all work is local and O(m) for a partition of m rows.
+   Each partition needs at least 2k rows.
+*/
+
+struct FluidSpike {
+  int m;       // number of local rows
+  int k;       // width of the coupling blocks
+  int kl;      // number of subdiagonals of the local band
+  int ku;      // number of superdiagonals of the local band
+  int ldab;    // leading dimension of ab, 2*kl+ku+1
+  double* ab;  // local band in LAPACK band storage, ldab x m
+  int* ipiv;   // pivot indices of the local LU factorization
+  double* B;   // coupling to the next partition, k x k, column-major
+  double* C;   // coupling to the previous partition, k x k, column-major
+  double* V;   // right spike, m x k, column-major
+  double* W;   // left spike, m x k, column-major
+  double* g;   // local right hand side / solution, m
+
+  int P;               // number of partitions
+  double* reducedAb;   // band of the reduced system, order 2kP
+  int* reducedIpiv;    // pivot indices of the reduced system
+};
+
+/* Number of doubles per partition exchanged for the reduced system */
+inline int fluid_spike_pack_size(int k)
+{
+  return 4 * k * k + 2 * k;
+}
+
+/* Allocates a partition of m rows, and the reduced system of P partitions */
+void fluid_spike_allocate(FluidSpike& spike, int m, int P);
+
+void fluid_spike_free(FluidSpike& spike);
+
+/* Zeros only the coupling blocks B and C, if the local band is written completely by the caller */
+void fluid_spike_zero_coupling(FluidSpike& spike);
+
+/* Entry (row, col) of the local rows, col < 0 and col >= m address the coupling blocks */
+inline double& fluid_spike_entry(FluidSpike& spike, int row, int col)
+{
+  if (col < 0)
+    return spike.C[row + (col + spike.k) * spike.k];
+  if (col >= spike.m)
+    return spike.B[(row - spike.m + spike.k) + (col - spike.m) * spike.k];
+  return spike.ab[spike.kl + spike.ku + row - col + col * spike.ldab];
+}
+
+/*
+   Copies the rows first .. first+m-1 of a matrix of order n, which is given in LAPACK band
+   storage with the same kl and ku, into the local band and the coupling blocks
+*/
+void fluid_spike_copy_band(FluidSpike& spike, const double* ab, int ldab, int n, int first);
+
+/* Factorizes the local band and computes the spikes, V and W on two threads if threads > 1. Returns the LAPACK info. */
+int fluid_spike_factor(FluidSpike& spike, bool hasPrevious, bool hasNext, int threads);
+
+/* Solves the local band for the right hand side f, the result is stored in g */
+int fluid_spike_solve_local(FluidSpike& spike, const double* f);
+
+/* Packs the top and bottom rows of the spikes and of g into buffer */
+void fluid_spike_pack(const FluidSpike& spike, double* buffer);
+
+/* Packs only the top and bottom rows of g (2k values), sufficient to reuse a reduced factorization */
+void fluid_spike_pack_rhs(const FluidSpike& spike, double* buffer);
+
+/* Assembles and factorizes the reduced system of all spike.P partitions from their packed spikes, ordered by partition */
+int fluid_spike_reduced_factor(FluidSpike& spike, const double* packed);
+
+/*
+   Solves the factorized reduced system, the 2k values of g of partition p are at rhs + p*stride.
+   y receives 2kP entries, the top k and the bottom k values of the solution of every partition.
+*/
+int fluid_spike_reduced_substitute(FluidSpike& spike, const double* rhs, int stride, double* y);
+
+/* Recovers the local solution g from the interface values of the neighbours */
+void fluid_spike_recover(FluidSpike& spike, const double* nextTop, const double* previousBottom);
+
+#endif
@@ -0,0 +1,62 @@
+#include "fluid_state.h"
+#include "fluid_memory.h"
+
+/* Arrays of one level are padded to whole cache lines */
+static int padded(int n)
+{
+  int values = FLUID_ALIGNMENT / sizeof(double);
+  return (n + values - 1) / values * values;
+}
+
+void tube_state_allocate(TubeState& state, int n)
+{
+  int stride = padded(n);
+  state.n = n;
+  state.storage = fluid_alloc<double>(6 * stride);
+  double* levels[2] = {state.storage, state.storage + 3 * stride};
+  TubeFields* fields[2] = {&state.current, &state.previous};
+  for (int l = 0; l < 2; l++) {
+    fields[l]->velocity = levels[l];
+    fields[l]->pressure = levels[l] + stride;
+    fields[l]->crossSectionLength = levels[l] + 2 * stride;
+  }
+  state.advanced = false;
+}
+
+void tube_state_free(TubeState& state)
+{
+  fluid_free(state.storage);
+  state.storage = NULL;
+  state.current.velocity = state.current.pressure = state.current.crossSectionLength = NULL;
+  state.previous.velocity = state.previous.pressure = state.previous.crossSectionLength = NULL;
+}
+
+void tube_state_fill(TubeState& state, double velocity, double pressure, double crossSectionLength)
+{
+  for (int i = 0; i < state.n; i++) {
+    state.current.velocity[i] = state.previous.velocity[i] = velocity;
+    state.current.pressure[i] = state.previous.pressure[i] = pressure;
+    state.current.crossSectionLength[i] = state.previous.crossSectionLength[i] = crossSectionLength;
+  }
+  state.advanced = false;
+}
+
+void tube_state_advance(TubeState& state)
+{
+  TubeFields swap = state.previous;
+  state.previous = state.current;
+  state.current = swap;
+  state.advanced = true;
+}
+
+void tube_state_settle(TubeState& state)
+{
+  if (!state.advanced)
+    return;
+  for (int i = 0; i < state.n; i++) {
+    state.current.velocity[i] = state.previous.velocity[i];
+    state.current.pressure[i] = state.previous.pressure[i];
+    state.current.crossSectionLength[i] = state.previous.crossSectionLength[i];
+  }
+  state.advanced = false;
+}
@@ -0,0 +1,49 @@
+#ifndef FLUID_STATE_H_
+#define FLUID_STATE_H_
+
+/*
+   Velocity, pressure and crossSectionLength of the fluid at the current and the previous
+   time level, structure of arrays in one allocation aligned to FLUID_ALIGNMENT (see
+   fluid_memory.h). n is N+1 for the serial solvers and chunkLength for a rank of the
+   parallel solver.
+
+   The time advance swaps the two levels instead of copying current into previous. Until
+   the next solve, the values of the current level are those of previous: advanced is set,
+   callers access the current values through tube_state_iterate(), e.g. to read
+   crossSectionLength from preCICE, and the solvers read their initial guess from previous
+   and write the first Newton update into current.
+*/
+struct TubeFields {
+  double* velocity;
+  double* pressure;
+  double* crossSectionLength;
+};
+
+struct TubeState {
+  int n;
+  TubeFields current;  // iterate of the time window
+  TubeFields previous; // converged solution of the last time window
+  bool advanced;       // the values of current are those of previous
+  double* storage;
+};
+
+void tube_state_allocate(TubeState& state, int n);
+
+void tube_state_free(TubeState& state);
+
+/* Constant values on both levels */
+void tube_state_fill(TubeState& state, double velocity, double pressure, double crossSectionLength);
+
+/* Accepts the current level as solution of the time window, O(1) */
+void tube_state_advance(TubeState& state);
+
+/* Level holding the values of the current iterate */
+inline const TubeFields& tube_state_iterate(const TubeState& state)
+{
+  return state.advanced ? state.previous : state.current;
+}
+
+/* Copies previous into current if advanced, e.g. before current is modified in place */
+void tube_state_settle(TubeState& state);
+
+#endif
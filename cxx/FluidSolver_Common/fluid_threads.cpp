@@ -0,0 +1,133 @@
+#include "fluid_threads.h"
+#include "fluid_memory.h"
+
+bool fluid_threads_available()
+{
+#ifdef _OPENMP
+  return true;
+#else
+  return false;
+#endif
+}
+
+void fluid_threads_allocate(FluidThreads& threads, int N, int count, bool partitioned)
+{
+  threads.count     = count;
+  threads.sums      = fluid_alloc<double>(2 * count);
+  threads.P         = 0;
+  threads.first     = NULL;
+  threads.spikes    = NULL;
+  threads.packed    = NULL;
+  threads.packedRhs = NULL;
+  threads.y         = NULL;
+
+  // Every partition needs at least 2k = 8 rows, i.e. 4 nodes
+  int P = count < (N + 1) / 4 ? count : (N + 1) / 4;
+  if (!partitioned || P < 2)
+    return;
+
+  threads.P      = P;
+  threads.first  = fluid_alloc<int>(P + 1);
+  threads.spikes = new FluidSpike[P];
+  for (int p = 0; p <= P; p++)
+    threads.first[p] = (int)((long)p * (N + 1) / P);
+  for (int p = 0; p < P; p++)
+    fluid_spike_allocate(threads.spikes[p], 2 * (threads.first[p + 1] - threads.first[p]), P);
+
+  int k = threads.spikes[0].k;
+  threads.packed    = fluid_alloc<double>(P * fluid_spike_pack_size(k));
+  threads.packedRhs = fluid_alloc<double>(2 * k * P);
+  threads.y         = fluid_alloc<double>(2 * k * P);
+}
+
+void fluid_threads_free(FluidThreads& threads)
+{
+  for (int p = 0; p < threads.P; p++)
+    fluid_spike_free(threads.spikes[p]);
+  delete [] threads.spikes;
+  fluid_free(threads.sums);
+  fluid_free(threads.first);
+  fluid_free(threads.packed);
+  fluid_free(threads.packedRhs);
+  fluid_free(threads.y);
+  threads.count     = 0;
+  threads.P         = 0;
+  threads.sums      = NULL;
+  threads.first     = NULL;
+  threads.spikes    = NULL;
+  threads.packed    = NULL;
+  threads.packedRhs = NULL;
+  threads.y         = NULL;
+}
+
+int fluid_threads_factor(FluidThreads& threads, FluidBand& band)
+{
+  int P = threads.P;
+  int info = 0;
+
+  // The partitions do not depend on the number of threads OpenMP actually provides
+#pragma omp parallel num_threads(P)
+  {
+    for (int p = fluid_thread_id(); p < P; p += fluid_thread_count()) {
+      FluidSpike& spike = threads.spikes[p];
+      fluid_spike_copy_band(spike, band.ab, band.ldab, band.n, 2 * threads.first[p]);
+      int local = fluid_spike_factor(spike, p > 0, p < P - 1, 1);
+      fluid_spike_pack(spike, threads.packed + p * fluid_spike_pack_size(spike.k));
+      if (local != 0) {
+#pragma omp critical
+        info = local;
+      }
+    }
+  }
+
+  if (info == 0)
+    info = fluid_spike_reduced_factor(threads.spikes[0], threads.packed);
+  return info;
+}
+
+int fluid_threads_substitute(FluidThreads& threads, FluidBand& band, double* b)
+{
+  int P = threads.P, N = band.N;
+  int k = threads.spikes[0].k;
+  int info = 0;
+
+#pragma omp parallel num_threads(P)
+  {
+    int thread = fluid_thread_id(), count = fluid_thread_count();
+
+    // Local solves of the right hand side, interleaved in band.x
+    for (int p = thread; p < P; p += count) {
+      FluidSpike& spike = threads.spikes[p];
+      double* f = band.x + 2 * threads.first[p];
+      for (int i = threads.first[p]; i < threads.first[p + 1]; i++) {
+        band.x[2 * i] = b[i];
+        band.x[2 * i + 1] = b[N + 1 + i];
+      }
+      int local = fluid_spike_solve_local(spike, f);
+      fluid_spike_pack_rhs(spike, threads.packedRhs + p * 2 * k);
+      if (local != 0) {
+#pragma omp critical
+        info = local;
+      }
+    }
+
+#pragma omp barrier
+#pragma omp single
+    {
+      if (info == 0)
+        info = fluid_spike_reduced_substitute(threads.spikes[0], threads.packedRhs, 2 * k, threads.y);
+    }
+
+    // Recovery from the interface values of the neighbours
+    for (int p = thread; p < P; p += count) {
+      FluidSpike& spike = threads.spikes[p];
+      fluid_spike_recover(spike, p < P - 1 ? threads.y + 2 * k * (p + 1) : NULL, p > 0 ? threads.y + 2 * k * p - k : NULL);
+      for (int i = threads.first[p]; i < threads.first[p + 1]; i++) {
+        int j = i - threads.first[p];
+        b[i] = spike.g[2 * j];
+        b[N + 1 + i] = spike.g[2 * j + 1];
+      }
+    }
+  }
+  return info;
+}
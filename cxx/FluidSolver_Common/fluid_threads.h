@@ -0,0 +1,76 @@
+#ifndef FLUID_THREADS_H_
+#define FLUID_THREADS_H_
+
+#include "fluid_banded.h"
+#include "fluid_spike.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+   Shared-memory parallelism of the serial fluid solver (--threads, OpenMP). The loops of
+   the Newton iteration are split into contiguous node ranges, one per thread. The
+   ranges of the assembly kernel start at multiples of 8 nodes, so every node takes the
+   same vector or scalar path as in a single thread and residual and Jacobian do not
+   depend on the number of threads. Norms are summed per thread and the partial sums
+   are added in the order of the threads.
+
+   The band system is solved with the SPIKE algorithm of fluid_spike.h: the assembled
+   band is copied into P partitions of consecutive nodes, which are factorized and
+   solved by one thread each; only the reduced system of the 8P interface unknowns is
+   solved by a single thread. SPIKE does not pivot across partitions, the solution
+   differs from the one of DGBTRF in the last digits (about 1e-14 relative), so the
+   Newton iteration converges to the same solution up to its tolerance. With one
+   thread, the solver runs exactly the serial code path.
+
+   Without OpenMP, all parallel regions run on the calling thread.
+*/
+
+#ifdef _OPENMP
+inline int fluid_thread_id() { return omp_get_thread_num(); }
+inline int fluid_thread_count() { return omp_get_num_threads(); }
+#else
+inline int fluid_thread_id() { return 0; }
+inline int fluid_thread_count() { return 1; }
+#endif
+
+/* true if the solver was built with OpenMP */
+bool fluid_threads_available();
+
+/* Range first <= i < last of thread of threads within begin <= i < end, split at multiples of 8 after begin */
+inline void fluid_thread_range(int begin, int end, int thread, int threads, int& first, int& last)
+{
+  long blocks = (end - begin + 7) / 8;
+  first = begin + (int)(blocks * thread / threads) * 8;
+  last = begin + (int)(blocks * (thread + 1) / threads) * 8;
+  if (first > end)
+    first = end;
+  if (last > end)
+    last = end;
+}
+
+struct FluidThreads {
+  int count;       // threads of the solve
+  double* sums;    // partial sums of the norms, 2 per thread
+
+  int P;              // SPIKE partitions of the band solve, 0 if the band is solved by DGBTRF
+  int* first;         // first node of every partition and N+1, P+1
+  FluidSpike* spikes; // partition p holds the interleaved rows 2*first[p] .. 2*first[p+1]-1
+  double* packed;     // spikes of all partitions for the reduced system
+  double* packedRhs;  // reduced right hand sides of all partitions
+  double* y;          // interface values of all partitions
+};
+
+/* threads for N mesh elements, with SPIKE partitions if partitioned and threads > 1 */
+void fluid_threads_allocate(FluidThreads& threads, int N, int count, bool partitioned);
+
+void fluid_threads_free(FluidThreads& threads);
+
+/* Factorizes the assembled band in P partitions and the reduced system. Returns the LAPACK info. */
+int fluid_threads_factor(FluidThreads& threads, FluidBand& band);
+
+/* Solves with the factors of fluid_threads_factor, b is given in block ordering (see fluid_banded.h) */
+int fluid_threads_substitute(FluidThreads& threads, FluidBand& band, double* b);
+
+#endif
@@ -0,0 +1,109 @@
+#include "fluid_timestep.h"
+#include "fluid_memory.h"
+#include <math.h>
+
+void fluid_step_allocate(FluidStepControl& control, int N, const FluidOptions& options, double dt)
+{
+  int n = N + 1;
+  control.n = n;
+  control.tol = options.dtTol;
+  control.dtMin = options.dtMin;
+  control.dtMax = options.dtMax;
+  control.h = fmin(fmax(dt, options.dtMin), options.dtMax);
+  control.hPrevious = 0.0;
+  control.error = 0.0;
+  control.velocityRate = fluid_alloc<double>(n);
+  control.pressureRate = fluid_alloc<double>(n);
+  control.accepted = 0;
+  control.rejected = 0;
+  control.hCheckpoint = control.h;
+  control.hPreviousCheckpoint = 0.0;
+  control.velocityRateCheckpoint = fluid_alloc<double>(n);
+  control.pressureRateCheckpoint = fluid_alloc<double>(n);
+}
+
+void fluid_step_free(FluidStepControl& control)
+{
+  fluid_free(control.velocityRate);
+  fluid_free(control.pressureRate);
+  fluid_free(control.velocityRateCheckpoint);
+  fluid_free(control.pressureRateCheckpoint);
+  control.velocityRate = control.pressureRate = NULL;
+  control.velocityRateCheckpoint = control.pressureRateCheckpoint = NULL;
+}
+
+bool fluid_step_control(FluidStepControl& control, const TubeState& state, double h, bool reject)
+{
+  const TubeFields& current = state.current;
+  const TubeFields& previous = state.previous;
+  int n = control.n;
+
+  if (control.hPrevious > 0.0) {
+    double difference = 0.0, solution = 0.0;
+    for (int i = 0; i < n; i++) {
+      double du = current.velocity[i] - previous.velocity[i] - h * control.velocityRate[i];
+      double dp = current.pressure[i] - previous.pressure[i] - h * control.pressureRate[i];
+      difference += du * du + dp * dp;
+      solution += current.velocity[i] * current.velocity[i] + current.pressure[i] * current.pressure[i];
+    }
+    control.error = h / (h + control.hPrevious) * sqrt(difference) / (control.tol * sqrt(solution));
+
+    // Local error O(h^2), with a safety factor and bounded changes
+    double factor = control.error > 0.0 ? 0.9 / sqrt(control.error) : 2.0;
+    factor = fmin(fmax(factor, 0.2), 2.0);
+    control.h = fmin(fmax(h * factor, control.dtMin), control.dtMax);
+
+    if (reject && control.error > 1.0 && h > control.dtMin) {
+      control.rejected++;
+      return false;
+    }
+  } else {
+    control.error = 0.0;
+    control.h = h;
+  }
+
+  for (int i = 0; i < n; i++) {
+    control.velocityRate[i] = (current.velocity[i] - previous.velocity[i]) / h;
+    control.pressureRate[i] = (current.pressure[i] - previous.pressure[i]) / h;
+  }
+  control.hPrevious = h;
+  control.accepted++;
+  return true;
+}
+
+void fluid_step_checkpoint(FluidStepControl& control)
+{
+  control.hCheckpoint = control.h;
+  control.hPreviousCheckpoint = control.hPrevious;
+  for (int i = 0; i < control.n; i++) {
+    control.velocityRateCheckpoint[i] = control.velocityRate[i];
+    control.pressureRateCheckpoint[i] = control.pressureRate[i];
+  }
+}
+
+void fluid_step_restore(FluidStepControl& control)
+{
+  control.h = control.hCheckpoint;
+  control.hPrevious = control.hPreviousCheckpoint;
+  for (int i = 0; i < control.n; i++) {
+    control.velocityRate[i] = control.velocityRateCheckpoint[i];
+    control.pressureRate[i] = control.pressureRateCheckpoint[i];
+  }
+}
+
+static void remesh(double*& values, const TubeMesh& mesh, const TubeMesh& adapted)
+{
+  double* moved = fluid_alloc<double>(adapted.elements + 1);
+  tube_mesh_interpolate(mesh, values, adapted, moved);
+  fluid_free(values);
+  values = moved;
+}
+
+void fluid_step_remesh(FluidStepControl& control, const TubeMesh& mesh, const TubeMesh& adapted)
+{
+  remesh(control.velocityRate, mesh, adapted);
+  remesh(control.pressureRate, mesh, adapted);
+  remesh(control.velocityRateCheckpoint, mesh, adapted);
+  remesh(control.pressureRateCheckpoint, mesh, adapted);
+  control.n = adapted.elements + 1;
+}
@@ -0,0 +1,63 @@
+#ifndef FLUID_TIMESTEP_H_
+#define FLUID_TIMESTEP_H_
+
+#include "../Common/elastictube_mesh.h"
+#include "fluid_options.h"
+#include "fluid_state.h"
+
+/*
+   Step size control of the serial solvers (--dt-tol). The fluid is advanced by implicit
+   Euler steps, the local error of a step of size h is estimated by Milne's device: the
+   solution y is compared with the linear extrapolation of the last accepted step,
+
+     err = h / (h + hPrevious) * |y - y_n - h * rate|,   rate = (y_n - y_{n-1}) / hPrevious
+
+   in the norm of velocity and pressure together, relative to dtTol times the norm of the
+   solution. The next step size is h * 0.9 / sqrt(err), at most twice and at least a fifth
+   of h and within [dtMin, dtMax]; a step with err > 1 is repeated with it. The first
+   step has no estimate and keeps its size.
+
+   Within an implicit coupling window, the rates of the window start are kept as
+   checkpoint, such that every coupling iteration estimates the same steps.
+*/
+struct FluidStepControl {
+  int n;             // nodes, N+1
+  double tol;        // relative tolerance of the local error
+  double dtMin;      // bounds of the step size
+  double dtMax;
+  double h;          // proposed size of the next step
+  double hPrevious;  // size of the last accepted step, 0 before the first one
+  double error;      // estimate of the last step, relative to tol
+  double* velocityRate; // change per time of the last accepted step
+  double* pressureRate;
+  long accepted;     // accepted and repeated steps
+  long rejected;
+
+  // rates and step sizes at the start of the coupling window
+  double hCheckpoint, hPreviousCheckpoint;
+  double* velocityRateCheckpoint;
+  double* pressureRateCheckpoint;
+};
+
+/* Control for N mesh elements with the tolerances of options, starting with steps of size dt */
+void fluid_step_allocate(FluidStepControl& control, int N, const FluidOptions& options, double dt);
+
+void fluid_step_free(FluidStepControl& control);
+
+/*
+   Estimates the error of the step of size h from the previous to the current level of
+   state and proposes the size of the next step in control.h. Returns false if the step
+   has to be repeated, which is never the case if reject is false. Accepted steps update
+   the rates, the caller then advances state.
+*/
+bool fluid_step_control(FluidStepControl& control, const TubeState& state, double h, bool reject);
+
+/* Saves and restores the rates at the start of an implicit coupling window */
+void fluid_step_checkpoint(FluidStepControl& control);
+
+void fluid_step_restore(FluidStepControl& control);
+
+/* Interpolates the rates from the nodes of mesh to those of adapted, see fluid_refine.h */
+void fluid_step_remesh(FluidStepControl& control, const TubeMesh& mesh, const TubeMesh& adapted);
+
+#endif
@@ -0,0 +1,169 @@
+#include "fluid_workspace.h"
+#include "fluid_kernel.h"
+#include "fluid_memory.h"
+#include "../Common/elastictube_partition.h"
+
+static void fluid_workspace_clear(FluidWorkspace& workspace, int N, int chunkLength)
+{
+  workspace.N           = N;
+  workspace.chunkLength = chunkLength;
+  workspace.Res         = NULL;
+  workspace.jac         = NULL;
+  workspace.flux_n      = NULL;
+  workspace.factorized  = false;
+  workspace.factorTime  = 0.0;
+  fluid_profile_reset(workspace.profile);
+  workspace.last        = FluidCallStats();
+  workspace.mesh        = NULL;
+  workspace.packedRhs   = NULL;
+  workspace.u           = NULL;
+  workspace.p           = NULL;
+  workspace.a           = NULL;
+  workspace.u_n         = NULL;
+  workspace.p_n         = NULL;
+  workspace.a_n         = NULL;
+  workspace.packed      = NULL;
+  workspace.y           = NULL;
+  workspace.partition   = NULL;
+  workspace.local       = NULL;
+  workspace.gathered    = NULL;
+
+  workspace.step           = NULL;
+  workspace.perturbed      = NULL;
+  workspace.resPerturbed   = NULL;
+  workspace.preconditioner = NULL;
+
+  workspace.band.ab   = NULL;
+  workspace.band.x    = NULL;
+  workspace.band.ipiv = NULL;
+  workspace.band.abf  = NULL;
+  workspace.band.xf   = NULL;
+  workspace.band.r    = NULL;
+
+  workspace.threads.count     = 0;
+  workspace.threads.P         = 0;
+  workspace.threads.sums      = NULL;
+  workspace.threads.first     = NULL;
+  workspace.threads.spikes    = NULL;
+  workspace.threads.packed    = NULL;
+  workspace.threads.packedRhs = NULL;
+  workspace.threads.y         = NULL;
+
+  workspace.spike.ab          = NULL;
+  workspace.spike.ipiv        = NULL;
+  workspace.spike.B           = NULL;
+  workspace.spike.C           = NULL;
+  workspace.spike.V           = NULL;
+  workspace.spike.W           = NULL;
+  workspace.spike.g           = NULL;
+  workspace.spike.reducedAb   = NULL;
+  workspace.spike.reducedIpiv = NULL;
+
+  workspace.history.velocity = NULL;
+
+  workspace.waves.A  = NULL;
+
+  workspace.krylov.V  = NULL;
+  workspace.krylov.H  = NULL;
+  workspace.krylov.cs = NULL;
+  workspace.krylov.sn = NULL;
+  workspace.krylov.s  = NULL;
+  workspace.krylov.w  = NULL;
+  workspace.krylov.z  = NULL;
+}
+
+void fluid_workspace_allocate(FluidWorkspace& workspace, int N, const FluidOptions& options)
+{
+  fluid_workspace_clear(workspace, N, N + 1);
+  workspace.Res = fluid_alloc<double>(2 * N + 2);
+  workspace.jac = fluid_alloc<double>(FLUID_JAC_COUNT * (N + 1));
+  if (options.theta < 1.0)
+    workspace.flux_n = fluid_alloc<double>(2 * N + 2);
+  if (options.engine == FLUID_ENGINE_JFNK) {
+    fluid_krylov_allocate(workspace.krylov, 2 * N + 2, options.krylovRestart);
+    workspace.step           = fluid_alloc<double>(2 * N + 2);
+    workspace.perturbed      = fluid_alloc<double>(2 * N + 2);
+    workspace.resPerturbed   = fluid_alloc<double>(2 * N + 2);
+    workspace.preconditioner = fluid_alloc<double>(4 * N + 4);
+  } else if (options.engine == FLUID_ENGINE_EXPLICIT) {
+    fluid_explicit_allocate(workspace.waves, N);
+  } else {
+    fluid_band_allocate(workspace.band, N, options.precision == FLUID_PRECISION_MIXED);
+  }
+  if (options.predictor != FLUID_PREDICTOR_NONE)
+    fluid_predictor_allocate(workspace.history, N);
+  fluid_threads_allocate(workspace.threads, N, options.threads, options.engine == FLUID_ENGINE_NEWTON);
+}
+
+void fluid_workspace_allocate_distributed(FluidWorkspace& workspace, int N, int chunkLength, int size, const FluidOptions& options)
+{
+  fluid_workspace_clear(workspace, N, chunkLength);
+  workspace.Res       = fluid_alloc<double>(2 * chunkLength);
+  workspace.jac       = fluid_alloc<double>(FLUID_JAC_COUNT * chunkLength);
+  workspace.u         = fluid_alloc<double>(chunkLength + 2);
+  workspace.p         = fluid_alloc<double>(chunkLength + 2);
+  workspace.a         = fluid_alloc<double>(chunkLength + 2);
+  if (options.theta < 1.0) {
+    workspace.flux_n  = fluid_alloc<double>(2 * chunkLength);
+    workspace.u_n     = fluid_alloc<double>(chunkLength + 2);
+    workspace.p_n     = fluid_alloc<double>(chunkLength + 2);
+    workspace.a_n     = fluid_alloc<double>(chunkLength + 2);
+  }
+  fluid_spike_allocate(workspace.spike, 2 * chunkLength, size);
+  workspace.packed    = fluid_alloc<double>(size * fluid_spike_pack_size(workspace.spike.k));
+  workspace.packedRhs = fluid_alloc<double>(2 * workspace.spike.k * size);
+  workspace.y         = fluid_alloc<double>(2 * workspace.spike.k * size);
+  fluid_threads_allocate(workspace.threads, N, options.threads, false);
+}
+
+void fluid_workspace_allocate_centralized(FluidWorkspace& workspace, const TubePartition& partition, int rank, const FluidOptions& options)
+{
+  int N = partition.nodes - 1;
+  int chunkLength = partition.counts[rank];
+  fluid_workspace_clear(workspace, N, chunkLength);
+  workspace.partition = &partition;
+  workspace.local     = fluid_alloc<double>(7 * chunkLength);
+  if (rank == 0) {
+    workspace.Res      = fluid_alloc<double>(2 * N + 2);
+    workspace.jac      = fluid_alloc<double>(FLUID_JAC_COUNT * (N + 1));
+    workspace.gathered = fluid_alloc<double>(7 * (N + 1));
+    if (options.theta < 1.0)
+      workspace.flux_n = fluid_alloc<double>(2 * N + 2);
+    fluid_band_allocate(workspace.band, N, options.precision == FLUID_PRECISION_MIXED);
+  }
+}
+
+void fluid_workspace_free(FluidWorkspace& workspace)
+{
+  fluid_free(workspace.Res);
+  fluid_free(workspace.jac);
+  fluid_free(workspace.u);
+  fluid_free(workspace.p);
+  fluid_free(workspace.a);
+  fluid_free(workspace.flux_n);
+  fluid_free(workspace.u_n);
+  fluid_free(workspace.p_n);
+  fluid_free(workspace.a_n);
+  fluid_free(workspace.packed);
+  fluid_free(workspace.packedRhs);
+  fluid_free(workspace.y);
+  fluid_free(workspace.local);
+  fluid_free(workspace.gathered);
+  fluid_free(workspace.step);
+  fluid_free(workspace.perturbed);
+  fluid_free(workspace.resPerturbed);
+  fluid_free(workspace.preconditioner);
+  if (workspace.band.ab)
+    fluid_band_free(workspace.band);
+  if (workspace.spike.ab)
+    fluid_spike_free(workspace.spike);
+  if (workspace.threads.sums)
+    fluid_threads_free(workspace.threads);
+  if (workspace.krylov.V)
+    fluid_krylov_free(workspace.krylov);
+  if (workspace.history.velocity)
+    fluid_predictor_free(workspace.history);
+  if (workspace.waves.A)
+    fluid_explicit_free(workspace.waves);
+  fluid_workspace_clear(workspace, workspace.N, workspace.chunkLength);
+}
@@ -0,0 +1,89 @@
+#ifndef FLUID_WORKSPACE_H_
+#define FLUID_WORKSPACE_H_
+
+#include "fluid_banded.h"
+#include "fluid_explicit.h"
+#include "fluid_krylov.h"
+#include "fluid_options.h"
+#include "fluid_predictor.h"
+#include "fluid_profile.h"
+#include "fluid_spike.h"
+#include "fluid_threads.h"
+
+struct TubeMesh;      // see Common/elastictube_mesh.h
+struct TubePartition; // see Common/elastictube_partition.h
+
+/*
+   Scratch buffers of the fluid solvers. A workspace is allocated once at startup and
+   passed to every call of fluid_nl() / fluidComputeSolution(), such that the Newton
+   iterations of all coupling iterations and time windows run without any allocation.
+   All buffers are aligned to FLUID_ALIGNMENT (see fluid_memory.h).
+
+   Only the members used by the respective solve are allocated, all others are NULL.
+*/
+struct FluidWorkspace {
+  int N;            // number of mesh elements
+  int chunkLength;  // number of local nodes of the distributed solve
+  double* Res;      // residual, 2N+2, or 2*chunkLength for the distributed solve
+  double* jac;      // Jacobian coefficients of the assembly kernel, see fluid_kernel.h
+  double* flux_n;   // theta < 1: weighted fluxes of the previous level, momentum then continuity, 2N+2 or 2*chunkLength
+
+  // factors of the Jacobian, reused by the chord iteration (see FluidOptions::chord). The
+  // distributed solve keeps factorized the same on all ranks, the centralized one on rank 0 only.
+  bool factorized;   // the band (or spike) holds valid factors
+  double factorTime; // time window for which the factors were computed
+
+  // time spent in the phases of the solve, see fluid_profile.h
+  FluidProfile profile;
+  FluidCallStats last; // serial solve: statistics of the last call
+
+  // serial solve on a non-uniform mesh of N elements, not owned by the workspace, NULL for the uniform mesh
+  const TubeMesh* mesh;
+
+  // serial solve, and rank 0 of the centralized parallel solve
+  FluidBand band;   // banded Jacobian
+  FluidThreads threads; // partial sums of the threads, SPIKE partitions of the serial solve, see fluid_threads.h
+
+  // serial solve with a predictor, see FluidOptions::predictor
+  FluidHistory history; // solutions of previous windows and coupling iterations
+
+  // serial solve with the Jacobian-free Newton-Krylov engine
+  FluidKrylov krylov;       // GMRES basis
+  double* step;             // Newton step, 2N+2
+  double* perturbed;        // perturbed state (velocity, pressure) of the finite difference, 2N+2
+  double* resPerturbed;     // residual of the perturbed state, 2N+2
+  double* preconditioner;   // inverse pivot blocks of the block tridiagonal JFNK preconditioner, 4N+4
+
+  // monolithic solve with the explicit engine
+  FluidExplicit waves; // substep buffers
+
+  // distributed parallel solve
+  FluidSpike spike; // local band, spikes and reduced system
+  double* u;        // velocity with one halo cell on each side, chunkLength+2
+  double* p;        // pressure with halo cells
+  double* a;        // crossSectionLength with halo cells
+  double* u_n;      // previous level with halo cells for the fluxes of theta < 1
+  double* p_n;
+  double* a_n;
+  double* packed;    // reduced system contributions of all ranks
+  double* packedRhs; // reduced right hand sides of all ranks, for reused factors
+  double* y;         // interface values of all ranks
+
+  // centralized parallel solve
+  const TubePartition* partition; // nodes of all ranks, not owned by the workspace
+  double* local;                  // 7 arrays of the chunkLength local values, packed for the gather
+  double* gathered;               // rank 0 only: 7 arrays of N+1 values, gathered from all ranks
+};
+
+/* Workspace for the serial solve of N mesh elements with the engine selected in options */
+void fluid_workspace_allocate(FluidWorkspace& workspace, int N, const FluidOptions& options);
+
+/* Workspace for the distributed solve, chunkLength local nodes on each of size ranks, options.threads per rank */
+void fluid_workspace_allocate_distributed(FluidWorkspace& workspace, int N, int chunkLength, int size, const FluidOptions& options);
+
+/* Workspace for the centralized solve of the nodes of partition, only rank 0 allocates the global buffers */
+void fluid_workspace_allocate_centralized(FluidWorkspace& workspace, const TubePartition& partition, int rank, const FluidOptions& options);
+
+void fluid_workspace_free(FluidWorkspace& workspace);
+
+#endif
@@ -1,4 +1,7 @@
 #include "FluidSolver.h"
+#include "../Common/elastictube_partition.h"
+#include "../FluidSolver_Common/fluid_kernel.h"
+#include "../FluidSolver_Common/fluid_options.h"
 #include "precice/SolverInterface.hpp"
 #include <iostream>
 #include <mpi.h>
@@ -10,46 +13,82 @@ int main(int argc, char** argv)
 {
 
   std::cout << "Starting Fluid Solver..." << std::endl;
-  if (argc != 5) {
+  FluidOptions options;
+  if (argc < 5 || !fluid_options_parse(options, argc, argv, 5)) {
     std::cout << std::endl;
-    std::cout << "Fluid: Usage: mpiexec -np <#procs> " << argv[0] << " <configurationFileName> <N> <tau> <kappa>" << std::endl;
+    std::cout << "Fluid: Usage: mpiexec -np <#procs> " << argv[0] << " <configurationFileName> <N> <tau> <kappa> [options]" << std::endl;
     std::cout << std::endl;
     std::cout << "N:     Number of mesh elements, needs to be equal for fluid and structure solver." << std::endl;
     std::cout << "tau:   Dimensionless time step size." << std::endl;
     std::cout << "kappa: Dimensionless structural stiffness." << std::endl;
+    fluid_options_usage();
 
     return -1;
   }
 
-  MPI_Init(&argc, &argv);
+  // The threads of --threads never call MPI, all communication stays on the main thread
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
   int domainSize, gridOffset, rank, size, chunkLength;
   double *grid, tau, kappa; // Declare dataset
 
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
+  TRACE_BEGIN("FLUID", rank);
 
   domainSize = atoi(argv[2]);
   tau = atof(argv[3]);
   kappa = atof(argv[4]);
 
-  if ((domainSize + 1) % size == 0) {
-    chunkLength = (domainSize + 1) / size;
-    gridOffset = rank * chunkLength;
-  } else if (rank < (domainSize + 1) % size) {
-    chunkLength = (domainSize + 1) / size + 1;
-    gridOffset = rank * chunkLength;
-  } else {
-    chunkLength = (domainSize + 1) / size;
-    gridOffset = ((domainSize + 1) % size) * ((domainSize + 1) / size + 1) + (rank - ((domainSize + 1) % size)) * (domainSize + 1) / size;
+  // Nodes of every rank, the structure solver partitions the same mesh independently
+  TubePartition partition;
+  tube_partition_boundary(partition, domainSize + 1, size, options.boundaryWeight);
+  chunkLength = partition.counts[rank];
+  gridOffset = partition.offsets[rank];
+
+  // The distributed solve needs the boundary stencils and the SPIKE coupling blocks within one rank
+  if (options.distributed && tube_partition_min_count(partition) < 4) {
+    if (rank == 0)
+      std::cout << "Fluid: Every rank needs at least 4 nodes, use fewer ranks, another --boundary-weight or --distributed=off." << std::endl;
+    MPI_Finalize();
+    return -1;
+  }
+
+  if (options.engine != FLUID_ENGINE_NEWTON || options.predictor != FLUID_PREDICTOR_NONE || options.couplingForcing > 0.0 ||
+      options.dtTol > 0.0 || !options.mesh.empty() || options.refine > 0) {
+    if (rank == 0)
+      std::cout << "Fluid: --engine, --predictor, --coupling-forcing, --dt-tol, --mesh and --refine are only available in the serial fluid solver." << std::endl;
+    MPI_Finalize();
+    return -1;
+  }
+
+  if (options.precision == FLUID_PRECISION_MIXED && options.distributed) {
+    if (rank == 0)
+      std::cout << "Fluid: --precision=mixed is only available for the band solve of --distributed=off." << std::endl;
+    MPI_Finalize();
+    return -1;
   }
 
-  std::vector<double> pressure(chunkLength);
-  std::vector<double> pressure_n(chunkLength);
-  std::vector<double > crossSectionLength(chunkLength);
-  std::vector<double > crossSectionLength_n(chunkLength);
-  std::vector<double> velocity(chunkLength);
-  std::vector<double> velocity_n(chunkLength);
+  if (options.threads > 1 && !options.distributed) {
+    if (rank == 0)
+      std::cout << "Fluid: --threads is only available for the distributed solve." << std::endl;
+    MPI_Finalize();
+    return -1;
+  }
+
+  if (options.threads > 1 && provided < MPI_THREAD_FUNNELED) {
+    if (rank == 0)
+      std::cout << "Fluid: The MPI library does not support threads, running with --threads=1." << std::endl;
+    options.threads = 1;
+  }
+
+  if (rank == 0)
+    std::cout << "Fluid: Assembly kernel: " << fluid_kernel_isa() << std::endl;
+
+  // velocity, pressure and crossSectionLength of the local nodes at the current and the previous time level
+  TubeState state;
+  tube_state_allocate(state, chunkLength);
   std::vector<int> vertexIDs(chunkLength);
 
   //fluidDataDisplay(pressure, chunkLength);
@@ -66,13 +105,8 @@ int main(int argc, char** argv)
   int dimensions = interface.getDimensions();
   grid = new double[dimensions * chunkLength];
   
+  tube_state_fill(state, 1.0 / kappa, 0.0, 1.0);
   for (int i = 0; i < chunkLength; i++) {
-    pressure[i] = 0.0;
-    pressure_n[i] = 0.0;
-    crossSectionLength[i] = 1.0;
-    crossSectionLength_n[i] = 1.0;
-    velocity[i] = 1.0 / kappa;
-    velocity_n[i] = 1.0 / kappa;
     for (int j = 0; j < dimensions; j++) {
       grid[i * dimensions + j] = j == 0 ? gridOffset + (double)i : 0.0;
     }
@@ -80,58 +114,114 @@ int main(int argc, char** argv)
 
   interface.setMeshVertices(meshID, chunkLength, grid, vertexIDs.data());
 
-  interface.initialize();
+  double dt = interface.initialize();
 
   double t = 0.0;
-  double dt = 0.01;
+  double solveTime = 0.0;
+  int window = 0, iteration = 0;
+
+  // resume after a completed time window, see elastictube_restart.h
+  const char* restartNames[3] = {"velocity", "pressure", "crossSection"};
+  if (options.restart.window >= 0) {
+    std::string path = tube_restart_path(options.restart, "FLUID", options.restart.window);
+    double* restartFields[3] = {state.current.velocity, state.current.pressure, state.current.crossSectionLength};
+    if (!tube_restart_read_partitioned(partition, path.c_str(), "FLUID", 3, restartNames, restartFields, window, t)) {
+      MPI_Finalize();
+      return -1;
+    }
+    tube_state_advance(state);
+    if (rank == 0)
+      std::cout << "Fluid: Resuming after time window " << window << " at t = " << t << std::endl;
+  }
+
+  // solver scratch buffers, reused by all time steps
+  FluidWorkspace workspace;
+  if (options.distributed)
+    fluid_workspace_allocate_distributed(workspace, domainSize, chunkLength, size, options);
+  else
+    fluid_workspace_allocate_centralized(workspace, partition, rank, options);
 
   if (interface.isActionRequired(actionWriteInitialData())) {
-    interface.writeBlockScalarData(pressureID, chunkLength, vertexIDs.data(), pressure.data());
+    interface.writeBlockScalarData(pressureID, chunkLength, vertexIDs.data(), tube_state_iterate(state).pressure);
     interface.markActionFulfilled(actionWriteInitialData());
   }
 
   interface.initializeData();
 
   if (interface.isReadDataAvailable()) {
-    interface.readBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), crossSectionLength.data());
+    interface.readBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), tube_state_iterate(state).crossSectionLength);
   }
 
   while (interface.isCouplingOngoing()) {
+    TRACE_WINDOW(window, iteration);
     int convergenceCounter = 0;
+    // the checkpoint of the window is the previous level of state, which the coupling iterations do not modify
     if (interface.isActionRequired(actionWriteIterationCheckpoint())) {
       interface.markActionFulfilled(actionWriteIterationCheckpoint());
     }
 
      // Call "Solver"
-    fluidComputeSolution(rank, size, domainSize, chunkLength, kappa, tau, 0.0, t+dt,
-                         pressure.data(), pressure_n.data(), pressure.data(),
-                         crossSectionLength.data(), crossSectionLength_n.data(),
-                         velocity.data(), velocity_n.data());
+    double solveStart = MPI_Wtime();
+    {
+      TRACE_SCOPE("fluidComputeSolution");
+      if (options.distributed) {
+        fluidComputeSolution(rank, size, domainSize, chunkLength, kappa, tau, 0.0, t+dt,
+                             state, workspace, options);
+      } else {
+        fluidComputeSolutionCentralized(rank, size, domainSize, chunkLength, kappa, tau, 0.0, t+dt,
+                                        state, workspace, options);
+      }
+    }
+    solveTime += MPI_Wtime() - solveStart;
 
     //fluidDataDisplay(pressure, chunkLength);
     //fluidDataDisplay(crossSectionLength, chunkLength);
 
-    interface.writeBlockScalarData(pressureID, chunkLength, vertexIDs.data(), pressure.data());
-
-    interface.advance(dt);
+    {
+      TRACE_SCOPE("writeBlockScalarData");
+      interface.writeBlockScalarData(pressureID, chunkLength, vertexIDs.data(), state.current.pressure);
+    }
 
-    interface.readBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), crossSectionLength.data());
+    {
+      TRACE_SCOPE("advance");
+      interface.advance(dt);
+    }
 
     if (interface.isActionRequired(actionReadIterationCheckpoint())) { // i.e. not yet converged
       interface.markActionFulfilled(actionReadIterationCheckpoint());
       convergenceCounter++;
+      iteration++;
     } else {
       t += dt;
-      for (int i = 0; i < chunkLength; i++) {
-        pressure_n[i] = pressure[i];
-        velocity_n[i] = velocity[i];
-        crossSectionLength_n[i] = crossSectionLength[i];
-      }
+      window++;
+      iteration = 0;
+      tube_state_advance(state);
+    }
+
+    // After a time advance, the cross section read starts both levels
+    {
+      TRACE_SCOPE("readBlockScalarData");
+      interface.readBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), tube_state_iterate(state).crossSectionLength);
+    }
+
+    if (state.advanced && tube_restart_due(options.restart, window)) {
+      TRACE_SCOPE("restart");
+      std::string path = tube_restart_path(options.restart, "FLUID", window);
+      const double* restartFields[3] = {state.previous.velocity, state.previous.pressure, state.previous.crossSectionLength};
+      tube_restart_write_partitioned(partition, path.c_str(), "FLUID", window, t, 3, restartNames, restartFields);
     }
   }
 
+  double maxSolveTime;
+  MPI_Reduce(&solveTime, &maxSolveTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (rank == 0)
+    std::cout << "Fluid solve time: " << maxSolveTime << " s on " << size << " ranks" << std::endl;
+
+  fluid_workspace_free(workspace);
+  tube_state_free(state);
   delete [] grid;
   interface.finalize();
+  TRACE_END();
   MPI_Finalize();
 
   return 0;
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "../FluidSolver_Common/fluid_options.h"
+#include "../FluidSolver_Common/fluid_state.h"
+#include "../FluidSolver_Common/fluid_workspace.h"
+
 const double PI = 3.14159265359;
 
 void fluidInit(
@@ -7,6 +11,7 @@ void fluidInit(
     int chunkLength,
     double* data);
 
+// Solves one time step on chunkLength local nodes, the levels of state are local, see fluid_state.h
 void fluidComputeSolution(
     int rank,
     int size,
@@ -16,13 +21,23 @@ void fluidComputeSolution(
     double tau,
     double gamma,
     double t,
-    double* pressure,
-    double* pressure_n,
-    double* pressure_old,
-    double* crossSectionLength,
-    double* crossSectionLength_n,
-    double* velocity,
-    double* velocity_n);
+    TubeState& state,
+    FluidWorkspace& workspace,
+    const FluidOptions& options);
+
+// Same interface, but all data is gathered on rank 0, which solves the complete system
+void fluidComputeSolutionCentralized(
+    int rank,
+    int size,
+    int domainSize,
+    int chunkLength,
+    double kappa,
+    double tau,
+    double gamma,
+    double t,
+    TubeState& state,
+    FluidWorkspace& workspace,
+    const FluidOptions& options);
 
 void fluidDataDisplay(
     double* data,
@@ -1,4 +1,7 @@
 #include "FluidSolver.h"
+#include "../FluidSolver_Common/fluid_kernel.h"
+#include "../FluidSolver_Common/fluid_workspace.h"
+#include "../Common/elastictube_partition.h"
 
 #include <iostream>
 #include <cmath>
@@ -7,16 +10,71 @@
 using std::sin;
 using std::sqrt;
 
-extern "C" {
-void dgesv_(
-    int* n,
-    int* nrhs,
-    double* A,
-    int* lda,
-    int* ipiv,
-    double* b,
-    int* ldb,
-    int* info);
+/* Halo exchange in flight, between exchangeHaloBegin() and exchangeHaloEnd() */
+struct HaloExchange {
+  int left, right, count;
+  double sendLeft[3], sendRight[3], recvLeft[3], recvRight[3];
+  MPI_Request requests[4];
+};
+
+/*
+ * Exchanges one halo cell with the left and right neighbour. The arrays hold the
+ * chunkLength local values at positions 1..chunkLength, positions 0 and chunkLength+1
+ * receive the last value of the left and the first value of the right neighbour.
+ * At most 3 fields are exchanged at once. The messages are started by
+ * exchangeHaloBegin(), the local nodes can be computed until exchangeHaloEnd()
+ * waits for them.
+ */
+static void exchangeHaloBegin(HaloExchange& halo, int rank, int size, int chunkLength, int count, double** fields)
+{
+  halo.left = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+  halo.right = rank < size - 1 ? rank + 1 : MPI_PROC_NULL;
+  halo.count = count;
+
+  for (int f = 0; f < count; f++) {
+    halo.sendLeft[f] = fields[f][1];
+    halo.sendRight[f] = fields[f][chunkLength];
+  }
+
+  MPI_Irecv(halo.recvLeft, count, MPI_DOUBLE, halo.left, 0, MPI_COMM_WORLD, &halo.requests[0]);
+  MPI_Irecv(halo.recvRight, count, MPI_DOUBLE, halo.right, 1, MPI_COMM_WORLD, &halo.requests[1]);
+  MPI_Isend(halo.sendRight, count, MPI_DOUBLE, halo.right, 0, MPI_COMM_WORLD, &halo.requests[2]);
+  MPI_Isend(halo.sendLeft, count, MPI_DOUBLE, halo.left, 1, MPI_COMM_WORLD, &halo.requests[3]);
+}
+
+static void exchangeHaloEnd(HaloExchange& halo, int chunkLength, double** fields)
+{
+  TRACE_SCOPE("halo exchange");
+  MPI_Waitall(4, halo.requests, MPI_STATUSES_IGNORE);
+
+  for (int f = 0; f < halo.count; f++) {
+    if (halo.left != MPI_PROC_NULL)
+      fields[f][0] = halo.recvLeft[f];
+    if (halo.right != MPI_PROC_NULL)
+      fields[f][chunkLength + 1] = halo.recvRight[f];
+  }
+}
+
+static void exchangeHalo(int rank, int size, int chunkLength, int count, double** fields)
+{
+  HaloExchange halo;
+  exchangeHaloBegin(halo, rank, size, chunkLength, count, fields);
+  exchangeHaloEnd(halo, chunkLength, fields);
+}
+
+/*
+ * Assembles the nodes first <= j < last on the threads of the rank, the ranges are split
+ * at multiples of 8 nodes after first (see fluid_threads.h)
+ */
+static void assembleNodes(const FluidKernelArgs& kernelArgs, int first, int last, double* Res, double* jac,
+                          int chunkLength, int threads)
+{
+#pragma omp parallel num_threads(threads) if (threads > 1)
+  {
+    int begin, end;
+    fluid_thread_range(first, last, fluid_thread_id(), fluid_thread_count(), begin, end);
+    fluid_kernel_assemble(kernelArgs, begin, end, Res, Res + 1, 2, jac, chunkLength);
+  }
 }
 
 void fluidComputeSolution(
@@ -28,119 +86,388 @@ void fluidComputeSolution(
     double tau,
     double gamma,
     double scaled_t,
-    double* pressure,
-    double* pressure_n,
-    double* pressure_old,
-    double* crossSectionLength,
-    double* crossSectionLength_n,
-    double* velocity,
-    double* velocity_n)
+    TubeState& state,
+    FluidWorkspace& workspace,
+    const FluidOptions& options)
 {
   /*
-   * Step 1: Recieve the complete dataset in process 0.
+   * Every rank assembles residual and Jacobian for the rows of its own nodes, using one
+   * halo cell of velocity, pressure and crossSectionLength from each neighbour. The
+   * distributed band system is solved with the SPIKE algorithm (see fluid_spike.h).
    */
-  if (rank != 0) {
-    int tagStart = 7 * rank;
-    MPI_Send(pressure, chunkLength, MPI_DOUBLE, 0, tagStart + 0, MPI_COMM_WORLD);
-    MPI_Send(pressure_n, chunkLength, MPI_DOUBLE, 0, tagStart + 1, MPI_COMM_WORLD);
-    MPI_Send(pressure_old, chunkLength, MPI_DOUBLE, 0, tagStart + 2, MPI_COMM_WORLD);
-    MPI_Send(crossSectionLength, chunkLength, MPI_DOUBLE, 0, tagStart + 3, MPI_COMM_WORLD);
-    MPI_Send(crossSectionLength_n, chunkLength, MPI_DOUBLE, 0, tagStart + 4, MPI_COMM_WORLD);
-    MPI_Send(velocity, chunkLength, MPI_DOUBLE, 0, tagStart + 5, MPI_COMM_WORLD);
-    MPI_Send(velocity_n, chunkLength, MPI_DOUBLE, 0, tagStart + 6, MPI_COMM_WORLD);
-
-    MPI_Recv(pressure, chunkLength, MPI_DOUBLE, 0, tagStart + 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(pressure_n, chunkLength, MPI_DOUBLE, 0, tagStart + 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(crossSectionLength, chunkLength, MPI_DOUBLE, 0, tagStart + 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(crossSectionLength_n, chunkLength, MPI_DOUBLE, 0, tagStart + 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(velocity, chunkLength, MPI_DOUBLE, 0, tagStart + 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(velocity_n, chunkLength, MPI_DOUBLE, 0, tagStart + 6, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-  } else {
-    double *pressure_NLS, *pressure_n_NLS, *pressure_old_NLS;
-    double *crossSectionLength_NLS, *crossSectionLength_n_NLS;
-    double *velocity_NLS, *velocity_n_NLS;
+  int N = domainSize;
+
+  // Phases of the iteration, see fluid_profile.h
+  FluidProfile& profile = workspace.profile;
+  double start = fluid_clock();
+  double clock = start;
+  int factorizations = 0;
+  int threads = workspace.threads.count;
+
+  bool isFirst = rank == 0;
+  bool isLast = rank == size - 1;
+  int m = 2 * chunkLength;
+
+  // Views of the state, the initial guess is the previous level after a time advance
+  const TubeFields& iterate = tube_state_iterate(state);
+  const double* velocity = iterate.velocity;
+  const double* pressure = iterate.pressure;
+  const double* pressure_old = iterate.pressure;
+  const double* crossSectionLength = iterate.crossSectionLength;
+  const double* velocity_n = state.previous.velocity;
+  const double* pressure_n = state.previous.pressure;
+  const double* crossSectionLength_n = state.previous.crossSectionLength;
+
+  // Local values with one halo cell on each side, node i is stored at position i+1
+  double* u = workspace.u;
+  double* p = workspace.p;
+  double* a = workspace.a;
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+  for (int i = 0; i < chunkLength; i++) {
+    u[i + 1] = velocity[i];
+    p[i + 1] = pressure[i];
+    a[i + 1] = crossSectionLength[i];
+  }
+  double* crossSectionHalo[] = {a};
+  double* stateHalo[] = {u, p};
+  exchangeHalo(rank, size, chunkLength, 1, crossSectionHalo);
+
+  double* Res = workspace.Res;
+  double* jac = workspace.jac;
+  double* packed = workspace.packed;
+  double* packedRhs = workspace.packedRhs;
+  double* y = workspace.y;
+  FluidSpike& spike = workspace.spike;
+  int k = spike.k;
+  auto LHS = [&spike](int row, int col) -> double& { return fluid_spike_entry(spike, row, col); };
+
+  // Stabilization intensity, weighted by theta like the fluxes
+  double theta = options.theta;
+  double alpha = theta * (N * kappa * tau) / (N * tau + 1);
+  double dx = 1.0 / (N * kappa * tau);
+  double ampl = options.ampl;
+  double tmp, tmp2, sums[2], norm, norm_previous = 0.0;
+  int info;
+
+  // Interior nodes of the rank
+  int begin = isFirst ? 1 : 0, end = isLast ? chunkLength - 1 : chunkLength;
+
+  // Theta scheme, the fluxes of the previous level need its halo cells, see fluid_kernel.h
+  double* flux_n = theta < 1.0 ? workspace.flux_n : NULL;
+  if (flux_n) {
+    double* previousHalo[] = {workspace.a_n, workspace.u_n, workspace.p_n};
+    for (int i = 0; i < chunkLength; i++) {
+      workspace.a_n[i + 1] = crossSectionLength_n[i];
+      workspace.u_n[i + 1] = velocity_n[i];
+      workspace.p_n[i + 1] = pressure_n[i];
+    }
+    exchangeHalo(rank, size, chunkLength, 3, previousHalo);
+    fluid_kernel_flux(workspace.a_n + 1, workspace.u_n + 1, workspace.p_n + 1, 1.0 - theta, begin, end,
+                      flux_n, flux_n + chunkLength);
+  }
 
-    int N = domainSize;
+  // Node j of the halo arrays is at position j+1, see fluid_kernel.h
+  FluidKernelArgs kernelArgs = {a + 1, crossSectionLength_n, u + 1, velocity_n, p + 1, pressure_old, alpha, gamma, dx, NULL,
+                                theta, flux_n, flux_n ? flux_n + chunkLength : NULL};
+
+  int whileLoopCounter = 0;
+  while (1) {
+    clock = fluid_clock();
+    HaloExchange halo;
+    exchangeHaloBegin(halo, rank, size, chunkLength, 2, stateHalo);
+
+    // Momentum and continuity of the interior nodes, residual and Jacobian coefficients in one pass.
+    // Only the first and the last local node need the halo, the vector blocks in between are
+    // assembled while it is exchanged.
+    int inner = begin + 8, outer = begin + (end - 1 - begin) / 8 * 8;
+    if (outer > inner)
+      assembleNodes(kernelArgs, inner, outer, Res, jac, chunkLength, threads);
+    exchangeHaloEnd(halo, chunkLength, stateHalo);
+    if (outer > inner) {
+      fluid_kernel_assemble(kernelArgs, begin, inner, Res, Res + 1, 2, jac, chunkLength);
+      fluid_kernel_assemble(kernelArgs, outer, end, Res, Res + 1, 2, jac, chunkLength);
+    } else {
+      assembleNodes(kernelArgs, begin, end, Res, jac, chunkLength, threads);
+    }
 
-    pressure_NLS = new double[N + 1];
-    pressure_n_NLS = new double[N + 1];
-    pressure_old_NLS = new double[N + 1];
-    crossSectionLength_NLS = new double[N + 1];
-    crossSectionLength_n_NLS = new double[N + 1];
-    velocity_NLS = new double[N + 1];
-    velocity_n_NLS = new double[N + 1];
+    // Boundary
+    if (isFirst) {
+      // Velocity
+      tmp = sin(PI * scaled_t);
+      Res[0] = (1.0 / kappa) + (1.0 / (kappa * ampl)) * tmp * tmp - u[1];
 
-    for (int i = 0; i < chunkLength; i++) {
-      pressure_NLS[i] = pressure[i];
-      pressure_n_NLS[i] = pressure_n[i];
-      pressure_old_NLS[i] = pressure_old[i];
-      crossSectionLength_NLS[i] = crossSectionLength[i];
-      crossSectionLength_n_NLS[i] = crossSectionLength_n[i];
-      velocity_NLS[i] = velocity[i];
-      velocity_n_NLS[i] = velocity_n[i];
+      // Pressure Inlet is lineary interpolated
+      Res[1] = -p[1] + 2 * p[2] - p[3];
     }
+    if (isLast) {
+      int j = chunkLength - 1, e = chunkLength;
 
-    for (int i = 1; i < size; i++) {
-      int tagStart = 7 * i;
-      int chunkLength_temp;
-      int gridOffset;
-
-      if ((N + 1) % size == 0) {
-        chunkLength_temp = (N + 1) / size;
-        gridOffset = i * chunkLength_temp;
-      } else if (i < (N + 1) % size) {
-        chunkLength_temp = (N + 1) / size + 1;
-        gridOffset = i * chunkLength_temp;
-      } else {
-        chunkLength_temp = (N + 1) / size;
-        gridOffset = ((N + 1) % size) * ((N + 1) / size + 1) + (i - ((N + 1) % size)) * (N + 1) / size;
+      // Velocity Outlet is lineary interpolated
+      Res[2 * j] = -u[e] + 2 * u[e - 1] - u[e - 2];
+
+      // Pressure Outlet is "non-reflecting"
+      tmp2 = sqrt(1 - pressure_n[j] / 2) - (u[e] - velocity_n[j]) / 4;
+      Res[2 * j + 1] = -p[e] + 2 * (1 - tmp2 * tmp2);
+    }
+    fluid_profile_lap(profile.residual, clock, "residual");
+
+    // Stopping Criteria
+    whileLoopCounter += 1; // Iteration Count
+
+    // Partial sums of the threads, added in a fixed order
+    double* threadSums = workspace.threads.sums;
+    int teams = 1;
+#pragma omp parallel num_threads(threads) if (threads > 1)
+    {
+      int thread = fluid_thread_id(), count = fluid_thread_count();
+      int first, last;
+      double sumRes = 0.0, sumState = 0.0;
+      fluid_thread_range(0, m, thread, count, first, last);
+      for (int i = first; i < last; i++) {
+        sumRes += Res[i] * Res[i];
       }
+      fluid_thread_range(1, chunkLength + 1, thread, count, first, last);
+      for (int i = first; i < last; i++) {
+        sumState += (p[i] * p[i]) + (u[i] * u[i]);
+      }
+      threadSums[2 * thread] = sumRes;
+      threadSums[2 * thread + 1] = sumState;
+      if (thread == 0)
+        teams = count;
+    }
+    double localSums[2] = {threadSums[0], threadSums[1]};
+    for (int t = 1; t < teams; t++) {
+      localSums[0] += threadSums[2 * t];
+      localSums[1] += threadSums[2 * t + 1];
+    }
+    {
+      TRACE_SCOPE("MPI_Allreduce");
+      MPI_Allreduce(localSums, sums, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+    norm = sqrt(sums[0]) / sqrt(sums[1]);
 
-      MPI_Recv(pressure_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      MPI_Recv(pressure_n_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      MPI_Recv(pressure_old_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      MPI_Recv(crossSectionLength_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      MPI_Recv(crossSectionLength_n_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      MPI_Recv(velocity_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      MPI_Recv(velocity_n_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 6, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    bool converged = norm < options.newtonRtol && whileLoopCounter > 1;
+    if (converged || whileLoopCounter > 50) {
+      if (rank == 0 && options.log)
+        std::cout << "Nonlinear Solver break, Its: " << whileLoopCounter << ", norm: " << norm << std::endl;
+      if (!converged) {
+        if (rank == 0)
+          std::cout << "Nonlinear Solver not converged!, Its: " << whileLoopCounter << ", norm: " << norm << std::endl;
+        profile.unconverged++;
+      }
+      break;
     }
 
-    // LAPACK Variables here
-    double *Res, **LHS, *A, alpha, dx, tmp, tmp2, temp_sum, norm_1, norm_2, norm = 1.0;
-    int *ipiv, nlhs = 2 * N + 2, nrhs = 1, info, ampl;
+    // Jacobian, reassembled and factorized unless the chord iteration reuses the factors. Every
+    // rank has to take the same branch: factorized is reduced over the ranks after the solve,
+    // the norm is global and factorTime the same scaled_t.
+    bool refactor = !options.chord || !workspace.factorized || workspace.factorTime != scaled_t ||
+                    (whileLoopCounter > 1 && norm > options.chordRate * norm_previous);
+    norm_previous = norm;
+    clock = fluid_clock();
+
+    if (refactor) {
+      // Local rows 2j (velocity) and 2j+1 (pressure), columns relative to the first local node.
+      // The band is written column by column, the coupling to the neighbours goes to the spikes.
+#pragma omp parallel num_threads(threads) if (threads > 1)
+      {
+        int first, last;
+        fluid_thread_range(0, chunkLength, fluid_thread_id(), fluid_thread_count(), first, last);
+        fluid_kernel_band_range(spike.ab, spike.ldab, jac, chunkLength, first, last, begin, end, alpha, gamma, dx);
+      }
+      fluid_spike_zero_coupling(spike);
+      if (!isFirst)
+        fluid_kernel_scatter(LHS, jac, chunkLength, 0, 1, alpha, gamma, dx);
+      if (!isLast)
+        fluid_kernel_scatter(LHS, jac, chunkLength, chunkLength - 1, chunkLength, alpha, gamma, dx);
+
+      // Boundary
+      if (isFirst) {
+        // Velocity Inlet is prescribed
+        LHS(0, 0) = 1;
+        // Pressure Inlet is lineary interpolated
+        LHS(1, 1) = 1;
+        LHS(1, 3) = -2;
+        LHS(1, 5) = 1;
+      }
+      if (isLast) {
+        int U = m - 2, P = m - 1, e = chunkLength;
+        // Velocity Outlet is lineary interpolated
+        LHS(U, U) = 1;
+        LHS(U, U - 2) = -2;
+        LHS(U, U - 4) = 1;
+        // Pressure Outlet is Non-Reflecting
+        LHS(P, P) = 1;
+        LHS(P, U) = -(sqrt(1 - pressure_n[chunkLength - 1] / 2.0) - (u[e] - velocity_n[chunkLength - 1]) / 4.0);
+      }
+
+      fluid_profile_lap(profile.jacobian, clock, "jacobian");
+
+      // Solve the distributed band system: local factorization, reduced system, recovery
+      info = fluid_spike_factor(spike, !isFirst, !isLast, threads);
+      fluid_profile_lap(profile.factor, clock, "spike factor");
+      if (info == 0)
+        info = fluid_spike_solve_local(spike, Res);
+      fluid_profile_lap(profile.solve, clock, "spike local solve");
+      fluid_spike_pack(spike, packed + rank * fluid_spike_pack_size(k));
+      {
+        TRACE_SCOPE("MPI_Allgather");
+        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                      packed, fluid_spike_pack_size(k), MPI_DOUBLE, MPI_COMM_WORLD);
+      }
+      if (info == 0)
+        info = fluid_spike_reduced_factor(spike, packed);
+      fluid_profile_lap(profile.factor, clock, "spike reduced factor");
+      if (info == 0)
+        info = fluid_spike_reduced_substitute(spike, packed + 4 * k * k, fluid_spike_pack_size(k), y);
+      workspace.factorTime = scaled_t;
+      factorizations++;
+    } else {
+      // Reused factors, only the 2k interface values of the local solution are exchanged
+      info = fluid_spike_solve_local(spike, Res);
+      fluid_spike_pack_rhs(spike, packedRhs + rank * 2 * k);
+      {
+        TRACE_SCOPE("MPI_Allgather");
+        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                      packedRhs, 2 * k, MPI_DOUBLE, MPI_COMM_WORLD);
+      }
+      if (info == 0)
+        info = fluid_spike_reduced_substitute(spike, packedRhs, 2 * k, y);
+    }
+
+    // A failure on any rank fails the step on all of them: the refactor test above has to
+    // give the same answer on every rank, or the ranks call different MPI_Allgather
+    int failed = info != 0, anyFailed = 0;
+    {
+      TRACE_SCOPE("MPI_Allreduce");
+      MPI_Allreduce(&failed, &anyFailed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    }
+    workspace.factorized = !anyFailed;
+    if (info != 0) {
+      std::cout << "Linear Solver not converged!, Rank: " << rank << ", Info: " << info << std::endl;
+    }
+    if (anyFailed) {
+      fluid_profile_lap(profile.solve, clock, "spike solve");
+      continue; // no update, all ranks refactorize in the next iteration
+    }
+
+    fluid_spike_recover(spike, isLast ? NULL : y + 2 * k * (rank + 1), isFirst ? NULL : y + 2 * k * rank - k);
+    fluid_profile_lap(profile.solve, clock, "spike solve");
 
-    Res = new double[2 * N + 2];
-    LHS = new double*[2 * N + 2];
-    for (int i = 0; i < 2 * N + 2; i++) {
-      LHS[i] = new double[2 * N + 2];
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+    for (int j = 0; j < chunkLength; j++) {
+      u[j + 1] = u[j + 1] + spike.g[2 * j];
+      p[j + 1] = p[j + 1] + spike.g[2 * j + 1];
     }
-    A = new double[(2 * N + 2) * (2 * N + 2)];
-    ipiv = new int[2 * N + 2];
+  } // End of while loop
 
-    // Stabilization intensity
-    alpha = (N * kappa * tau) / (N * tau + 1);
+  for (int i = 0; i < chunkLength; i++) {
+    state.current.velocity[i] = u[i + 1];
+    state.current.pressure[i] = p[i + 1];
+  }
+  if (state.advanced)
+    for (int i = 0; i < chunkLength; i++)
+      state.current.crossSectionLength[i] = a[i + 1];
+  state.advanced = false;
+
+  profile.total += fluid_clock() - start;
+  profile.calls++;
+  profile.iterations += whileLoopCounter;
+  TRACE_COUNTER("newton iterations", whileLoopCounter);
+  profile.factorizations += factorizations;
+}
+
+void fluidComputeSolutionCentralized(
+    int rank,
+    int size,
+    int domainSize,
+    int chunkLength,
+    double kappa,
+    double tau,
+    double gamma,
+    double scaled_t,
+    TubeState& state,
+    FluidWorkspace& workspace,
+    const FluidOptions& options)
+{
+  /*
+   * Gathers the complete dataset in process 0, which solves the whole system serially
+   * and scatters the result back.
+   *
+   * Step 1: Gather the complete dataset in process 0, all fields with one collective.
+   */
+  // Phases of the iteration on rank 0, see fluid_profile.h
+  FluidProfile& profile = workspace.profile;
+  double start = fluid_clock();
+
+  const TubePartition& partition = *workspace.partition;
+  int N = domainSize;
+
+  // Local fields in the order of the gathered arrays, the initial guess is the previous level after a time advance.
+  // The fields that the solve updates come first, only they are scattered back.
+  const TubeFields& iterate = tube_state_iterate(state);
+  const int fields = 7, updatedFields = 2;
+  double* local = workspace.local;
+  const double* localFields[fields] = {iterate.pressure, iterate.velocity, state.previous.pressure, iterate.pressure,
+                                       iterate.crossSectionLength, state.previous.crossSectionLength, state.previous.velocity};
+  for (int f = 0; f < fields; f++) {
+    for (int i = 0; i < chunkLength; i++)
+      local[f * chunkLength + i] = localFields[f][i];
+  }
+  {
+    TRACE_SCOPE("gather");
+    tube_partition_gather(partition, fields, local, workspace.gathered, 0);
+  }
+
+  if (rank == 0) {
+    double *pressure_NLS, *pressure_n_NLS, *pressure_old_NLS;
+    double *crossSectionLength_NLS, *crossSectionLength_n_NLS;
+    double *velocity_NLS, *velocity_n_NLS;
+
+    pressure_NLS = workspace.gathered;
+    velocity_NLS = pressure_NLS + (N + 1);
+    pressure_n_NLS = velocity_NLS + (N + 1);
+    pressure_old_NLS = pressure_n_NLS + (N + 1);
+    crossSectionLength_NLS = pressure_old_NLS + (N + 1);
+    crossSectionLength_n_NLS = crossSectionLength_NLS + (N + 1);
+    velocity_n_NLS = crossSectionLength_n_NLS + (N + 1);
+
+    // LAPACK Variables here
+    double *Res, alpha, dx, tmp, tmp2, temp_sum, norm_1, norm_2, norm = 1.0, norm_previous = 0.0;
+    int info;
+    double ampl;
+
+    Res = workspace.Res;
+    double* jac = workspace.jac;
+
+    // Banded Jacobian, see fluid_banded.h
+    FluidBand& band = workspace.band;
+    auto LHS = [&band](int row, int col) -> double& { return fluid_band_entry(band, row, col); };
+
+    // Stabilization intensity, weighted by theta like the fluxes
+    double theta = options.theta;
+    alpha = theta * (N * kappa * tau) / (N * tau + 1);
     dx = 1.0 / (N * kappa * tau);
-    ampl = 100;
+    ampl = options.ampl;
+
+    // Theta scheme, the fluxes of the previous level are the same in all iterations, see fluid_kernel.h
+    double* flux_n = theta < 1.0 ? workspace.flux_n : NULL;
+    if (flux_n)
+      fluid_kernel_flux(crossSectionLength_n_NLS, velocity_n_NLS, pressure_n_NLS, 1.0 - theta, 1, N, flux_n, flux_n + N + 1);
+
+    FluidKernelArgs kernelArgs = {crossSectionLength_NLS, crossSectionLength_n_NLS, velocity_NLS, velocity_n_NLS,
+                                  pressure_NLS, pressure_old_NLS, alpha, gamma, dx, NULL,
+                                  theta, flux_n, flux_n ? flux_n + N + 1 : NULL};
+
+    int factorizations = 0;
+    double clock;
 
     int whileLoopCounter = 0;
     while (1) { // Add stopping criterion
-      for (int i = 0; i < 2 * N + 2; i++) {
-        Res[i] = 0.0;
-      }
+      clock = fluid_clock();
 
-      for (int i = 0; i < N; i++) {
-        Res[i] = velocity_n_NLS[i] * crossSectionLength_NLS[i] * dx;
-        Res[i] = Res[i] - 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i] * velocity_NLS[i + 1] - 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i] * velocity_NLS[i + 1];
-        Res[i] = Res[i] - crossSectionLength_NLS[i] * dx * velocity_NLS[i] - 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i] * velocity_NLS[i] - 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i] * velocity_NLS[i] + 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i - 1] * velocity_NLS[i] + 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i - 1] * velocity_NLS[i];
-        Res[i] = Res[i] + 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i - 1] * velocity_NLS[i - 1] + 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i - 1] * velocity_NLS[i - 1];
-        Res[i] = Res[i] + 0.25 * crossSectionLength_NLS[i - 1] * pressure_NLS[i - 1] + 0.25 * crossSectionLength_NLS[i] * pressure_NLS[i - 1] - 0.25 * crossSectionLength_NLS[i - 1] * pressure_NLS[i] + 0.25 * crossSectionLength_NLS[i + 1] * pressure_NLS[i] - 0.25 * crossSectionLength_NLS[i] * pressure_NLS[i + 1] - 0.25 * crossSectionLength_NLS[i + 1] * pressure_NLS[i + 1];
-
-        /* Continuity */
-        Res[i + N + 1] = -(crossSectionLength_NLS[i] - crossSectionLength_n_NLS[i]) * dx + pressure_old_NLS[i] * gamma * dx;
-        Res[i + N + 1] = Res[i + N + 1] + 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i - 1] + 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i - 1] + 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i] - 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i] - 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i + 1] - 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i + 1];
-        Res[i + N + 1] = Res[i + N + 1] + alpha * pressure_NLS[i - 1] - 2 * alpha * pressure_NLS[i] - gamma * pressure_NLS[i] * dx + alpha * pressure_NLS[i + 1];
-      }
+      // Momentum and continuity of the interior nodes, residual and Jacobian coefficients in one pass
+      fluid_kernel_assemble(kernelArgs, 1, N, Res, Res + N + 1, 1, jac, N + 1);
 
       // Boundary
 
@@ -157,6 +484,7 @@ void fluidComputeSolution(
       // Pressure Outlet is "non-reflecting"
       tmp2 = sqrt(1 - pressure_n_NLS[N] / 2) - (velocity_NLS[N] - velocity_n_NLS[N]) / 4;
       Res[2 * N + 1] = -pressure_NLS[N] + 2 * (1 - tmp2 * tmp2);
+      fluid_profile_lap(profile.residual, clock, "residual");
 
       // Stopping Criteria
       whileLoopCounter += 1; // Iteration Count
@@ -175,71 +503,56 @@ void fluidComputeSolution(
 
       norm = norm_1 / norm_2; // Norm
 
-      if ((norm < 1e-15 && whileLoopCounter > 1) || whileLoopCounter > 50) {
-        std::cout << "Nonlinear Solver break, Its: " << whileLoopCounter << ", norm: " << norm << std::endl;
+      bool converged = norm < options.newtonRtol && whileLoopCounter > 1;
+      if (converged || whileLoopCounter > 50) {
+        if (options.log)
+          std::cout << "Nonlinear Solver break, Its: " << whileLoopCounter << ", norm: " << norm << std::endl;
+        if (!converged) {
+          std::cout << "Nonlinear Solver not converged!, Its: " << whileLoopCounter << ", norm: " << norm << std::endl;
+          profile.unconverged++;
+        }
         break;
       }
 
-      // Initilizing the the LHS i.e. Left Hand Side
-      for (int i = 0; i <= (2 * N + 1); i++) {
-        for (int j = 0; j <= (2 * N + 1); j++) {
-          LHS[i][j] = 0.0;
-        }
+      // Jacobian, reassembled and factorized unless the chord iteration reuses the factors. Only
+      // rank 0 solves, factorized and factorTime are neither set nor read on the other ranks.
+      bool refactor = !options.chord || !workspace.factorized || workspace.factorTime != scaled_t ||
+                      (whileLoopCounter > 1 && norm > options.chordRate * norm_previous);
+      norm_previous = norm;
+      clock = fluid_clock();
+
+      info = 0;
+      if (refactor) {
+        // Interior nodes, this also initializes all other entries of the band
+        fluid_kernel_band(band.ab, band.ldab, jac, N + 1, N + 1, 1, N, alpha, gamma, dx);
+
+        // Boundary
+        // Velocity Inlet is prescribed
+        LHS(0, 0) = 1;
+        // Pressure Inlet is lineary interpolated
+        LHS(N + 1, N + 1) = 1;
+        LHS(N + 1, N + 2) = -2;
+        LHS(N + 1, N + 3) = 1;
+        // Velocity Outlet is lineary interpolated
+        LHS(N, N) = 1;
+        LHS(N, N - 1) = -2;
+        LHS(N, N - 2) = 1;
+        // Pressure Outlet is Non-Reflecting
+        LHS(2 * N + 1, 2 * N + 1) = 1;
+        LHS(2 * N + 1, N) = -(sqrt(1 - pressure_n_NLS[N] / 2.0) - (velocity_NLS[N] - velocity_n_NLS[N]) / 4.0);
+        fluid_profile_lap(profile.jacobian, clock, "jacobian");
+
+        info = fluid_band_factor(band);
+        workspace.factorized = info == 0;
+        workspace.factorTime = scaled_t;
+        factorizations++;
+        fluid_profile_lap(profile.factor, clock, "dgbtrf");
       }
 
-      for (int i = 1; i < N; i++) {
-        // Momentum, Velocity
-        LHS[i][i - 1] = LHS[i][i - 1] - 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i - 1] * 2 - 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i - 1] * 2 - 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i] - 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i];
-        LHS[i][i] = LHS[i][i] + 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i + 1] + 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i + 1] + crossSectionLength_NLS[i] * dx + 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i] * 2 + 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i] * 2 - 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i - 1] - 0.25 * crossSectionLength_NLS[i - 1] * velocity_NLS[i - 1];
-        LHS[i][i + 1] = LHS[i][i + 1] + 0.25 * crossSectionLength_NLS[i + 1] * velocity_NLS[i] + 0.25 * crossSectionLength_NLS[i] * velocity_NLS[i];
-
-        // Momentum, Pressure
-        LHS[i][N + 1 + i - 1] = LHS[i][N + 1 + i - 1] - 0.25 * crossSectionLength_NLS[i - 1] - 0.25 * crossSectionLength_NLS[i];
-        LHS[i][N + 1 + i] = LHS[i][N + 1 + i] + 0.25 * crossSectionLength_NLS[i - 1] - 0.25 * crossSectionLength_NLS[i + 1];
-        LHS[i][N + 1 + i + 1] = LHS[i][N + 1 + i + 1] + 0.25 * crossSectionLength_NLS[i] + 0.25 * crossSectionLength_NLS[i + 1];
-
-        // Continuity, Velocity
-        LHS[i + N + 1][i - 1] = LHS[i + N + 1][i - 1] - 0.25 * crossSectionLength_NLS[i - 1] - 0.25 * crossSectionLength_NLS[i];
-        LHS[i + N + 1][i] = LHS[i + N + 1][i] - 0.25 * crossSectionLength_NLS[i - 1] + 0.25 * crossSectionLength_NLS[i + 1];
-        LHS[i + N + 1][i + 1] = LHS[i + N + 1][i + 1] + 0.25 * crossSectionLength_NLS[i] + 0.25 * crossSectionLength_NLS[i + 1];
-
-        // Continuity, Pressure
-        LHS[i + N + 1][N + 1 + i - 1] = LHS[i + N + 1][N + 1 + i - 1] - alpha;
-        LHS[i + N + 1][N + 1 + i] = LHS[i + N + 1][N + 1 + i] + 2 * alpha + gamma * dx;
-        LHS[i + N + 1][N + 1 + i + 1] = LHS[i + N + 1][N + 1 + i + 1] - alpha;
-      }
-
-      // Boundary
-      // Velocity Inlet is prescribed
-      LHS[0][0] = 1;
-      // Pressure Inlet is lineary interpolated
-      LHS[N + 1][N + 1] = 1;
-      LHS[N + 1][N + 2] = -2;
-      LHS[N + 1][N + 3] = 1;
-      // Velocity Outlet is lineary interpolated
-      LHS[N][N] = 1;
-      LHS[N][N - 1] = -2;
-      LHS[N][N - 2] = 1;
-      // Pressure Outlet is Non-Reflecting
-      LHS[2 * N + 1][2 * N + 1] = 1;
-      LHS[2 * N + 1][N] = -(sqrt(1 - pressure_n_NLS[N] / 2.0) - (velocity_NLS[N] - velocity_n_NLS[N]) / 4.0);
-
-      // Solve Linear System using LAPACK
-
-      /* LAPACK requires a 1D array
-         i.e. Linearizing 2D
-      */
-
-      int counter = 0;
-      for (int i = 0; i <= (2 * N + 1); i++) {
-        for (int j = 0; j <= (2 * N + 1); j++) {
-          A[counter] = LHS[j][i];
-          counter++;
-        }
-      }
-
-      /* LAPACK Function call to solve the linear system */
-      dgesv_(&nlhs, &nrhs, A, &nlhs, ipiv, Res, &nlhs, &info);
+      // Solve banded Linear System using LAPACK
+      if (info == 0)
+        info = fluid_band_substitute(band, Res);
+      fluid_profile_lap(profile.solve, clock, "dgbtrs");
 
       if (info != 0) {
         std::cout << "Linear Solver not converged!, Info: " << info << std::endl;
@@ -251,49 +564,26 @@ void fluidComputeSolution(
       }
     } // End of while loop
 
-    for (int i = 0; i < chunkLength; i++) {
-      pressure[i] = pressure_NLS[i];
-      pressure_n[i] = pressure_n_NLS[i];
-      //p_old[i] = p_old_NLS[i];
-      crossSectionLength[i] = crossSectionLength_NLS[i];
-      crossSectionLength_n[i] = crossSectionLength_n_NLS[i];
-      velocity[i] = velocity_NLS[i];
-      velocity_n[i] = velocity_n_NLS[i];
-    }
-
-    for (int i = 1; i < size; i++) {
-      int tagStart = 7 * i;
-      int chunkLength_temp;
-      int gridOffset;
-
-      if ((N + 1) % size == 0) {
-        chunkLength_temp = (N + 1) / size;
-        gridOffset = i * chunkLength_temp;
-      } else if (i < (N + 1) % size) {
-        chunkLength_temp = (N + 1) / size + 1;
-        gridOffset = i * chunkLength_temp;
-      } else {
-        chunkLength_temp = (N + 1) / size;
-        gridOffset = ((N + 1) % size) * ((N + 1) / size + 1) + (i - ((N + 1) % size)) * (N + 1) / size;
-      }
-      MPI_Send(pressure_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 0, MPI_COMM_WORLD);
-      MPI_Send(pressure_n_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 1, MPI_COMM_WORLD);
-      MPI_Send(crossSectionLength_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 3, MPI_COMM_WORLD);
-      MPI_Send(crossSectionLength_n_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 4, MPI_COMM_WORLD);
-      MPI_Send(velocity_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 5, MPI_COMM_WORLD);
-      MPI_Send(velocity_n_NLS + gridOffset, chunkLength_temp, MPI_DOUBLE, i, tagStart + 6, MPI_COMM_WORLD);
-    }
+    profile.iterations += whileLoopCounter;
+    profile.factorizations += factorizations;
+    TRACE_COUNTER("newton iterations", whileLoopCounter);
+  }
 
-    delete [] pressure_NLS;
-    delete [] pressure_n_NLS;
-    delete [] pressure_old_NLS;
-    delete [] crossSectionLength_NLS;
-    delete [] crossSectionLength_n_NLS;
-    delete [] velocity_NLS;
-    delete [] velocity_n_NLS;
-    delete [] Res;
-    delete [] LHS;
-    delete [] A;
-    delete [] ipiv;
+  // Step 2: Scatter the solution, the other ranks wait here for the solve on rank 0
+  {
+    TRACE_SCOPE("scatter");
+    tube_partition_scatter(partition, updatedFields, workspace.gathered, local, 0);
+  }
+  // Velocity and pressure of the current level, the cross section is not changed by the solve
+  for (int i = 0; i < chunkLength; i++) {
+    state.current.pressure[i] = local[i];
+    state.current.velocity[i] = local[chunkLength + i];
   }
+  if (state.advanced)
+    for (int i = 0; i < chunkLength; i++)
+      state.current.crossSectionLength[i] = iterate.crossSectionLength[i];
+  state.advanced = false;
+
+  profile.total += fluid_clock() - start;
+  profile.calls++;
 }
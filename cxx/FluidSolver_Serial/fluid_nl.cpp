@@ -1,284 +1,943 @@
 #include "fluid_nl.h"
+#include "../Common/elastictube_mesh.h"
+#include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sstream>
-#include <string>
 
-#include <fstream>
-#include <iomanip>
-
-/* 
-   Function for solving the linear system 
-   LAPACK is used DGESV computes the solution to a real system of linear equations
-   A * x = b,
-   where A is an N-by-N matrix and x and b are N-by-NRHS matrices.
+/*
+   Assembles the Jacobian of the residual of fluid_nl into band, the coefficients of the
+   interior nodes have been computed by fluid_residual (see fluid_kernel.h). x holds the
+   node positions of a non-uniform mesh, NULL for the uniform mesh.
 */
-extern "C" {
-void dgesv_(
-    int* n,
-    int* nrhs,
-    double* A,
-    int* lda,
-    int* ipiv,
-    double* b,
-    int* ldb,
-    int* info);
-}
-
-/* Function for fluid_nl i.e. non-linear */
-int fluid_nl(
-    double* crossSectionLength,
-    double* crossSectionLength_n,
+static void fluid_jacobian(
+    FluidBand& band,
+    const double* jac,
     double* velocity,
     double* velocity_n,
-    double* pressure,
     double* pressure_n,
+    int N,
+    const double* x,
+    double alpha,
+    int threads)
+{
+  auto LHS = [&band](int row, int col) -> double& { return fluid_band_entry(band, row, col); };
+  double inlet = x ? (x[1] - x[0]) / (x[2] - x[1]) : 1.0;
+  double outlet = x ? (x[N] - x[N - 1]) / (x[N - 1] - x[N - 2]) : 1.0;
+
+  /* Interior nodes, this also initializes all other entries of the band, see fluid_threads.h */
+#pragma omp parallel num_threads(threads) if (threads > 1)
+  {
+    int first, last;
+    fluid_thread_range(0, N + 1, fluid_thread_id(), fluid_thread_count(), first, last);
+    fluid_kernel_band_range(band.ab, band.ldab, jac, N + 1, first, last, 1, N, alpha, 0.0, 0.0);
+  }
+
+  /* Boundary */
+
+  // Velocity Inlet is prescribed
+  LHS(0, 0) = 1;
+  // Pressure Inlet is lineary interpolated
+  LHS(N + 1, N + 1) = 1;
+  LHS(N + 1, N + 2) = -(1 + inlet);
+  LHS(N + 1, N + 3) = inlet;
+  // Velocity Outlet is lineary interpolated
+  LHS(N, N) = 1;
+  LHS(N, N - 1) = -(1 + outlet);
+  LHS(N, N - 2) = outlet;
+  // Pressure Outlet is Non-Reflecting
+  LHS(2 * N + 1, 2 * N + 1) = 1;
+  LHS(2 * N + 1, N) = -(sqrt(1 - pressure_n[N] / 2) - (velocity[N] - velocity_n[N]) / 4);
+}
+
+/* Prescribed velocity at the inlet at time t */
+static double fluid_inlet_velocity(double t, double kappa, double ampl)
+{
+  double tmp = sin(PI * t);
+  return (1.0 / kappa) + (1.0 / (kappa * ampl)) * tmp * tmp;
+}
+
+/*
+   Residual of the discretized momentum and continuity equations, Res = 0 is solved by
+   fluid_nl. The interior nodes are assembled by the fused kernel, which also stores the
+   Jacobian coefficients in jac unless jac is NULL, split over threads (see fluid_threads.h).
+   On a non-uniform mesh, x and width are the node positions and control volumes (see
+   Common/elastictube_mesh.h), the boundary values are extrapolated with the spacing of the
+   first and the last two elements. flux_n are the weighted fluxes of the previous level of
+   the theta scheme, NULL for implicit Euler.
+*/
+static void fluid_residual(
+    double* Res,
+    double* jac,
+    const double* crossSectionLength,
+    const double* crossSectionLength_n,
+    const double* velocity,
+    const double* velocity_n,
+    const double* pressure,
+    const double* pressure_n,
+    double t,
+    int N,
+    double kappa,
+    double ampl,
+    double alpha,
+    double dx,
+    const double* x,
+    const double* width,
+    double theta,
+    const double* flux_n,
+    int threads)
+{
+  double tmp2;
+  double inlet = x ? (x[1] - x[0]) / (x[2] - x[1]) : 1.0;
+  double outlet = x ? (x[N] - x[N - 1]) / (x[N - 1] - x[N - 2]) : 1.0;
+
+  /* Momentum and Continuity, the serial solver has no pressure stabilization (gamma = 0) */
+  FluidKernelArgs args = {crossSectionLength, crossSectionLength_n, velocity, velocity_n, pressure, pressure, alpha, 0.0, dx, width,
+                          theta, flux_n, flux_n ? flux_n + N + 1 : NULL};
+#pragma omp parallel num_threads(threads) if (threads > 1)
+  {
+    int first, last;
+    fluid_thread_range(1, N, fluid_thread_id(), fluid_thread_count(), first, last);
+    fluid_kernel_assemble(args, first, last, Res, Res + N + 1, 1, jac, N + 1);
+  }
+
+  /* Boundary */
+
+  /* Velocity Inlet is prescribed */
+  Res[0] = fluid_inlet_velocity(t, kappa, ampl) - velocity[0];
+
+  /* Pressure Inlet is lineary interpolated */
+  Res[N + 1] = -pressure[0] + (1 + inlet) * pressure[1] - inlet * pressure[2];
+
+  /* Velocity Outlet is lineary interpolated */
+  Res[N] = -velocity[N] + (1 + outlet) * velocity[N - 1] - outlet * velocity[N - 2];
+
+  /* Pressure Outlet is "non-reflecting" */
+  tmp2 = sqrt(1 - pressure_n[N] / 2) - (velocity[N] - velocity_n[N]) / 4;
+  Res[2 * N + 1] = -pressure[N] + 2 * (1 - tmp2 * tmp2);
+}
+
+/* State of the Jacobian-free Newton-Krylov engine, passed to the GMRES callbacks */
+struct FluidJFNK {
+  FluidWorkspace* workspace;
+  double* crossSectionLength;
+  double* crossSectionLength_n;
+  double* velocity;
+  double* velocity_n;
+  double* pressure;
+  double* pressure_n;
+  double t, kappa, ampl, alpha, dx;
+  double normState; // norm of (velocity, pressure), scales the finite difference increment
+  int N;
+  int threads;
+  const double* x;     // node positions and control volumes of a non-uniform mesh, NULL for the uniform mesh
+  const double* width;
+  double theta;        // theta scheme, see fluid_kernel.h
+  const double* flux_n;
+};
+
+/*
+   Jacobian-vector product by a forward difference of the residual. As for the assembled
+   LHS, the Newton matrix is the negative Jacobian, LHS * v = -(Res(x + eps v) - Res(x)) / eps.
+*/
+static void fluid_jfnk_apply(void* context, const double* v, double* y)
+{
+  FluidJFNK& jfnk = *(FluidJFNK*)context;
+  FluidWorkspace& workspace = *jfnk.workspace;
+  int i, N = jfnk.N;
+  double* perturbed = workspace.perturbed;
+
+  double normV = 0.0;
+  for (i = 0; i < 2 * N + 2; i++)
+    normV += v[i] * v[i];
+  normV = sqrt(normV);
+  if (normV == 0.0) {
+    for (i = 0; i < 2 * N + 2; i++)
+      y[i] = 0.0;
+    return;
+  }
+  double eps = sqrt(DBL_EPSILON) * (1.0 + jfnk.normState) / normV;
+
+  for (i = 0; i <= N; i++) {
+    perturbed[i] = jfnk.velocity[i] + eps * v[i];
+    perturbed[i + N + 1] = jfnk.pressure[i] + eps * v[i + N + 1];
+  }
+  fluid_residual(workspace.resPerturbed, NULL, jfnk.crossSectionLength, jfnk.crossSectionLength_n, perturbed, jfnk.velocity_n,
+                 perturbed + N + 1, jfnk.pressure_n, jfnk.t, N, jfnk.kappa, jfnk.ampl, jfnk.alpha, jfnk.dx,
+                 jfnk.x, jfnk.width, jfnk.theta, jfnk.flux_n, jfnk.threads);
+
+  for (i = 0; i < 2 * N + 2; i++)
+    y[i] = -(workspace.resPerturbed[i] - workspace.Res[i]) / eps;
+}
+
+/*
+   Coefficients of the Newton matrix between node i and node j = i-1, i, i+1 as a 2x2 block
+   {momentum/velocity, momentum/pressure, continuity/velocity, continuity/pressure}, taken
+   from the kernel output jac like fluid_kernel_band(). The extrapolation of the boundary
+   rows is lumped onto the nodes 1 and N-1, p0 = p1 and uN = uN-1; dropping the third
+   node instead would cancel the stabilization of node 1 and leave a singular pivot.
+*/
+static void fluid_jfnk_block(const FluidJFNK& jfnk, int i, int j, double* block)
+{
+  int N = jfnk.N;
+  const double* jac = jfnk.workspace->jac;
+  double alpha = jfnk.alpha;
+  block[0] = block[1] = block[2] = block[3] = 0.0;
+
+  if (i == 0) {
+    if (j == 0)
+      block[0] = block[3] = 1.0;
+    else
+      block[3] = -1.0;
+    return;
+  }
+  if (i == N) {
+    if (j == N) {
+      block[0] = block[3] = 1.0;
+      block[2] = -(sqrt(1 - jfnk.pressure_n[N] / 2) - (jfnk.velocity[N] - jfnk.velocity_n[N]) / 4);
+    } else {
+      block[0] = -1.0;
+    }
+    return;
+  }
+
+  int uu = j < i ? FLUID_JAC_UU_W : (j == i ? FLUID_JAC_UU_C : FLUID_JAC_UU_E);
+  int up = j < i ? FLUID_JAC_UP_W : (j == i ? FLUID_JAC_UP_C : FLUID_JAC_UP_E);
+  block[0] = jac[uu * (N + 1) + i];
+  block[1] = jac[up * (N + 1) + i];
+  block[2] = j == i ? -jac[up * (N + 1) + i] : jac[up * (N + 1) + i];
+  block[3] = j == i ? 2 * alpha : -alpha;
+}
+
+/* y = a x for 2x2 blocks */
+static inline void fluid_block_apply(const double* a, const double* x, double* y)
+{
+  double y0 = a[0] * x[0] + a[1] * x[1];
+  double y1 = a[2] * x[0] + a[3] * x[1];
+  y[0] = y0;
+  y[1] = y1;
+}
+
+/*
+   Sets up the block tridiagonal preconditioner: the Newton matrix with the 2x2 blocks of
+   velocity and pressure of neighbouring nodes, which includes the pressure gradient of the
+   momentum equation and the stabilization of the continuity equation, with the lumped
+   boundary rows of fluid_jfnk_block(). The block LU factorization (block Thomas
+   algorithm) stores the inverse pivot blocks, 4 (N+1) values.
+*/
+static void fluid_jfnk_precondition_setup(FluidJFNK& jfnk)
+{
+  int N = jfnk.N;
+  double* pivot = jfnk.workspace->preconditioner;
+  double lower[4], upper[4], diagonal[4], product[4];
+
+  for (int i = 0; i <= N; i++) {
+    fluid_jfnk_block(jfnk, i, i, diagonal);
+    if (i > 0) {
+      // diagonal -= lower * pivot_{i-1} * upper_{i-1}
+      fluid_jfnk_block(jfnk, i, i - 1, lower);
+      fluid_jfnk_block(jfnk, i - 1, i, upper);
+      const double* inverse = pivot + 4 * (i - 1);
+      double column[2];
+      for (int c = 0; c < 2; c++) {
+        double u[2] = {upper[c], upper[2 + c]};
+        fluid_block_apply(inverse, u, column);
+        fluid_block_apply(lower, column, u);
+        product[c] = u[0];
+        product[2 + c] = u[1];
+      }
+      for (int k = 0; k < 4; k++)
+        diagonal[k] -= product[k];
+    }
+    double det = diagonal[0] * diagonal[3] - diagonal[1] * diagonal[2];
+    double* inverse = pivot + 4 * i;
+    inverse[0] = diagonal[3] / det;
+    inverse[1] = -diagonal[1] / det;
+    inverse[2] = -diagonal[2] / det;
+    inverse[3] = diagonal[0] / det;
+  }
+}
+
+static void fluid_jfnk_precondition(void* context, const double* r, double* z)
+{
+  FluidJFNK& jfnk = *(FluidJFNK*)context;
+  int N = jfnk.N;
+  const double* pivot = jfnk.workspace->preconditioner;
+  double block[4], g[2], h[2];
+
+  // Forward elimination, z holds pivot_i * g_i in block ordering
+  for (int i = 0; i <= N; i++) {
+    g[0] = r[i];
+    g[1] = r[N + 1 + i];
+    if (i > 0) {
+      double previous[2] = {z[i - 1], z[N + i]};
+      fluid_jfnk_block(jfnk, i, i - 1, block);
+      fluid_block_apply(block, previous, h);
+      g[0] -= h[0];
+      g[1] -= h[1];
+    }
+    fluid_block_apply(pivot + 4 * i, g, h);
+    z[i] = h[0];
+    z[N + 1 + i] = h[1];
+  }
+
+  // Back substitution, z_i = pivot_i g_i - pivot_i upper_i z_{i+1}
+  for (int i = N - 1; i >= 0; i--) {
+    double next[2] = {z[i + 1], z[N + 2 + i]};
+    fluid_jfnk_block(jfnk, i, i + 1, block);
+    fluid_block_apply(block, next, g);
+    fluid_block_apply(pivot + 4 * i, g, h);
+    z[i] -= h[0];
+    z[N + 1 + i] -= h[1];
+  }
+}
+
+/* Tube law of the structure solver, crossSectionLength as a function of the pressure */
+static inline double tube_law(double pressure)
+{
+  return 4.0 / ((2.0 - pressure) * (2.0 - pressure));
+}
+
+static inline double tube_law_derivative(double pressure)
+{
+  return 8.0 / ((2.0 - pressure) * (2.0 - pressure) * (2.0 - pressure));
+}
+
+/*
+   Adds the dependency of the residual on crossSectionLength = tube_law(pressure) to the
+   pressure columns of the Jacobian, LHS(row, p_j) -= dRes_row/dA_j * dA_j/dp_j. Only the
+   interior rows depend on crossSectionLength, the band is not changed. width are the
+   control volumes of a non-uniform mesh, NULL for the uniform mesh. The fluxes are
+   weighted by theta, the time derivatives are not.
+*/
+static void fluid_jacobian_tube_law(
+    FluidBand& band,
+    const double* velocity,
+    const double* velocity_n,
+    const double* pressure,
+    int N,
+    double dx,
+    const double* width,
+    double theta,
+    int threads)
+{
+  auto LHS = [&band](int row, int col) -> double& { return fluid_band_entry(band, row, col); };
+  const double* u = velocity;
+  const double* p = pressure;
+  const double quarter = 0.25 * theta;
+
+  // Every row is only written by its own node
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+  for (int i = 1; i < N; i++) {
+    double dAW = tube_law_derivative(p[i - 1]);
+    double dAC = tube_law_derivative(p[i]);
+    double dAE = tube_law_derivative(p[i + 1]);
+    double convectionW = u[i - 1] * (u[i] + u[i - 1]);
+    double convectionE = u[i] * (u[i + 1] + u[i]);
+    double dxC = width ? dx * width[i] : dx;
+
+    // Momentum, derivatives with respect to A[i-1], A[i], A[i+1]
+    LHS(i, N + 1 + i - 1) -= quarter * (convectionW + p[i - 1] - p[i]) * dAW;
+    LHS(i, N + 1 + i) -= (dxC * (velocity_n[i] - u[i]) + quarter * (convectionW - convectionE + p[i - 1] - p[i + 1])) * dAC;
+    LHS(i, N + 1 + i + 1) -= quarter * (p[i] - p[i + 1] - convectionE) * dAE;
+
+    // Continuity
+    LHS(i + N + 1, N + 1 + i - 1) -= quarter * (u[i - 1] + u[i]) * dAW;
+    LHS(i + N + 1, N + 1 + i) -= (-dxC + quarter * (u[i - 1] - u[i + 1])) * dAC;
+    LHS(i + N + 1, N + 1 + i + 1) -= -quarter * (u[i] + u[i + 1]) * dAE;
+  }
+}
+
+/*
+   Newton iteration of fluid_nl. With tubeLaw, crossSectionLength is not an input but
+   follows from the pressure by the tube law in every iteration.
+
+   velocity and pressure point to the iterate. After a time advance, this is the previous
+   level of the state until the first update writes the current level.
+*/
+static int fluid_solve(
+    TubeState& state,
     double t,
     int N,
     double kappa,
-    double tau)
+    double tau,
+    FluidWorkspace& workspace,
+    const FluidOptions& options,
+    double rtol,
+    bool tubeLaw)
 {
+  /* The predictor modifies the current level in place */
+  if (options.predictor != FLUID_PREDICTOR_NONE)
+    tube_state_settle(state);
+
+  /* Views of the state, see fluid_state.h */
+  double* crossSectionLength = tubeLaw ? state.current.crossSectionLength : tube_state_iterate(state).crossSectionLength;
+  double* crossSectionLength_n = state.previous.crossSectionLength;
+  double* velocity = tube_state_iterate(state).velocity;
+  double* velocity_n = state.previous.velocity;
+  double* pressure = tube_state_iterate(state).pressure;
+  double* pressure_n = state.previous.pressure;
+
   /* fluid_nl Variables */
-  int i, j = 0, k, ampl;
+  int i, k;
   double alpha, dx;
-  double tmp, tmp2;
   double* Res;
-  double** LHS;
   double temp_sum;
   double norm_1, norm_2;
   double norm = 1.0;
 
   // Used as Ax = b
   // i.e. LHS*x = Res
-  Res = (double*)calloc((2 * N + 2), sizeof(double));
-  LHS = (double**)calloc((2 * N + 2), sizeof(double*));
-  for (i = 0; i < (2 * N + 2); ++i)
-    LHS[i] = (double*)calloc((2 * N + 2), sizeof(double));
-
-  /* LAPACK Variables */
-  double* A = (double*)calloc((2 * N + 2) * (2 * N + 2), sizeof(double));
-  ;
-  int* ipiv = (int*)calloc((2 * N + 2), sizeof(int));
-  ;
-  int nlhs = (2 * N + 2);
-  int nrhs = 1;
-  int info;
-
-  /* Stabilization Intensity */
-  alpha = (N * kappa * tau) / (N * tau + 1);
-  dx = 1.0 / (N * kappa * tau);
-  ampl = 100;
-
-  k = 0;
-  while (1) {
-    for (i = 0; i < (2 * N + 2); i++)
-      Res[i] = 0.0;
-
-    for (i = 1; i < N; i++) {
-      /* Momentum */
-      Res[i] = velocity_n[i] * crossSectionLength[i] * dx;
-      Res[i] = Res[i] - 0.25 * crossSectionLength[i + 1] * velocity[i] * velocity[i + 1] - 0.25 * crossSectionLength[i] * velocity[i] * velocity[i + 1];
-      Res[i] = Res[i] - crossSectionLength[i] * dx * velocity[i] - 0.25 * crossSectionLength[i + 1] * velocity[i] * velocity[i] - 0.25 * crossSectionLength[i] * velocity[i] * velocity[i] + 0.25 * crossSectionLength[i] * velocity[i - 1] * velocity[i] + 0.25 * crossSectionLength[i - 1] * velocity[i - 1] * velocity[i];
-      Res[i] = Res[i] + 0.25 * crossSectionLength[i - 1] * velocity[i - 1] * velocity[i - 1] + 0.25 * crossSectionLength[i] * velocity[i - 1] * velocity[i - 1];
-      Res[i] = Res[i] + 0.25 * crossSectionLength[i - 1] * pressure[i - 1] + 0.25 * crossSectionLength[i] * pressure[i - 1] - 0.25 * crossSectionLength[i - 1] * pressure[i] + 0.25 * crossSectionLength[i + 1] * pressure[i] - 0.25 * crossSectionLength[i] * pressure[i + 1] - 0.25 * crossSectionLength[i + 1] * pressure[i + 1];
-
-      /* Continuity */
-      Res[i + N + 1] = -(crossSectionLength[i] - crossSectionLength_n[i]) * dx;
-      Res[i + N + 1] = Res[i + N + 1] + 0.25 * crossSectionLength[i - 1] * velocity[i - 1] + 0.25 * crossSectionLength[i] * velocity[i - 1] + 0.25 * crossSectionLength[i - 1] * velocity[i] - 0.25 * crossSectionLength[i + 1] * velocity[i] - 0.25 * crossSectionLength[i] * velocity[i + 1] - 0.25 * crossSectionLength[i + 1] * velocity[i + 1];
-      Res[i + N + 1] = Res[i + N + 1] + alpha * pressure[i - 1] - 2 * alpha * pressure[i] + alpha * pressure[i + 1];
+  Res = workspace.Res;
+
+  /* Banded Jacobian, see fluid_banded.h, solved in partitions with more than one thread */
+  FluidBand& band = workspace.band;
+  FluidThreads& parallel = workspace.threads;
+  int threads = parallel.count;
+  int info = 0;
+  int factorizations = 0;
+  double norm_previous = 0.0;
+  double fullRtol = tubeLaw ? options.tubeLawNewtonRtol : options.newtonRtol; // tolerance of a fully converged solve
+
+  /* Non-uniform mesh, the tube keeps the length of the uniform reference mesh, see elastictube_mesh.h */
+  const TubeMesh* mesh = workspace.mesh;
+  const double* x = mesh && !tube_mesh_is_uniform(*mesh) ? mesh->x.data() : NULL;
+  const double* width = x ? mesh->width.data() : NULL;
+  double length = mesh ? mesh->length : N;
+
+  /* Stabilization Intensity, weighted by theta like the fluxes */
+  double theta = options.theta;
+  alpha = theta * (length * kappa * tau) / (length * tau + 1);
+  dx = 1.0 / (length * kappa * tau);
+
+  /* Theta scheme, the fluxes of the previous level are the same in all iterations, see fluid_kernel.h */
+  double* flux_n = theta < 1.0 ? workspace.flux_n : NULL;
+  if (flux_n) {
+#pragma omp parallel num_threads(threads) if (threads > 1)
+    {
+      int first, last;
+      fluid_thread_range(1, N, fluid_thread_id(), fluid_thread_count(), first, last);
+      fluid_kernel_flux(crossSectionLength_n, velocity_n, pressure_n, 1.0 - theta, first, last, flux_n, flux_n + N + 1);
     }
+  }
 
-    i = N - 1;
-
-    /* Boundary */
+  /* Jacobian-free engine, the Jacobian is only applied to vectors, see fluid_krylov.h */
+  FluidJFNK jfnk = {&workspace, crossSectionLength, crossSectionLength_n, velocity, velocity_n,
+                    pressure, pressure_n, t, kappa, options.ampl, alpha, dx, 0.0, N, threads, x, width, theta, flux_n};
+  int linearIterations = 0;
+  double eta = options.krylovRtol; // forcing term, the tolerance of the linear solve
+  double initialNorm = 0.0;
 
-    /* Velocity Inlet is prescribed */
-    tmp = sin(PI * (t+0.01)); //to not start with 0 velocity
-    Res[0] = (1.0 / kappa) + (1.0 / (kappa * ampl)) * tmp * tmp - velocity[0];
+  /* Phases of the iteration, see fluid_profile.h */
+  FluidProfile& profile = workspace.profile;
+  double start = fluid_clock();
+  double clock;
 
-    /* Pressure Inlet is lineary interpolated */
-    Res[N + 1] = -pressure[0] + 2 * pressure[1] - pressure[2];
+  /* Initial guess, see fluid_predictor.h */
+  if (options.predictor != FLUID_PREDICTOR_NONE)
+    fluid_predictor_predict(workspace.history, options.predictor, t, crossSectionLength,
+                            velocity_n, pressure_n, velocity, pressure);
 
-    /* Velocity Outlet is lineary interpolated */
-    Res[N] = -velocity[N] + 2 * velocity[N - 1] - velocity[N - 2];
+  k = 0;
+  while (1) {
+    clock = fluid_clock();
+    if (tubeLaw) {
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+      for (int j = 0; j <= N; j++)
+        crossSectionLength[j] = tube_law(pressure[j]);
+    }
 
-    /* Pressure Outlet is "non-reflecting" */
-    tmp2 = sqrt(1 - pressure_n[N] / 2) - (velocity[N] - velocity_n[N]) / 4;
-    Res[2 * N + 1] = -pressure[N] + 2 * (1 - tmp2 * tmp2);
+    fluid_residual(Res, workspace.jac, crossSectionLength, crossSectionLength_n, velocity, velocity_n, pressure, pressure_n,
+                   t, N, kappa, options.ampl, alpha, dx, x, width, theta, flux_n, threads);
+    fluid_profile_lap(profile.residual, clock, "residual");
 
     k += 1; // Iteration Count
 
-    // compute norm of residual
-    temp_sum = 0;
-    for (i = 0; i < (2 * N + 2); i++) {
-      temp_sum += Res[i] * Res[i];
+    // compute norm of residual, the partial sums of the threads are added in a fixed order
+    int teams = 1;
+#pragma omp parallel num_threads(threads) if (threads > 1)
+    {
+      int thread = fluid_thread_id(), count = fluid_thread_count();
+      int first, last;
+      double sumRes = 0, sumState = 0;
+      fluid_thread_range(0, 2 * N + 2, thread, count, first, last);
+      for (int j = first; j < last; j++) {
+        sumRes += Res[j] * Res[j];
+      }
+      fluid_thread_range(0, N + 1, thread, count, first, last);
+      for (int j = first; j < last; j++) {
+        sumState += (pressure[j] * pressure[j]) + (velocity[j] * velocity[j]);
+      }
+      parallel.sums[2 * thread] = sumRes;
+      parallel.sums[2 * thread + 1] = sumState;
+      if (thread == 0)
+        teams = count;
     }
+    temp_sum = parallel.sums[0];
+    for (i = 1; i < teams; i++)
+      temp_sum += parallel.sums[2 * i];
     norm_1 = sqrt(temp_sum);
-    temp_sum = 0;
-    for (i = 0; i < (N + 1); i++) {
-      temp_sum += (pressure[i] * pressure[i]) + (velocity[i] * velocity[i]);
-    }
+    temp_sum = parallel.sums[1];
+    for (i = 1; i < teams; i++)
+      temp_sum += parallel.sums[2 * i + 1];
     norm_2 = sqrt(temp_sum);
     norm = norm_1 / norm_2; 
 
-    if ((norm < 1e-15 && k > 1) || k > 50) {
-      printf("Nonlinear Solver break, iterations: %i, residual norm: %e\n", k, norm);
+    if (k == 1)
+      initialNorm = norm;
+
+    // A relaxed tolerance may already be met by the initial guess
+    bool converged = norm < rtol && (k > 1 || rtol > fullRtol);
+    if (converged || k > 50) {
+      workspace.last.converged = converged;
+      if (!converged)
+        profile.unconverged++;
+      // Callers without log, e.g. the threads of tube_sweep, report workspace.last or the profile
+      if (options.log && converged) {
+        printf("Nonlinear Solver break, iterations: %i, residual norm: %e", k, norm);
+        if (options.engine == FLUID_ENGINE_JFNK)
+          printf(", linear iterations: %i", linearIterations);
+        else if (options.chord)
+          printf(", factorizations: %i", factorizations);
+        if (rtol != fullRtol)
+          printf(", tolerance: %e", rtol);
+        printf("\n");
+      } else if (options.log) {
+        printf("Nonlinear Solver not converged!, iterations: %i, residual norm: %e, tolerance: %e\n", k, norm, rtol);
+      }
       break;
     }
-
-    /* Initilizing the the LHS i.e. Left Hand Side */
-    for (i = 0; i <= (2 * N + 1); i++)
-      for (j = 0; j <= (2 * N + 1); j++)
-        LHS[i][j] = 0.0;
-
-    for (i = 1; i < N; i++) {
-      // Momentum, Velocity
-      LHS[i][i - 1] = LHS[i][i - 1] - 0.25 * crossSectionLength[i - 1] * velocity[i - 1] * 2 - 0.25 * crossSectionLength[i] * velocity[i - 1] * 2 - 0.25 * crossSectionLength[i] * velocity[i] - 0.25 * crossSectionLength[i - 1] * velocity[i];
-      LHS[i][i] = LHS[i][i] + 0.25 * crossSectionLength[i + 1] * velocity[i + 1] + 0.25 * crossSectionLength[i] * velocity[i + 1] + crossSectionLength[i] * dx + 0.25 * crossSectionLength[i + 1] * velocity[i] * 2 + 0.25 * crossSectionLength[i] * velocity[i] * 2 - 0.25 * crossSectionLength[i] * velocity[i - 1] - 0.25 * crossSectionLength[i - 1] * velocity[i - 1];
-      LHS[i][i + 1] = LHS[i][i + 1] + 0.25 * crossSectionLength[i + 1] * velocity[i] + 0.25 * crossSectionLength[i] * velocity[i];
-
-      // Momentum, Pressure
-      LHS[i][N + 1 + i - 1] = LHS[i][N + 1 + i - 1] - 0.25 * crossSectionLength[i - 1] - 0.25 * crossSectionLength[i];
-      LHS[i][N + 1 + i] = LHS[i][N + 1 + i] + 0.25 * crossSectionLength[i - 1] - 0.25 * crossSectionLength[i + 1];
-      LHS[i][N + 1 + i + 1] = LHS[i][N + 1 + i + 1] + 0.25 * crossSectionLength[i] + 0.25 * crossSectionLength[i + 1];
-
-      // Continuity, Velocity
-      LHS[i + N + 1][i - 1] = LHS[i + N + 1][i - 1] - 0.25 * crossSectionLength[i - 1] - 0.25 * crossSectionLength[i];
-      LHS[i + N + 1][i] = LHS[i + N + 1][i] - 0.25 * crossSectionLength[i - 1] + 0.25 * crossSectionLength[i + 1];
-      LHS[i + N + 1][i + 1] = LHS[i + N + 1][i + 1] + 0.25 * crossSectionLength[i] + 0.25 * crossSectionLength[i + 1];
-
-      // Continuity, Pressure
-      LHS[i + N + 1][N + 1 + i - 1] = LHS[i + N + 1][N + 1 + i - 1] - alpha;
-      LHS[i + N + 1][N + 1 + i] = LHS[i + N + 1][N + 1 + i] + 2 * alpha;
-      LHS[i + N + 1][N + 1 + i + 1] = LHS[i + N + 1][N + 1 + i + 1] - alpha;
-    }
-
-    /* Boundary */
-
-    // Velocity Inlet is prescribed
-    LHS[0][0] = 1;
-    // Pressure Inlet is lineary interpolated
-    LHS[N + 1][N + 1] = 1;
-    LHS[N + 1][N + 2] = -2;
-    LHS[N + 1][N + 3] = 1;
-    // Velocity Outlet is lineary interpolated
-    LHS[N][N] = 1;
-    LHS[N][N - 1] = -2;
-    LHS[N][N - 2] = 1;
-    // Pressure Outlet is Non-Reflecting
-    LHS[2 * N + 1][2 * N + 1] = 1;
-    LHS[2 * N + 1][N] = -(sqrt(1 - pressure_n[N] / 2) - (velocity[N] - velocity_n[N]) / 4);
-
-    /* LAPACK requires a 1D array 
-       i.e. Linearizing 2D 
-    */
-    int counter = 0;
-    for (i = 0; i <= (2 * N + 1); i++) {
-      for (j = 0; j <= (2 * N + 1); j++) {
-        A[counter] = LHS[j][i];
-        counter++;
+    clock = fluid_clock();
+
+    if (options.engine == FLUID_ENGINE_JFNK) {
+      /* Inexact Newton step, GMRES solves LHS * step = Res to the relative tolerance eta */
+      if (options.forcing == FLUID_FORCING_EW && k > 1) {
+        // Eisenstat-Walker choice 2, safeguarded against a too fast decrease and oversolving
+        const double gamma = 0.9, order = (1.0 + sqrt(5.0)) / 2.0;
+        double previous = gamma * pow(eta, order);
+        eta = gamma * pow(norm / norm_previous, order);
+        if (previous > 0.1 && previous > eta)
+          eta = previous;
+        if (eta < 0.5 * rtol / norm)
+          eta = 0.5 * rtol / norm;
+        if (eta > 0.9)
+          eta = 0.9;
+      }
+      norm_previous = norm;
+      jfnk.normState = norm_2;
+      fluid_jfnk_precondition_setup(jfnk);
+      fluid_profile_lap(profile.jacobian, clock, "preconditioner setup");
+      for (i = 0; i < (2 * N + 2); i++)
+        workspace.step[i] = 0.0;
+
+      int iterations = fluid_gmres(workspace.krylov, fluid_jfnk_apply, fluid_jfnk_precondition, &jfnk,
+                                   Res, workspace.step, eta, 50 * options.krylovRestart);
+      if (iterations < 0) {
+        printf("Linear Solver not converged!, GMRES iterations: %i\n", 50 * options.krylovRestart);
+        iterations = 50 * options.krylovRestart;
+      }
+      linearIterations += iterations;
+      fluid_profile_lap(profile.solve, clock, "gmres");
+
+      for (i = 0; i < (2 * N + 2); i++)
+        Res[i] = workspace.step[i];
+    } else {
+      /* Jacobian, reassembled and factorized unless the chord iteration reuses the factors */
+      bool refactor = !options.chord || !workspace.factorized || workspace.factorTime != t ||
+                      (k > 1 && norm > options.chordRate * norm_previous);
+      norm_previous = norm;
+
+      if (refactor) {
+        fluid_jacobian(band, workspace.jac, velocity, velocity_n, pressure_n, N, x, alpha, threads);
+        if (tubeLaw)
+          fluid_jacobian_tube_law(band, velocity, velocity_n, pressure, N, dx, width, theta, threads);
+        fluid_profile_lap(profile.jacobian, clock, "jacobian");
+        info = parallel.P ? fluid_threads_factor(parallel, band) : fluid_band_factor(band);
+        workspace.factorized = info == 0;
+        workspace.factorTime = t;
+        factorizations++;
+        fluid_profile_lap(profile.factor, clock, "dgbtrf");
       }
-    }
 
-    /* LAPACK Function call to solve the linear system */
-    dgesv_(&nlhs, &nrhs, A, &nlhs, ipiv, Res, &nlhs, &info);
+      /* LAPACK Function call to solve the banded linear system */
+      if (info == 0)
+        info = parallel.P ? fluid_threads_substitute(parallel, band, Res) : fluid_band_substitute(band, Res);
+      fluid_profile_lap(profile.solve, clock, "dgbtrs");
 
-    if (info != 0) {
-      printf("Linear Solver not converged!, Info: %i\n", info);
+      if (info != 0) {
+        printf("Linear Solver not converged!, Info: %i\n", info);
+      }
     }
 
-    for (i = 0; i <= N; i++) {
-      velocity[i] = velocity[i] + Res[i];
-      pressure[i] = pressure[i] + Res[i + N + 1];
+#pragma omp parallel for num_threads(threads) if (threads > 1) schedule(static)
+    for (int j = 0; j <= N; j++) {
+      state.current.velocity[j] = velocity[j] + Res[j];
+      state.current.pressure[j] = pressure[j] + Res[j + N + 1];
     }
+    velocity = jfnk.velocity = state.current.velocity;
+    pressure = jfnk.pressure = state.current.pressure;
+    if (state.advanced && !tubeLaw)
+      for (i = 0; i <= N; i++)
+        state.current.crossSectionLength[i] = crossSectionLength[i];
+    state.advanced = false;
 
   } 
+  tube_state_settle(state); // the initial guess was accepted without an update
+
+  if (options.predictor != FLUID_PREDICTOR_NONE)
+    fluid_predictor_store(workspace.history, crossSectionLength);
+
+  workspace.last.rtol = rtol;
+  workspace.last.initialNorm = initialNorm;
+  workspace.last.norm = norm;
+  workspace.last.iterations = k;
+  workspace.last.factorizations = factorizations;
+  workspace.last.linearIterations = linearIterations;
+
+  profile.total += fluid_clock() - start;
+  profile.calls++;
+  TRACE_COUNTER("newton iterations", k);
+  profile.iterations += k;
+  profile.factorizations += factorizations;
+  profile.linearIterations += linearIterations;
+
   return 0;
 }
 
-void initializeWriting(std::ofstream&filestream)
+/* Function for fluid_nl i.e. non-linear */
+int fluid_nl(
+    TubeState& state,
+    double t,
+    int N,
+    double kappa,
+    double tau,
+    FluidWorkspace& workspace,
+    const FluidOptions& options,
+    double rtol)
 {
-  filestream.setf(std::ios::showpoint);
-  filestream.setf(std::ios::scientific);
-  filestream << std::setprecision(16);
+  return fluid_solve(state, t, N, kappa, tau, workspace, options, rtol, false);
 }
 
-void writeHeader(std::ostream& outFile)
+int fluid_nl_monolithic(
+    TubeState& state,
+    double t,
+    int N,
+    double kappa,
+    double tau,
+    FluidWorkspace& workspace,
+    const FluidOptions& options)
 {
-  outFile << "# vtk DataFile Version 2.0" << std::endl << std::endl
-          << "ASCII" << std::endl << std::endl
-          << "DATASET UNSTRUCTURED_GRID" << std::endl << std::endl;
+  if (options.engine != FLUID_ENGINE_EXPLICIT)
+    return fluid_solve(state, t, N, kappa, tau, workspace, options, options.tubeLawNewtonRtol, true);
+
+  /* Explicit substeps, see fluid_explicit.h */
+  FluidProfile& profile = workspace.profile;
+  double start = fluid_clock();
+  double dx = 1.0 / (N * kappa * tau);
+  int substeps = fluid_explicit_window(workspace.waves, state, dx, fluid_inlet_velocity(t, kappa, options.ampl),
+                                       options.cfl, workspace.threads.count);
+  if (options.log)
+    printf("Explicit substeps: %i\n", substeps);
+
+  workspace.last = FluidCallStats();
+  workspace.last.iterations = substeps;
+  workspace.last.converged = true;
+
+  double now = fluid_clock();
+  profile.residual += now - start;
+  profile.total += now - start;
+  profile.calls++;
+  TRACE_COMPLETE("explicit", start, now);
+  profile.iterations += substeps;
+  return 0;
 }
 
-void exportMesh(std::ofstream& outFile, int N_slices, double* grid)
-{  
-  // Plot vertices
-  outFile << "POINTS " << N_slices << " float "<<std::endl << std::endl;
-  
-  for (int i = 0; i<N_slices; i++)
+/* Runs body(segment) for all segments of network, the segments of a team on one thread */
+template <typename Body>
+static void fluid_network_for(FluidNetwork& network, Body body)
+{
+  int teams = (int)network.teams.size();
+#pragma omp parallel num_threads(teams) if (teams > 1)
   {
-	  // read x,y from grid. Set z = 0
-	  // Values are stored in grid in the following way: [x_0,y_0,x_1,y_1,...x_n-1,y_n-1]	 
-	  double x = grid[2 * i + 0]; 
-	  double y = grid[2 * i + 1];
-	  double z = 0.0;
-	  outFile << x << "  " << y << "  " << z << std::endl;
+    for (int team = fluid_thread_id(); team < teams; team += fluid_thread_count()) {
+      for (size_t k = 0; k < network.teams[team].size(); k++)
+        body(network.segments[network.teams[team][k]]);
+    }
   }
-  outFile << std::endl;
 }
 
-void exportVectorData(std::ofstream& outFile, int N_slices, double* data, const char* dataname)
+/* Stabilization and dx of fluid_solve() for a segment with elements / length elements per tube */
+static void fluid_segment_coefficients(const FluidSegment& segment, double kappa, double tau, double theta,
+                                       double& alpha, double& dx)
 {
-	outFile << "VECTORS " << dataname << " float" << std::endl;
-
-	for(int i = 0; i < N_slices; i++)
-	{ 	
-		// Plot vertex data 
-		// read x vector component from dataset. Set y,z = 0
-		// Values are stored in dataset in the following way: [vx_0,vx_1,...vx_n-1]
-		double vx = data[i]; 
-		double vy = 0.0; 
-		double vz = 0.0;           
-		outFile << vx << "  " << vy << "  " << vz << std::endl;      
-	}  
-	
-	outFile << std::endl;          
+  double length = segment.elements / segment.length;
+  alpha = theta * (length * kappa * tau) / (length * tau + 1);
+  dx = 1.0 / (length * kappa * tau);
 }
 
-void exportScalarData(std::ofstream& outFile, int N_slices, double* data, std::string dataname)
-{  
-	outFile << "SCALARS " << dataname << " float" << std::endl;
-	outFile << "LOOKUP_TABLE default" << std::endl;
-
-	for(int i = 0; i < N_slices; i++)
-	{ 
-		// Plot vertex data            
-		outFile << data[i] << std::endl;      
-	}
-	
-	outFile << std::endl;
+/*
+   Residual of a segment at the current level of its state, with the rows of the ends at
+   junctions replaced: the velocity is extrapolated and p + u^2/2 equals the total
+   pressure of the junction. Leaves the squared norms of residual and state in sums.
+*/
+static void fluid_segment_residual(FluidSegment& segment, const double* junctionPressure, double t, double kappa,
+                                   double tau, const FluidOptions& options)
+{
+  int N = segment.elements;
+  TubeFields& x = segment.state.current;
+  const TubeFields& x_n = segment.state.previous;
+  FluidWorkspace& workspace = segment.workspace;
+  double* Res = workspace.Res;
+  double alpha, dx;
+  fluid_segment_coefficients(segment, kappa, tau, options.theta, alpha, dx);
+
+  for (int i = 0; i <= N; i++)
+    x.crossSectionLength[i] = tube_law(x.pressure[i]);
+  fluid_residual(Res, workspace.jac, x.crossSectionLength, x_n.crossSectionLength, x.velocity, x_n.velocity, x.pressure,
+                 x_n.pressure, t, N, kappa, options.ampl, alpha, dx, NULL, NULL, options.theta,
+                 options.theta < 1.0 ? workspace.flux_n : NULL, 1);
+
+  if (segment.junction[0] >= 0) {
+    Res[0] = -x.velocity[0] + 2 * x.velocity[1] - x.velocity[2];
+    Res[N + 1] = junctionPressure[segment.junction[0]] - x.pressure[0] - 0.5 * x.velocity[0] * x.velocity[0];
+  }
+  if (segment.junction[1] >= 0)
+    Res[2 * N + 1] = junctionPressure[segment.junction[1]] - x.pressure[N] - 0.5 * x.velocity[N] * x.velocity[N];
+
+  double sumRes = 0, sumState = 0;
+  for (int i = 0; i < 2 * N + 2; i++)
+    sumRes += Res[i] * Res[i];
+  for (int i = 0; i <= N; i++)
+    sumState += (x.pressure[i] * x.pressure[i]) + (x.velocity[i] * x.velocity[i]);
+  segment.sums[0] = sumRes;
+  segment.sums[1] = sumState;
 }
 
-void write_vtk(double t, int iteration, const char* filename_prefix, int N_slices, double* grid, double* velocity, double* pressure, double* diameter)
+/* Newton matrix of a segment in its band, with the junction rows of fluid_segment_residual() */
+static void fluid_segment_jacobian(FluidSegment& segment, double kappa, double tau, const FluidOptions& options)
 {
-	std::stringstream filename_stream;
-	filename_stream << filename_prefix <<"_"<< iteration <<".vtk";
-	std::string filename = filename_stream.str();
-	printf("writing timestep at t=%f to %s\n", t, filename.c_str());
-				
-	std::ofstream outstream(filename);	
-
-	initializeWriting(outstream);
-	writeHeader(outstream);
-	exportMesh(outstream, N_slices, grid);
-	
-	outstream << "POINT_DATA " << N_slices << std::endl;
-	outstream << std::endl;  
-  	
-	exportVectorData(outstream, N_slices, velocity, "velocity");
-	exportScalarData(outstream, N_slices, pressure, "pressure");
-	exportScalarData(outstream, N_slices, diameter, "diameter");
-	
-	outstream.close();		
+  int N = segment.elements;
+  const TubeFields& x = segment.state.current;
+  const TubeFields& x_n = segment.state.previous;
+  FluidBand& band = segment.workspace.band;
+  auto LHS = [&band](int row, int col) -> double& { return fluid_band_entry(band, row, col); };
+  double alpha, dx;
+  fluid_segment_coefficients(segment, kappa, tau, options.theta, alpha, dx);
+
+  fluid_jacobian(band, segment.workspace.jac, x.velocity, x_n.velocity, x_n.pressure, N, NULL, alpha, 1);
+  fluid_jacobian_tube_law(band, x.velocity, x_n.velocity, x.pressure, N, dx, NULL, options.theta, 1);
+
+  // The column of the junction pressure is -1 in the total pressure row, see fluid_nl_network()
+  if (segment.junction[0] >= 0) {
+    LHS(0, 0) = 1;
+    LHS(0, 1) = -2;
+    LHS(0, 2) = 1;
+    LHS(N + 1, 0) = x.velocity[0];
+    LHS(N + 1, N + 1) = 1;
+    LHS(N + 1, N + 2) = 0;
+    LHS(N + 1, N + 3) = 0;
+  }
+  if (segment.junction[1] >= 0) {
+    LHS(2 * N + 1, N) = x.velocity[N];
+    LHS(2 * N + 1, 2 * N + 1) = 1;
+  }
+}
+
+/*
+   Solves the band of a segment for its residual and for the junction columns of its
+   ends, which are -1 in the total pressure rows of the start (N+1) and the end (2N+1).
+*/
+static int fluid_segment_substitute(FluidSegment& segment)
+{
+  int N = segment.elements;
+  FluidBand& band = segment.workspace.band;
+  int info = fluid_band_substitute(band, segment.workspace.Res);
+  for (int side = 0; side < 2; side++) {
+    if (segment.junction[side] < 0 || info != 0)
+      continue;
+    double* w = segment.coupling + side * (2 * N + 2);
+    for (int i = 0; i < 2 * N + 2; i++)
+      w[i] = 0.0;
+    w[side ? 2 * N + 1 : N + 1] = -1.0;
+    info = fluid_band_substitute(band, w);
+  }
+  return info;
+}
+
+/*
+   Mass rows of the junctions in the unknowns of the segment ends, the flow into the
+   junction A u at the end of a segment, out of it at the start. LHS = -dRes/d(u, p).
+*/
+static void fluid_junction_row(const FluidSegment& segment, int side, double& rowU, double& rowP)
+{
+  int i = side ? segment.elements : 0;
+  double sign = side ? 1.0 : -1.0;
+  const TubeFields& x = segment.state.current;
+  rowU = -sign * x.crossSectionLength[i];
+  rowP = -sign * tube_law_derivative(x.pressure[i]) * x.velocity[i];
+}
+
+int fluid_nl_network(FluidNetwork& network, double t, double kappa, double tau, const FluidOptions& options)
+{
+  FluidProfile& profile = network.profile;
+  double start = fluid_clock();
+  double clock;
+  int J = (int)network.junctions.size();
+  int S = (int)network.segments.size();
+  int k = 0, info = 0;
+  double norm = 1.0;
+
+  /* The iterate is the current level, the fluxes of the previous level are fixed, see fluid_kernel.h */
+  fluid_network_for(network, [&options](FluidSegment& segment) {
+    TubeState& state = segment.state;
+    int N = segment.elements;
+    tube_state_settle(state);
+    if (options.theta < 1.0)
+      fluid_kernel_flux(state.previous.crossSectionLength, state.previous.velocity, state.previous.pressure,
+                        1.0 - options.theta, 1, N, segment.workspace.flux_n, segment.workspace.flux_n + N + 1);
+  });
+
+  while (1) {
+    clock = fluid_clock();
+    fluid_network_for(network, [&](FluidSegment& segment) {
+      fluid_segment_residual(segment, network.pressure, t, kappa, tau, options);
+    });
+
+    // Mass residual of the junctions, flow in minus flow out
+    for (int j = 0; j < J; j++) {
+      double flow = 0.0;
+      for (size_t e = 0; e < network.junctions[j].ends.size(); e++) {
+        int end = network.junctions[j].ends[e];
+        const FluidSegment& segment = network.segments[end / 2];
+        int i = end % 2 ? segment.elements : 0;
+        double inflow = segment.state.current.crossSectionLength[i] * segment.state.current.velocity[i];
+        flow += end % 2 ? inflow : -inflow;
+      }
+      network.mass[j] = flow;
+    }
+    fluid_profile_lap(profile.residual, clock, "residual");
+
+    k += 1; // Iteration Count
+
+    // Norms in the order of the segments
+    double sumRes = 0.0, sumState = 0.0;
+    for (int s = 0; s < S; s++) {
+      sumRes += network.segments[s].sums[0];
+      sumState += network.segments[s].sums[1];
+    }
+    for (int j = 0; j < J; j++)
+      sumRes += network.mass[j] * network.mass[j];
+    norm = sqrt(sumRes) / sqrt(sumState);
+
+    bool converged = norm < options.tubeLawNewtonRtol && k > 1;
+    if (converged || k > 50) {
+      if (!converged)
+        profile.unconverged++;
+      if (options.log && converged)
+        printf("Nonlinear Solver break, iterations: %i, residual norm: %e\n", k, norm);
+      else if (options.log)
+        printf("Nonlinear Solver not converged!, iterations: %i, residual norm: %e\n", k, norm);
+      break;
+    }
+    clock = fluid_clock();
+
+    /* Bands of the segments */
+    fluid_network_for(network, [&](FluidSegment& segment) {
+      fluid_segment_jacobian(segment, kappa, tau, options);
+    });
+    fluid_profile_lap(profile.jacobian, clock, "jacobian");
+
+    int failed = 0;
+    fluid_network_for(network, [&failed](FluidSegment& segment) {
+      int result = fluid_band_factor(segment.workspace.band);
+      if (result != 0) {
+#pragma omp atomic write
+        failed = result;
+      }
+    });
+    fluid_profile_lap(profile.factor, clock, "dgbtrf");
+
+    if (failed == 0) {
+      fluid_network_for(network, [&failed](FluidSegment& segment) {
+        int result = fluid_segment_substitute(segment);
+        if (result != 0) {
+#pragma omp atomic write
+          failed = result;
+        }
+      });
+    }
+
+    /*
+       Schur complement of the junctions: with the band solutions z of the residual and w of
+       the junction columns, the step of a segment is z - w dP, and the mass rows a give
+       sum a (z - w dP) = mass.
+    */
+    for (int j = 0; j < J * J; j++)
+      network.schur[j] = 0.0;
+    for (int j = 0; j < J && failed == 0; j++) {
+      double rhs = -network.mass[j];
+      for (size_t e = 0; e < network.junctions[j].ends.size(); e++) {
+        int end = network.junctions[j].ends[e];
+        const FluidSegment& segment = network.segments[end / 2];
+        int N = segment.elements, i = end % 2 ? N : 0;
+        double rowU, rowP;
+        fluid_junction_row(segment, end % 2, rowU, rowP);
+        rhs += rowU * segment.workspace.Res[i] + rowP * segment.workspace.Res[N + 1 + i];
+        for (int side = 0; side < 2; side++) {
+          int column = segment.junction[side];
+          if (column < 0)
+            continue;
+          const double* w = segment.coupling + side * (2 * N + 2);
+          network.schur[j + J * column] += rowU * w[i] + rowP * w[N + 1 + i];
+        }
+      }
+      network.mass[j] = rhs;
+    }
+    info = failed != 0 ? failed : fluid_network_junction_solve(network);
+    if (info != 0)
+      printf("Linear Solver not converged!, Info: %i\n", info);
+
+    for (int j = 0; j < J; j++)
+      network.pressure[j] += network.mass[j];
+    fluid_network_for(network, [&network](FluidSegment& segment) {
+      int N = segment.elements;
+      double* step = segment.workspace.Res;
+      for (int side = 0; side < 2; side++) {
+        if (segment.junction[side] < 0)
+          continue;
+        const double* w = segment.coupling + side * (2 * N + 2);
+        double dP = network.mass[segment.junction[side]];
+        for (int i = 0; i < 2 * N + 2; i++)
+          step[i] -= w[i] * dP;
+      }
+      for (int i = 0; i <= N; i++) {
+        segment.state.current.velocity[i] = segment.state.current.velocity[i] + step[i];
+        segment.state.current.pressure[i] = segment.state.current.pressure[i] + step[i + N + 1];
+      }
+    });
+    fluid_profile_lap(profile.solve, clock, "dgbtrs");
+  }
+
+  profile.total += fluid_clock() - start;
+  profile.calls++;
+  TRACE_COUNTER("newton iterations", k);
+  profile.iterations += k;
+  profile.factorizations += k - 1;
+  return info;
+}
+
+double fluid_coupling_tolerance(const FluidOptions& options, const double* crossSectionLength,
+                                const double* crossSectionLength_previous, int N)
+{
+  if (options.couplingForcing <= 0.0)
+    return options.newtonRtol;
+
+  double change = 0.0, length = 0.0;
+  for (int i = 0; i <= N; i++) {
+    double d = crossSectionLength[i] - crossSectionLength_previous[i];
+    change += d * d;
+    length += crossSectionLength[i] * crossSectionLength[i];
+  }
+  double rtol = options.couplingForcing * sqrt(change / length);
+  return rtol > options.newtonRtol ? rtol : options.newtonRtol;
 }
@@ -1,31 +1,74 @@
 #ifndef FLUID_NL_H_
 #define FLUID_NL_H_
 
+#include "../FluidSolver_Common/fluid_kernel.h"
+#include "../FluidSolver_Common/fluid_network.h"
+#include "../FluidSolver_Common/fluid_options.h"
+#include "../FluidSolver_Common/fluid_state.h"
+#include "../FluidSolver_Common/fluid_timestep.h"
+#include "../FluidSolver_Common/fluid_workspace.h"
+#include "fluid_output.h"
+
 #define PI 3.14159265359
 
-int fluid_nl(double* crossSectionLength,
-             double* crossSectionLength_n,
-             double* velocity,
-             double* velocity_n,
-             double* pressure,
-             double* pressure_n,
+/*
+   Solves one time step of the fluid, workspace has to be allocated for N, see fluid_workspace.h.
+   On a non-uniform mesh (workspace.mesh), N is its number of elements and the tube keeps the
+   length of the reference mesh, which kappa and tau refer to.
+   Velocity and pressure of the current level of state are updated, with the previous level
+   as solution of the last time window, see fluid_state.h. t is the end of the time step,
+   the time of the prescribed inlet velocity.
+   The Newton iteration stops at the relative residual norm rtol, options.newtonRtol for a
+   fully converged solve or fluid_coupling_tolerance() within a coupling iteration. The
+   statistics of the call are left in workspace.last.
+*/
+int fluid_nl(TubeState& state,
              double t,
              int N,
              double kappa,
-             double tau);
+             double tau,
+             FluidWorkspace& workspace,
+             const FluidOptions& options,
+             double rtol);
+
+/*
+   Solves one time step of fluid and structure as one system: crossSectionLength of state is
+   given by the tube law A = 4/(2-p)^2 of the structure solver and is updated together
+   with velocity and pressure. The Newton iteration stops at options.tubeLawNewtonRtol, the
+   residual with the tube law stalls above the 1e-15 of a fluid solve. With
+   options.engine = FLUID_ENGINE_EXPLICIT, the window is advanced by explicit substeps
+   instead of a Newton solve, see fluid_explicit.h.
+*/
+int fluid_nl_monolithic(TubeState& state,
+                        double t,
+                        int N,
+                        double kappa,
+                        double tau,
+                        FluidWorkspace& workspace,
+                        const FluidOptions& options);
+
+/*
+   Solves one time step of a tube network, see fluid_network.h: fluid and tube law of all
+   segments as in fluid_nl_monolithic(), coupled at the junctions. Velocity, pressure and
+   crossSectionLength of the current level of the segments and the junction pressures
+   are updated, all inlets prescribe the velocity of fluid_nl() at the end t of the step.
+   The Newton iteration stops at options.tubeLawNewtonRtol.
+   The segments are assembled and solved on network.teams threads. Returns the LAPACK
+   info of the last Newton step.
+*/
+int fluid_nl_network(FluidNetwork& network,
+                     double t,
+                     double kappa,
+                     double tau,
+                     const FluidOptions& options);
 
-int linsolve(int n,
-             double** A,
-             double* b,
-             double* x);
-             
-void write_vtk(double t, 
-				int iteration, 
-				const char* filename_prefix,
-				int N_slices,
-				double* grid,
-				double* velocity, 
-				double* pressure, 
-				double* diameter);             
+/*
+   Tolerance of fluid_nl() in a coupling iteration: options.couplingForcing times the
+   relative change of crossSectionLength since the previous call, at least
+   options.newtonRtol. Far from the converged coupling the fluid is solved loosely, the
+   tolerance tightens as the coupling iterations of the window converge.
+*/
+double fluid_coupling_tolerance(const FluidOptions& options, const double* crossSectionLength,
+                                const double* crossSectionLength_previous, int N);
 
 #endif
@@ -0,0 +1,378 @@
+#include "fluid_output.h"
+#include "../FluidSolver_Common/fluid_memory.h"
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+/* ASCII legacy VTK */
+
+static void initializeWriting(std::ofstream& filestream)
+{
+  filestream.setf(std::ios::showpoint);
+  filestream.setf(std::ios::scientific);
+  filestream << std::setprecision(16);
+}
+
+static void writeHeader(std::ostream& outFile)
+{
+  outFile << "# vtk DataFile Version 2.0" << "\n\n"
+          << "ASCII" << "\n\n"
+          << "DATASET UNSTRUCTURED_GRID" << "\n\n";
+}
+
+static void exportMesh(std::ofstream& outFile, int N_slices, const double* grid)
+{
+  // Plot vertices
+  outFile << "POINTS " << N_slices << " float " << "\n\n";
+
+  for (int i = 0; i < N_slices; i++) {
+    // read x,y from grid. Set z = 0
+    // Values are stored in grid in the following way: [x_0,y_0,x_1,y_1,...x_n-1,y_n-1]
+    double x = grid[2 * i + 0];
+    double y = grid[2 * i + 1];
+    double z = 0.0;
+    outFile << x << "  " << y << "  " << z << "\n";
+  }
+  outFile << "\n";
+}
+
+static void exportVectorData(std::ofstream& outFile, int N_slices, const double* data, const char* dataname)
+{
+  outFile << "VECTORS " << dataname << " float" << "\n";
+
+  for (int i = 0; i < N_slices; i++) {
+    // Plot vertex data
+    // read x vector component from dataset. Set y,z = 0
+    // Values are stored in dataset in the following way: [vx_0,vx_1,...vx_n-1]
+    double vx = data[i];
+    double vy = 0.0;
+    double vz = 0.0;
+    outFile << vx << "  " << vy << "  " << vz << "\n";
+  }
+
+  outFile << "\n";
+}
+
+static void exportScalarData(std::ofstream& outFile, int N_slices, const double* data, const char* dataname)
+{
+  outFile << "SCALARS " << dataname << " float" << "\n";
+  outFile << "LOOKUP_TABLE default" << "\n";
+
+  for (int i = 0; i < N_slices; i++) {
+    // Plot vertex data
+    outFile << data[i] << "\n";
+  }
+
+  outFile << "\n";
+}
+
+static void writeLegacy(const std::string& filename, int N_slices, const double* grid,
+                        const double* velocity, const double* pressure, const double* diameter)
+{
+  std::ofstream outstream(filename);
+
+  initializeWriting(outstream);
+  writeHeader(outstream);
+  exportMesh(outstream, N_slices, grid);
+
+  outstream << "POINT_DATA " << N_slices << "\n";
+  outstream << "\n";
+
+  exportVectorData(outstream, N_slices, velocity, "velocity");
+  exportScalarData(outstream, N_slices, pressure, "pressure");
+  exportScalarData(outstream, N_slices, diameter, "diameter");
+
+  outstream.close();
+}
+
+void write_vtk(double t, int iteration, const char* filename_prefix, int N_slices, double* grid, double* velocity, double* pressure, double* diameter)
+{
+  std::stringstream filename_stream;
+  filename_stream << filename_prefix << "_" << iteration << ".vtk";
+  std::string filename = filename_stream.str();
+  printf("writing timestep at t=%f to %s\n", t, filename.c_str());
+
+  writeLegacy(filename, N_slices, grid, velocity, pressure, diameter);
+}
+
+/* Binary XML VTK */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FLUID_BYTE_ORDER "BigEndian"
+#else
+#define FLUID_BYTE_ORDER "LittleEndian"
+#endif
+
+/*
+   Appended data of a .vtu file. Every array is stored as its size in bytes (UInt64)
+   followed by the raw values, the XML element refers to it by its offset.
+*/
+struct VtuWriter {
+  std::string xml;
+  std::vector<char> data;
+
+  void array(const char* indent, const char* type, const char* name, int components, const void* values, size_t bytes)
+  {
+    char element[256];
+    snprintf(element, sizeof(element),
+             "%s<DataArray type=\"%s\" Name=\"%s\" NumberOfComponents=\"%d\" format=\"appended\" offset=\"%lu\"/>\n",
+             indent, type, name, components, (unsigned long)data.size());
+    xml += element;
+
+    uint64_t size = bytes;
+    data.insert(data.end(), (const char*)&size, (const char*)&size + sizeof(size));
+    data.insert(data.end(), (const char*)values, (const char*)values + bytes);
+  }
+};
+
+/* Points and line cells of the tube, the same for all time steps */
+struct VtuMesh {
+  std::vector<double> points;
+  std::vector<int64_t> connectivity;
+  std::vector<int64_t> offsets;
+  std::vector<uint8_t> types;
+};
+
+static void buildMesh(VtuMesh& mesh, int points, const double* grid, const std::vector<int>& segments)
+{
+  mesh.points.resize(3 * points);
+  for (int i = 0; i < points; i++) {
+    mesh.points[3 * i + 0] = grid[2 * i + 0];
+    mesh.points[3 * i + 1] = grid[2 * i + 1];
+    mesh.points[3 * i + 2] = 0.0;
+  }
+  for (int i = 0; i + 1 < points; i++) {
+    if (std::find(segments.begin(), segments.end(), i + 1) != segments.end())
+      continue; // the next segment of a network
+    mesh.connectivity.push_back(i);
+    mesh.connectivity.push_back(i + 1);
+    mesh.offsets.push_back(mesh.connectivity.size());
+    mesh.types.push_back(3); // VTK_LINE
+  }
+}
+
+static void writeVtu(const std::string& filename, const VtuMesh& mesh, int points, const FluidSnapshot& snapshot,
+                     std::vector<double>& vectorScratch)
+{
+  int cells = (int)mesh.types.size();
+  VtuWriter vtu;
+
+  vectorScratch.assign(3 * points, 0.0);
+  for (int i = 0; i < points; i++)
+    vectorScratch[3 * i] = snapshot.velocity[i];
+
+  vtu.xml += "<?xml version=\"1.0\"?>\n";
+  vtu.xml += "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"" FLUID_BYTE_ORDER "\" header_type=\"UInt64\">\n";
+  vtu.xml += "  <UnstructuredGrid>\n";
+  vtu.xml += "    <Piece NumberOfPoints=\"" + std::to_string(points) + "\" NumberOfCells=\"" + std::to_string(cells) + "\">\n";
+  vtu.xml += "      <PointData Vectors=\"velocity\" Scalars=\"pressure\">\n";
+  vtu.array("        ", "Float64", "velocity", 3, vectorScratch.data(), 3 * points * sizeof(double));
+  vtu.array("        ", "Float64", "pressure", 1, snapshot.pressure, points * sizeof(double));
+  vtu.array("        ", "Float64", "diameter", 1, snapshot.diameter, points * sizeof(double));
+  vtu.xml += "      </PointData>\n";
+  vtu.xml += "      <Points>\n";
+  vtu.array("        ", "Float64", "Points", 3, mesh.points.data(), mesh.points.size() * sizeof(double));
+  vtu.xml += "      </Points>\n";
+  vtu.xml += "      <Cells>\n";
+  vtu.array("        ", "Int64", "connectivity", 1, mesh.connectivity.data(), mesh.connectivity.size() * sizeof(int64_t));
+  vtu.array("        ", "Int64", "offsets", 1, mesh.offsets.data(), mesh.offsets.size() * sizeof(int64_t));
+  vtu.array("        ", "UInt8", "types", 1, mesh.types.data(), mesh.types.size());
+  vtu.xml += "      </Cells>\n";
+  vtu.xml += "    </Piece>\n";
+  vtu.xml += "  </UnstructuredGrid>\n";
+  vtu.xml += "  <AppendedData encoding=\"raw\">\n_";
+
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (!file) {
+    printf("Cannot write %s\n", filename.c_str());
+    return;
+  }
+  fwrite(vtu.xml.data(), 1, vtu.xml.size(), file);
+  fwrite(vtu.data.data(), 1, vtu.data.size(), file);
+  fputs("\n  </AppendedData>\n</VTKFile>\n", file);
+  fclose(file);
+}
+
+static void writePvd(const std::string& filename, const std::vector<std::pair<double, std::string> >& collection)
+{
+  FILE* file = fopen(filename.c_str(), "w");
+  if (!file) {
+    printf("Cannot write %s\n", filename.c_str());
+    return;
+  }
+  fprintf(file, "<?xml version=\"1.0\"?>\n");
+  fprintf(file, "<VTKFile type=\"Collection\" version=\"0.1\" byte_order=\"" FLUID_BYTE_ORDER "\">\n");
+  fprintf(file, "  <Collection>\n");
+  for (size_t i = 0; i < collection.size(); i++)
+    fprintf(file, "    <DataSet timestep=\"%.17g\" group=\"\" part=\"0\" file=\"%s\"/>\n", collection[i].first, collection[i].second.c_str());
+  fprintf(file, "  </Collection>\n");
+  fprintf(file, "</VTKFile>\n");
+  fclose(file);
+}
+
+/*
+   Entries of an existing .pvd for the files prefix_<index>.vtu with index < resume that
+   still exist, the collection of a resumed run
+*/
+static void readPvd(const std::string& prefix, const std::string& directory, int resume,
+                    std::vector<std::pair<double, std::string> >& collection)
+{
+  std::ifstream file(prefix + ".pvd");
+  std::string base = prefix.substr(directory.size()) + "_";
+  std::string line;
+  while (std::getline(file, line)) {
+    double t;
+    char name[1024];
+    std::string::size_type element = line.find("<DataSet ");
+    if (element == std::string::npos ||
+        sscanf(line.c_str() + element, "<DataSet timestep=\"%lf\" group=\"\" part=\"0\" file=\"%1023[^\"]\"", &t, name) != 2)
+      continue;
+
+    std::string filename(name);
+    char* end;
+    long index = strtol(filename.c_str() + std::min(base.size(), filename.size()), &end, 10);
+    if (filename.compare(0, base.size(), base) != 0 || strcmp(end, ".vtu") != 0 || index < 0 || index >= resume)
+      continue;
+    if (access((directory + filename).c_str(), F_OK) == 0)
+      collection.push_back(std::make_pair(t, filename));
+  }
+}
+
+/* Background writer */
+
+static std::string snapshotFile(const FluidOutput& output, int index)
+{
+  if (output.format == FLUID_OUTPUT_SERIES)
+    return output.tubePath;
+  return output.prefix + "_" + std::to_string(index) + (output.format == FLUID_OUTPUT_VTU ? ".vtu" : ".vtk");
+}
+
+static void writerLoop(FluidOutput* output)
+{
+  VtuMesh mesh;
+  std::vector<double> vectorScratch;
+  if (output->format == FLUID_OUTPUT_VTU)
+    buildMesh(mesh, output->points, output->grid, output->segments);
+
+  // The .pvd refers to the files relative to its own directory
+  std::string::size_type slash = output->prefix.rfind('/');
+  std::string directory = slash == std::string::npos ? "" : output->prefix.substr(0, slash + 1);
+
+  std::unique_lock<std::mutex> lock(output->mutex);
+  while (1) {
+    output->changed.wait(lock, [output] { return output->written < output->submitted || output->closing; });
+    if (output->written == output->submitted)
+      break;
+
+    // The snapshot is not touched by fluid_output_write() until written is incremented
+    const FluidSnapshot& snapshot = output->snapshots[output->written % 2];
+    lock.unlock();
+
+    std::string filename = snapshotFile(*output, snapshot.index);
+    if (output->format == FLUID_OUTPUT_VTU) {
+      writeVtu(filename, mesh, output->points, snapshot, vectorScratch);
+      output->collection.push_back(std::make_pair(snapshot.t, filename.substr(directory.size())));
+      writePvd(output->prefix + ".pvd", output->collection);
+    } else if (output->format == FLUID_OUTPUT_SERIES) {
+      if (output->tube.file)
+        fluid_series_append(output->tube, snapshot.t, snapshot.velocity, snapshot.pressure, snapshot.diameter);
+    } else {
+      // same as write_vtk(), which leaves out the last point
+      writeLegacy(filename, output->points - 1, output->grid, snapshot.velocity, snapshot.pressure, snapshot.diameter);
+    }
+
+    lock.lock();
+    output->written++;
+    output->changed.notify_all();
+  }
+}
+
+void fluid_output_open(FluidOutput& output, const char* prefix, FluidOutputFormat format, int N, const double* grid,
+                       const std::vector<int>* segments, int resume)
+{
+  output.prefix = prefix;
+  output.segments.clear();
+  if (segments)
+    output.segments = *segments;
+  output.format = format;
+  output.points = N + 1;
+  output.grid = fluid_alloc<double>(2 * (N + 1));
+  memcpy(output.grid, grid, 2 * (N + 1) * sizeof(double));
+
+  for (int s = 0; s < 2; s++) {
+    output.snapshots[s].velocity = fluid_alloc<double>(N + 1);
+    output.snapshots[s].pressure = fluid_alloc<double>(N + 1);
+    output.snapshots[s].diameter = fluid_alloc<double>(N + 1);
+  }
+  output.submitted = 0;
+  output.written = 0;
+  output.closing = false;
+  output.collection.clear();
+  output.tube.file = NULL;
+  output.tubePath = output.prefix + ".tube";
+
+  // A resumed run continues the output of the windows before the restart
+  if (resume > 0 && format == FLUID_OUTPUT_VTU) {
+    std::string::size_type slash = output.prefix.rfind('/');
+    readPvd(output.prefix, slash == std::string::npos ? "" : output.prefix.substr(0, slash + 1), resume,
+            output.collection);
+  }
+  if (format == FLUID_OUTPUT_SERIES) {
+    bool resumed = resume > 0 && fluid_series_resume(output.tube, output.tubePath.c_str(), N, resume);
+    if (resume > 0 && !resumed && access(output.tubePath.c_str(), F_OK) == 0) {
+      output.tubePath = output.prefix + "_" + std::to_string(resume) + ".tube";
+      printf("Writing the time steps after window %d to %s\n", resume, output.tubePath.c_str());
+    }
+    if (!resumed)
+      fluid_series_create(output.tube, output.tubePath.c_str(), N, grid);
+  }
+
+  output.writer = std::thread(writerLoop, &output);
+}
+
+void fluid_output_write(FluidOutput& output, double t, int index,
+                        const double* velocity, const double* pressure, const double* diameter)
+{
+  printf("writing timestep at t=%f to %s\n", t, snapshotFile(output, index).c_str());
+
+  // Wait for a free snapshot, only if the writer is two time steps behind
+  std::unique_lock<std::mutex> lock(output.mutex);
+  output.changed.wait(lock, [&output] { return output.submitted - output.written < 2; });
+  FluidSnapshot& snapshot = output.snapshots[output.submitted % 2];
+  lock.unlock();
+
+  size_t bytes = output.points * sizeof(double);
+  snapshot.t = t;
+  snapshot.index = index;
+  memcpy(snapshot.velocity, velocity, bytes);
+  memcpy(snapshot.pressure, pressure, bytes);
+  memcpy(snapshot.diameter, diameter, bytes);
+
+  lock.lock();
+  output.submitted++;
+  output.changed.notify_all();
+}
+
+void fluid_output_close(FluidOutput& output)
+{
+  {
+    std::lock_guard<std::mutex> lock(output.mutex);
+    output.closing = true;
+    output.changed.notify_all();
+  }
+  output.writer.join();
+  fluid_series_finish(output.tube);
+
+  fluid_free(output.grid);
+  for (int s = 0; s < 2; s++) {
+    fluid_free(output.snapshots[s].velocity);
+    fluid_free(output.snapshots[s].pressure);
+    fluid_free(output.snapshots[s].diameter);
+  }
+}
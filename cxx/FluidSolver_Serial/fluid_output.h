@@ -0,0 +1,83 @@
+#ifndef FLUID_OUTPUT_H_
+#define FLUID_OUTPUT_H_
+
+#include "../FluidSolver_Common/fluid_options.h"
+#include "fluid_series.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+   Output of the time steps of the serial solvers. fluid_output_write() only copies the
+   state into one of two snapshot buffers and returns, a writer thread writes the files
+   in the background. The solver only waits if both buffers are still being written.
+
+   The default format writes prefix_<index>.vtu as XML unstructured grid of all N+1 points
+   and N line cells with the arrays as raw binary appended data (Float64), and
+   prefix.pvd, which lists all written files with their time for ParaView. It is
+   rewritten after every file, so it is valid while the simulation is running.
+   FLUID_OUTPUT_VTK writes the ASCII legacy files prefix_<index>.vtk of write_vtk()
+   instead, FLUID_OUTPUT_SERIES appends all time steps to the single file prefix.tube.
+*/
+
+struct FluidSnapshot {
+  double t;
+  int index;
+  double* velocity;
+  double* pressure;
+  double* diameter;
+};
+
+struct FluidOutput {
+  std::string prefix;
+  FluidOutputFormat format;
+  int points;   // N+1
+  double* grid; // x,y of all points
+  std::vector<int> segments; // first point of every segment of a network, the tube is not connected before it
+
+  FluidSnapshot snapshots[2]; // snapshot seq is stored in snapshots[seq % 2]
+  long submitted;             // snapshots handed to the writer
+  long written;               // snapshots written
+  bool closing;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread writer;
+
+  std::vector<std::pair<double, std::string> > collection; // time and file of the .pvd, writer thread only
+  FluidSeriesWriter tube;                                  // FLUID_OUTPUT_SERIES
+  std::string tubePath;                                    // file of tube, prefix.tube unless it cannot be resumed
+};
+
+/*
+   Starts the writer thread for N mesh elements, grid holds x,y of the N+1 points. The
+   points of a network are the segments one after the other, segments lists the first
+   point of every segment, see fluid_network_grid().
+   A run resumed after the time window resume > 0 keeps the output of the windows before
+   it: the .pvd lists the files prefix_<index>.vtu with index < resume of the previous
+   .pvd, prefix.tube is truncated to resume time steps. If prefix.tube cannot be resumed,
+   the new time steps go to prefix_<resume>.tube instead of overwriting it.
+*/
+void fluid_output_open(FluidOutput& output, const char* prefix, FluidOutputFormat format, int N, const double* grid,
+                       const std::vector<int>* segments = NULL, int resume = 0);
+
+/* Hands the state of time t over to the writer, index numbers the files */
+void fluid_output_write(FluidOutput& output, double t, int index,
+                        const double* velocity, const double* pressure, const double* diameter);
+
+/* Writes all pending snapshots and stops the writer thread */
+void fluid_output_close(FluidOutput& output);
+
+/* Writes filename_prefix_<iteration>.vtk synchronously in the ASCII legacy format */
+void write_vtk(double t,
+               int iteration,
+               const char* filename_prefix,
+               int N_slices,
+               double* grid,
+               double* velocity,
+               double* pressure,
+               double* diameter);
+
+#endif
@@ -0,0 +1,173 @@
+#include "fluid_series.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* fieldNames[FLUID_SERIES_FIELDS] = {"velocity", "pressure", "diameter"};
+
+static size_t gridOffset()
+{
+  return sizeof(FluidSeriesHeader);
+}
+
+static size_t recordsOffset(long points)
+{
+  return sizeof(FluidSeriesHeader) + 2 * points * sizeof(double);
+}
+
+bool fluid_series_create(FluidSeriesWriter& writer, const char* path, int N, const double* grid)
+{
+  writer.points = N + 1;
+  writer.steps = 0;
+  writer.file = fopen(path, "wb");
+  if (!writer.file) {
+    printf("Cannot write %s\n", path);
+    return false;
+  }
+
+  FluidSeriesHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FLUID_SERIES_MAGIC, sizeof(header.magic));
+  header.version = FLUID_SERIES_VERSION;
+  header.fields = FLUID_SERIES_FIELDS;
+  header.points = writer.points;
+  header.steps = 0;
+  for (int f = 0; f < FLUID_SERIES_FIELDS; f++)
+    strncpy(header.names[f], fieldNames[f], sizeof(header.names[f]) - 1);
+
+  fwrite(&header, sizeof(header), 1, writer.file);
+  fwrite(grid, sizeof(double), 2 * writer.points, writer.file);
+  fflush(writer.file);
+  return true;
+}
+
+bool fluid_series_resume(FluidSeriesWriter& writer, const char* path, int N, long steps)
+{
+  writer.points = N + 1;
+  writer.steps = steps;
+  writer.file = fopen(path, "r+b");
+  if (!writer.file) {
+    printf("Cannot open %s\n", path);
+    return false;
+  }
+
+  FluidSeriesHeader header;
+  size_t recordBytes = (1 + FLUID_SERIES_FIELDS * writer.points) * sizeof(double);
+  struct stat status;
+  bool valid = fread(&header, sizeof(header), 1, writer.file) == 1 && fstat(fileno(writer.file), &status) == 0 &&
+               memcmp(header.magic, FLUID_SERIES_MAGIC, sizeof(header.magic)) == 0 &&
+               header.version == FLUID_SERIES_VERSION && header.fields == FLUID_SERIES_FIELDS &&
+               (long)header.points == writer.points;
+  if (!valid) {
+    printf("%s is not a tube series of version %d with %ld points\n", path, FLUID_SERIES_VERSION, writer.points);
+    fluid_series_finish(writer);
+    return false;
+  }
+  size_t bytes = recordsOffset(writer.points) + steps * recordBytes;
+  if ((long)header.steps < steps || (size_t)status.st_size < bytes) {
+    printf("%s holds fewer than %ld time steps\n", path, steps);
+    fluid_series_finish(writer);
+    return false;
+  }
+
+  // drop the records after the restart, then publish the new number of steps
+  fflush(writer.file);
+  if (ftruncate(fileno(writer.file), bytes) != 0) {
+    printf("Cannot truncate %s\n", path);
+    fluid_series_finish(writer);
+    return false;
+  }
+  uint64_t published = steps;
+  fseek(writer.file, offsetof(FluidSeriesHeader, steps), SEEK_SET);
+  fwrite(&published, sizeof(published), 1, writer.file);
+  fflush(writer.file);
+  fseek(writer.file, 0, SEEK_END);
+  return true;
+}
+
+void fluid_series_append(FluidSeriesWriter& writer, double t,
+                         const double* velocity, const double* pressure, const double* diameter)
+{
+  fwrite(&t, sizeof(double), 1, writer.file);
+  fwrite(velocity, sizeof(double), writer.points, writer.file);
+  fwrite(pressure, sizeof(double), writer.points, writer.file);
+  fwrite(diameter, sizeof(double), writer.points, writer.file);
+  fflush(writer.file);
+
+  // publish the record only after it is complete
+  uint64_t steps = ++writer.steps;
+  fseek(writer.file, offsetof(FluidSeriesHeader, steps), SEEK_SET);
+  fwrite(&steps, sizeof(steps), 1, writer.file);
+  fflush(writer.file);
+  fseek(writer.file, 0, SEEK_END);
+}
+
+void fluid_series_finish(FluidSeriesWriter& writer)
+{
+  if (writer.file)
+    fclose(writer.file);
+  writer.file = NULL;
+}
+
+bool fluid_series_open(FluidSeries& series, const char* path)
+{
+  series.map = NULL;
+  series.bytes = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("Cannot open %s\n", path);
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(FluidSeriesHeader)) {
+    printf("%s is not a tube series\n", path);
+    close(fd);
+    return false;
+  }
+  series.bytes = status.st_size;
+  series.map = mmap(NULL, series.bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (series.map == MAP_FAILED) {
+    printf("Cannot map %s\n", path);
+    series.map = NULL;
+    return false;
+  }
+
+  const FluidSeriesHeader* header = (const FluidSeriesHeader*)series.map;
+  if (memcmp(header->magic, FLUID_SERIES_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != FLUID_SERIES_VERSION || header->fields != FLUID_SERIES_FIELDS ||
+      recordsOffset(header->points) > series.bytes) {
+    printf("%s is not a tube series of version %d\n", path, FLUID_SERIES_VERSION);
+    fluid_series_close(series);
+    return false;
+  }
+
+  series.points = header->points;
+  series.grid = (const double*)((const char*)series.map + gridOffset());
+  series.records = (const double*)((const char*)series.map + recordsOffset(series.points));
+
+  // a record may be written while the file is mapped, use complete and published records only
+  size_t recordBytes = (1 + FLUID_SERIES_FIELDS * series.points) * sizeof(double);
+  long complete = (series.bytes - recordsOffset(series.points)) / recordBytes;
+  series.steps = (long)header->steps < complete ? (long)header->steps : complete;
+  return true;
+}
+
+void fluid_series_close(FluidSeries& series)
+{
+  if (series.map)
+    munmap(series.map, series.bytes);
+  series.map = NULL;
+}
+
+int fluid_series_field_index(const char* name)
+{
+  for (int f = 0; f < FLUID_SERIES_FIELDS; f++) {
+    if (strcmp(name, fieldNames[f]) == 0)
+      return f;
+  }
+  return -1;
+}
@@ -0,0 +1,92 @@
+#ifndef FLUID_SERIES_H_
+#define FLUID_SERIES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+   Time series of the tube in a single binary file (prefix.tube), written by the serial
+   solvers with --output=series. All values are stored in native byte order (little
+   endian on x86), the layout is
+
+     FluidSeriesHeader                      80 bytes
+     grid        double[2 * points]         x,y of all points
+     record 0    double t, double velocity[points], pressure[points], diameter[points]
+     record 1    ...
+
+   so a field of all time steps is a strided array that can be read through mmap without
+   parsing, e.g. as numpy.memmap (see Postproc/fluid_series.py). Records are appended
+   while the solver runs and steps in the header is updated after every record, a
+   reader only uses the first steps records.
+*/
+
+#define FLUID_SERIES_MAGIC "TUBESERI"
+#define FLUID_SERIES_VERSION 1
+#define FLUID_SERIES_FIELDS 3
+
+struct FluidSeriesHeader {
+  char magic[8];     // FLUID_SERIES_MAGIC, not null-terminated
+  uint32_t version;  // FLUID_SERIES_VERSION
+  uint32_t fields;   // FLUID_SERIES_FIELDS
+  uint64_t points;   // N+1
+  uint64_t steps;    // complete records
+  char names[FLUID_SERIES_FIELDS][16]; // "velocity", "pressure", "diameter"
+};
+
+/* Writer */
+
+struct FluidSeriesWriter {
+  FILE* file;
+  long points;
+  long steps;
+};
+
+/* Creates path with the header and the grid (x,y of the N+1 points), false on error */
+bool fluid_series_create(FluidSeriesWriter& writer, const char* path, int N, const double* grid);
+
+/*
+   Reopens the series path of N elements to continue it after its first steps records,
+   the records after them are removed, e.g. of a run that is resumed from a restart file.
+   Prints a message and returns false if path is no such series or has fewer records.
+*/
+bool fluid_series_resume(FluidSeriesWriter& writer, const char* path, int N, long steps);
+
+/* Appends the record of time t and publishes it in the header */
+void fluid_series_append(FluidSeriesWriter& writer, double t,
+                         const double* velocity, const double* pressure, const double* diameter);
+
+/* Closes the file, the series stays readable */
+void fluid_series_finish(FluidSeriesWriter& writer);
+
+/* Reader */
+
+struct FluidSeries {
+  void* map;
+  size_t bytes;
+  long points;
+  long steps;
+  const double* grid;    // x,y of all points
+  const double* records; // steps records of 1 + FLUID_SERIES_FIELDS * points values
+};
+
+/* Maps a series file, prints a message and returns false on error */
+bool fluid_series_open(FluidSeries& series, const char* path);
+
+void fluid_series_close(FluidSeries& series);
+
+/* Index of the field with the given name, -1 if there is none */
+int fluid_series_field_index(const char* name);
+
+inline double fluid_series_time(const FluidSeries& series, long step)
+{
+  return series.records[step * (1 + FLUID_SERIES_FIELDS * series.points)];
+}
+
+/* points values of one field at one step */
+inline const double* fluid_series_field(const FluidSeries& series, long step, int field)
+{
+  return series.records + step * (1 + FLUID_SERIES_FIELDS * series.points) + 1 + field * series.points;
+}
+
+#endif
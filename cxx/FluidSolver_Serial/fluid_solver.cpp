@@ -1,7 +1,10 @@
 #include "fluid_nl.h"
+#include "../Common/elastictube_mesh.h"
 #include "precice/SolverInterface.hpp"
+#include <cmath>
 #include <iostream>
 #include <stdlib.h>
+#include <vector>
 
 using std::cout;
 using std::endl;
@@ -13,22 +16,55 @@ int main(int argc, char** argv)
 {
   cout << "Starting Fluid Solver..." << endl;
 
-  if (argc != 5) {
+  FluidOptions options;
+  if (argc < 5 || !fluid_options_parse(options, argc, argv, 5)) {
     cout << endl;
-    cout << "Usage: " << argv[0] << " configurationFileName N tau kappa" << endl;
+    cout << "Usage: " << argv[0] << " configurationFileName N tau kappa [options]" << endl;
     cout << endl;
     cout << "N:     Number of mesh elements." << endl;
     cout << "tau:   Dimensionless time step size." << endl;
     cout << "kappa: Dimensionless structural stiffness." << endl;
+    fluid_options_usage();
     return -1;
   }
 
+  // With a prescribed crossSectionLength, the fluid alone has no pressure waves to advance explicitly
+  if (options.engine == FLUID_ENGINE_EXPLICIT) {
+    cout << "--engine=explicit is only available in the MonolithicSolver." << endl;
+    return -1;
+  }
+
+  // The relaxed tolerance and the predictor follow the coupling iterations, which the subcycling interleaves
+  if (options.dtTol > 0.0 && (options.couplingForcing > 0.0 || options.predictor != FLUID_PREDICTOR_NONE)) {
+    cout << "--coupling-forcing and --predictor cannot be combined with --dt-tol." << endl;
+    return -1;
+  }
+
+  // The coupling mesh of preCICE is fixed at initialization
+  if (options.refine > 0) {
+    cout << "--refine is only available in the MonolithicSolver." << endl;
+    return -1;
+  }
+
+  TRACE_BEGIN("FLUID", 0);
+
   std::string configFileName(argv[1]);
   int N = atoi(argv[2]);
   double tau = atof(argv[3]);
   double kappa = atof(argv[4]);
 
   std::cout << "N: " << N << " tau: " << tau << " kappa: " << kappa << std::endl;
+  std::cout << "Assembly kernel: " << fluid_kernel_isa() << std::endl;
+
+  // node positions, see elastictube_mesh.h, from here on N counts the elements of the mesh
+  TubeMesh mesh;
+  tube_mesh_uniform(mesh, N);
+  if (!options.mesh.empty()) {
+    if (!tube_mesh_read(mesh, options.mesh.c_str(), N))
+      return -1;
+    N = mesh.elements;
+    std::cout << "Mesh: " << N << " elements from " << options.mesh << std::endl;
+  }
 
   std::string solverName = "FLUID";
   
@@ -39,16 +75,11 @@ int main(int argc, char** argv)
   SolverInterface interface(solverName, configFileName, 0, 1);
 
   int i;
-  double *velocity, *velocity_n, *pressure, *pressure_n, *crossSectionLength, *crossSectionLength_n;
-  
   int dimensions = interface.getDimensions();
 
-  velocity             = new double[N + 1];
-  velocity_n           = new double[N + 1];
-  pressure             = new double[N + 1]; 
-  pressure_n           = new double[N + 1];
-  crossSectionLength   = new double[N + 1];
-  crossSectionLength_n = new double[N + 1];
+  // velocity, pressure and crossSectionLength at the current and the previous time level
+  TubeState state;
+  tube_state_allocate(state, N + 1);
 
   // get IDs from preCICE
   int meshID               = interface.getMeshID("Fluid_Nodes");
@@ -61,87 +92,193 @@ int main(int argc, char** argv)
   grid = new double[dimensions * (N + 1)];
 
   // init data values and mesh
-  for (i = 0; i <= N; i++) {
-    velocity[i]             = 1.0 / (kappa * 1.0);
-    velocity_n[i]           = 1.0 / (kappa * 1.0);
-    crossSectionLength[i]   = 1.0;
-    crossSectionLength_n[i] = 1.0;
-    pressure[i]             = 0.0;
-    pressure_n[i]           = 0.0;
-    
-    for (int dim = 0; dim < dimensions; dim++)
-      grid[i * dimensions + dim] = i * (1 - dim);
-  }
+  tube_state_fill(state, 1.0 / (kappa * 1.0), 0.0, 1.0);
+  tube_mesh_grid(mesh, grid, dimensions);
 
   double t = 0.0; // time
-  double dt = 0.01; // solver timestep size
+  double dt = 0.01; // time window size, set by preCICE
+  int out_counter = 0; // completed time windows
+
+  // resume after a completed time window, see elastictube_restart.h
+  const char* restartNames[3] = {"velocity", "pressure", "crossSection"};
+  if (options.restart.window >= 0) {
+    std::string path = tube_restart_path(options.restart, "FLUID", options.restart.window);
+    double* restartFields[3] = {state.current.velocity, state.current.pressure, state.current.crossSectionLength};
+    if (!tube_restart_read(path.c_str(), "FLUID", N + 1, 3, restartNames, restartFields, out_counter, t))
+      return -1;
+    tube_state_advance(state);
+    cout << "Resuming after time window " << out_counter << " at t = " << t << endl;
+  }
 
   // tell preCICE about your coupling interface mesh
   interface.setMeshVertices(meshID, N + 1, grid, vertexIDs);
 
   cout << "Initialize preCICE..." << endl;
-  interface.initialize();
+  dt = interface.initialize();
   
   // write initial data if required
   if (interface.isActionRequired(actionWriteInitialData())) {
-    interface.writeBlockScalarData(pressureID, N + 1, vertexIDs, pressure);
+    interface.writeBlockScalarData(pressureID, N + 1, vertexIDs, tube_state_iterate(state).pressure);
     interface.markActionFulfilled(actionWriteInitialData());
   }
 
   // initial data is sent or received if necessary
   interface.initializeData();
 
+  // with --dt-tol, every time window is subcycled in steps sized by the error estimate (see fluid_timestep.h),
+  // crossSectionLength is interpolated from the start of the window to the coupled value at its end
+  bool adaptive = options.dtTol > 0.0;
+  FluidStepControl control;
+  std::vector<double> checkpoint, crossSectionLength_coupled;
+  double remaining = dt;  // time to the end of the window
+  double tWindow = t;     // start of the window
+  bool windowStart = true; // the next substep starts a time window
+  if (adaptive) {
+    fluid_step_allocate(control, N, options, dt);
+    checkpoint.resize(3 * (N + 1));
+    crossSectionLength_coupled.assign(tube_state_iterate(state).crossSectionLength, tube_state_iterate(state).crossSectionLength + N + 1);
+  }
+  double* crossSectionLength_read = adaptive ? crossSectionLength_coupled.data() : tube_state_iterate(state).crossSectionLength;
+
   // read data if available
   if (interface.isReadDataAvailable()) {
-    interface.readBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength);
+    interface.readBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength_read);
   }
-  int out_counter = 0;  
+  int iteration = 0; // coupling iteration within the time window
+
+  // crossSectionLength of the previous fluid solve, the coupling residual relaxes its tolerance
+  double* crossSectionLength_previous = new double[N + 1];
+  for (i = 0; i <= N; i++)
+    crossSectionLength_previous[i] = tube_state_iterate(state).crossSectionLength[i];
+
+  // solver scratch buffers, reused by all time steps
+  FluidWorkspace workspace;
+  fluid_workspace_allocate(workspace, N, options);
+  workspace.mesh = &mesh;
+
+  // time steps are written by a background thread
+  FluidOutput output;
+  fluid_output_open(output, outputFilePrefix.c_str(), options.output, N, grid, NULL, out_counter);
   
   while (interface.isCouplingOngoing()) {
-    // for an implicit coupling, you can store an iteration checkpoint here (from the first iteration of a timestep)
-    // this is, however, not necessary for this scenario
-    if (interface.isActionRequired(actionWriteIterationCheckpoint())) {
+    TRACE_WINDOW(out_counter, iteration);
+
+    // for an implicit coupling, the iteration checkpoint is the previous level of state, which the coupling
+    // iterations of the window do not modify (see fluid_state.h)
+    if (interface.isActionRequired(actionWriteIterationCheckpoint()))
       interface.markActionFulfilled(actionWriteIterationCheckpoint());
+
+    // the substeps interpolate crossSectionLength from the start of the window, for every coupling scheme,
+    // an implicit coupling also restarts its iterations from there
+    if (adaptive && windowStart) {
+      const TubeFields& start = tube_state_iterate(state);
+      for (i = 0; i <= N; i++) {
+        checkpoint[i] = start.velocity[i];
+        checkpoint[N + 1 + i] = start.pressure[i];
+        checkpoint[2 * N + 2 + i] = start.crossSectionLength[i];
+      }
+      fluid_step_checkpoint(control);
+      tWindow = t;
+      windowStart = false;
+    }
+
+    double h = dt;
+    if (adaptive) {
+      // equal substeps to the end of the window
+      TRACE_SCOPE("fluid_nl");
+      h = remaining / std::ceil(remaining / control.h - 1e-9);
+      double fraction = 1.0 - (remaining - h) / dt; // of the window at the end of the substep
+      tube_state_settle(state);
+      for (i = 0; i <= N; i++) {
+        double start = checkpoint[2 * N + 2 + i];
+        state.current.crossSectionLength[i] = start + fraction * (crossSectionLength_coupled[i] - start);
+      }
+      fluid_nl(state, t + h, N, kappa, tau * h / dt, workspace, options, options.newtonRtol);
+      fluid_step_control(control, state, h, false);
+    } else {
+      TRACE_SCOPE("fluid_nl");
+      const double* crossSectionLength = tube_state_iterate(state).crossSectionLength;
+      double rtol = fluid_coupling_tolerance(options, crossSectionLength, crossSectionLength_previous, N);
+      for (i = 0; i <= N; i++)
+        crossSectionLength_previous[i] = crossSectionLength[i];
+      fluid_nl(state, t + h, N, kappa, tau, workspace, options, rtol);
     }
-    
-    fluid_nl(crossSectionLength, crossSectionLength_n,  
-	     velocity, velocity_n,                      
-	     pressure, pressure_n,            
-	     t, N, kappa, tau); 
-    
+
     // write pressure data to precice
-    interface.writeBlockScalarData(pressureID, N + 1, vertexIDs, pressure);
-    
-    interface.advance(dt);
-    
-    // read crossSectionLength data from precice
-    interface.readBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength);
+    {
+      TRACE_SCOPE("writeBlockScalarData");
+      interface.writeBlockScalarData(pressureID, N + 1, vertexIDs, state.current.pressure);
+    }
+
+    {
+      TRACE_SCOPE("advance");
+      remaining = interface.advance(h);
+    }
 
     // set variables back to checkpoint
     if (interface.isActionRequired(actionReadIterationCheckpoint())) { 
-    // i.e. not yet converged, you could restore a checkpoint here (not necessary for this scenario)      
+    // i.e. not yet converged, t and the previous level stay at the checkpoint, the last solution is the
+    // initial guess of the next coupling iteration
       interface.markActionFulfilled(actionReadIterationCheckpoint());
+      iteration++;
+      if (adaptive) {
+        // the substeps moved the previous level, back to the start of the window
+        for (i = 0; i <= N; i++) {
+          state.previous.velocity[i] = checkpoint[i];
+          state.previous.pressure[i] = checkpoint[N + 1 + i];
+          state.previous.crossSectionLength[i] = checkpoint[2 * N + 2 + i];
+        }
+        fluid_step_restore(control);
+        t = tWindow;
+      }
     }
     else{
-      t += dt;
-      for (i = 0; i <= N; i++) {
-        velocity_n[i]           = velocity[i];
-        pressure_n[i]           = pressure[i];
-        crossSectionLength_n[i] = crossSectionLength[i];
-      }      
-      write_vtk(t, out_counter, outputFilePrefix.c_str(), N, grid, velocity_n, pressure_n, crossSectionLength_n);
+      t += h;
+      tube_state_advance(state);
+      if (!adaptive || interface.isTimeWindowComplete()) {
+        iteration = 0;
+        windowStart = true;
+      }
+    }
+
+    // read crossSectionLength data from precice, after a time advance it starts both levels
+    if (!adaptive)
+      crossSectionLength_read = tube_state_iterate(state).crossSectionLength;
+    {
+      TRACE_SCOPE("readBlockScalarData");
+      interface.readBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength_read);
+    }
+
+    if (state.advanced && (!adaptive || interface.isTimeWindowComplete())) {
+      TRACE_SCOPE("fluid_output_write");
+      fluid_output_write(output, t, out_counter, state.previous.velocity, state.previous.pressure,
+                         state.previous.crossSectionLength);
       out_counter++;
     }
+
+    if (state.advanced && (!adaptive || interface.isTimeWindowComplete()) && tube_restart_due(options.restart, out_counter)) {
+      TRACE_SCOPE("restart");
+      std::string path = tube_restart_path(options.restart, "FLUID", out_counter);
+      const double* restartFields[3] = {state.previous.velocity, state.previous.pressure, state.previous.crossSectionLength};
+      tube_restart_write(path.c_str(), "FLUID", out_counter, t, N + 1, 3, restartNames, restartFields);
+    }
   }
 
   interface.finalize();
+  TRACE_END();
+
+  if (adaptive) {
+    cout << "Time steps: " << control.accepted << " in " << out_counter << " time windows" << endl;
+    fluid_step_free(control);
+  }
+  if (workspace.profile.unconverged > 0)
+    cout << "Nonlinear Solver not converged in " << workspace.profile.unconverged << " of "
+         << workspace.profile.calls << " calls" << endl;
 
-  delete [] velocity;
-  delete [] velocity_n;
-  delete [] pressure;
-  delete [] pressure_n;
-  delete [] crossSectionLength;
-  delete [] crossSectionLength_n;
+  fluid_output_close(output);
+  fluid_workspace_free(workspace);
+  tube_state_free(state);
+  delete [] crossSectionLength_previous;
   delete [] vertexIDs;
   delete [] grid;
 
@@ -0,0 +1,217 @@
+#include "../FluidSolver_Serial/fluid_nl.h"
+#include "../Common/elastictube_mesh.h"
+#include "../FluidSolver_Common/fluid_refine.h"
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+
+using std::cout;
+using std::endl;
+
+/*
+   Moves the solution of the last time window, the workspace and the step size control to
+   the adapted mesh, see fluid_refine.h. The predictor history of the workspace starts anew.
+*/
+static void remesh(TubeMesh& mesh, const TubeMesh& adapted, TubeState& state, FluidWorkspace& workspace,
+                   const FluidOptions& options, FluidStepControl* control)
+{
+  TubeState moved;
+  tube_state_allocate(moved, adapted.elements + 1);
+  tube_mesh_interpolate(mesh, state.previous.velocity, adapted, moved.current.velocity);
+  tube_mesh_interpolate(mesh, state.previous.pressure, adapted, moved.current.pressure);
+  tube_mesh_interpolate(mesh, state.previous.crossSectionLength, adapted, moved.current.crossSectionLength);
+  tube_state_advance(moved);
+  tube_state_free(state);
+  state = moved;
+
+  FluidProfile profile = workspace.profile;
+  fluid_workspace_free(workspace);
+  fluid_workspace_allocate(workspace, adapted.elements, options);
+  workspace.profile = profile;
+
+  if (control)
+    fluid_step_remesh(*control, mesh, adapted);
+  mesh = adapted;
+  workspace.mesh = &mesh;
+}
+
+/*
+   Fluid and structure of the elastic tube in one process. The structure is the tube law
+   A = 4/(2-p)^2, which fluid_nl_monolithic() substitutes into the Newton iteration of the
+   fluid, so every time step is a single Newton solve without coupling iterations. The
+   time stepping and the output match the partitioned run of FluidSolver and
+   StructureSolver with precice-config.xml.
+*/
+int main(int argc, char** argv)
+{
+  cout << "Starting Monolithic Solver..." << endl;
+
+  FluidOptions options;
+  if (argc < 4 || !fluid_options_parse(options, argc, argv, 4)) {
+    cout << endl;
+    cout << "Usage: " << argv[0] << " N tau kappa [options]" << endl;
+    cout << endl;
+    cout << "N:     Number of mesh elements." << endl;
+    cout << "tau:   Dimensionless time step size." << endl;
+    cout << "kappa: Dimensionless structural stiffness." << endl;
+    fluid_options_usage();
+    return -1;
+  }
+
+  if (options.engine == FLUID_ENGINE_JFNK) {
+    cout << "--engine=jfnk is only available in the partitioned fluid solver." << endl;
+    return -1;
+  }
+
+  int N = atoi(argv[1]);
+  double tau = atof(argv[2]);
+  double kappa = atof(argv[3]);
+
+  std::cout << "N: " << N << " tau: " << tau << " kappa: " << kappa << std::endl;
+
+  // node positions, see elastictube_mesh.h
+  TubeMesh mesh;
+  tube_mesh_uniform(mesh, N);
+  if (!options.mesh.empty()) {
+    if (!tube_mesh_read(mesh, options.mesh.c_str(), N))
+      return -1;
+    std::cout << "Mesh: " << mesh.elements << " elements from " << options.mesh << std::endl;
+  }
+
+  // the adaptive mesh starts from the uniform mesh, see fluid_refine.h
+  if (options.refine > 0 && !fluid_refine_valid(N, options.refine)) {
+    cout << "--refine=" << options.refine << " needs N to be a multiple of " << (1 << options.refine)
+         << " and at least " << (2 << options.refine) << "." << endl;
+    return -1;
+  }
+  if (options.refine > 0 && (options.restart.window >= 0 || options.restart.interval > 0)) {
+    cout << "--refine cannot be combined with restart files." << endl;
+    return -1;
+  }
+
+  TRACE_BEGIN("MONOLITHIC", 0);
+  std::cout << "Assembly kernel: " << fluid_kernel_isa() << std::endl;
+
+  std::string outputFilePrefix = "Postproc/out_monolithic";
+
+  int dimensions = 2;
+
+  // velocity, pressure and crossSectionLength at the current and the previous time level
+  TubeState state;
+  tube_state_allocate(state, mesh.elements + 1);
+
+  // the output of the adaptive mesh stays on the uniform reference mesh
+  double* grid;
+  grid = new double[dimensions * (mesh.elements + 1)];
+
+  // init data values and mesh
+  tube_state_fill(state, 1.0 / (kappa * 1.0), 0.0, 1.0);
+  tube_mesh_grid(mesh, grid, dimensions);
+  TubeMesh reference = mesh;
+  double* interpolated = options.refine > 0 ? new double[3 * (N + 1)] : NULL;
+  long elementWindows = 0;
+  int maxElements = 0;
+
+  double t = 0.0;          // time
+  double dt = 0.01;        // time step size, time-window-size of precice-config.xml
+  int timeSteps = 100;     // max-time of precice-config.xml is 1.0
+  int out_counter = 0;
+
+  // resume after a completed time window, see elastictube_restart.h
+  const char* restartNames[3] = {"velocity", "pressure", "crossSection"};
+  if (options.restart.window >= 0) {
+    std::string path = tube_restart_path(options.restart, "MONOLITHIC", options.restart.window);
+    double* restartFields[3] = {state.current.velocity, state.current.pressure, state.current.crossSectionLength};
+    if (!tube_restart_read(path.c_str(), "MONOLITHIC", mesh.elements + 1, 3, restartNames, restartFields, out_counter, t))
+      return -1;
+    tube_state_advance(state);
+    std::cout << "Resuming after time window " << out_counter << " at t = " << t << std::endl;
+  }
+
+  // solver scratch buffers, reused by all time steps
+  FluidWorkspace workspace;
+  fluid_workspace_allocate(workspace, mesh.elements, options);
+  workspace.mesh = &mesh;
+
+  // time steps are written by a background thread
+  FluidOutput output;
+  fluid_output_open(output, outputFilePrefix.c_str(), options.output, reference.elements, grid, NULL, out_counter);
+
+  // with --dt-tol, the steps are sized by the error estimate, tau scales with the step size
+  bool adaptive = options.dtTol > 0.0;
+  double tEnd = timeSteps * dt;
+  FluidStepControl control;
+  if (adaptive)
+    fluid_step_allocate(control, mesh.elements, options, dt);
+
+  while (adaptive ? tEnd - t > 1e-12 : out_counter < timeSteps) {
+    double h = adaptive ? std::min(control.h, tEnd - t) : dt;
+    TRACE_WINDOW(out_counter, 0);
+    {
+      TRACE_SCOPE("fluid_nl_monolithic");
+      fluid_nl_monolithic(state, t + h, mesh.elements, kappa, adaptive ? tau * h / dt : tau, workspace, options);
+    }
+
+    // repeated with the smaller step size proposed by the control
+    if (adaptive && !fluid_step_control(control, state, h, true))
+      continue;
+
+    t += h;
+    tube_state_advance(state);
+    elementWindows += mesh.elements;
+    maxElements = std::max(maxElements, mesh.elements);
+    {
+      TRACE_SCOPE("fluid_output_write");
+      TubeFields solution = state.previous;
+      if (mesh.elements != reference.elements) {
+        TubeFields onReference = {interpolated, interpolated + N + 1, interpolated + 2 * (N + 1)};
+        tube_mesh_interpolate(mesh, solution.velocity, reference, onReference.velocity);
+        tube_mesh_interpolate(mesh, solution.pressure, reference, onReference.pressure);
+        tube_mesh_interpolate(mesh, solution.crossSectionLength, reference, onReference.crossSectionLength);
+        solution = onReference;
+      }
+      fluid_output_write(output, t, out_counter, solution.velocity, solution.pressure, solution.crossSectionLength);
+    }
+    out_counter++;
+
+    if (tube_restart_due(options.restart, out_counter)) {
+      TRACE_SCOPE("restart");
+      std::string path = tube_restart_path(options.restart, "MONOLITHIC", out_counter);
+      const double* restartFields[3] = {state.previous.velocity, state.previous.pressure, state.previous.crossSectionLength};
+      tube_restart_write(path.c_str(), "MONOLITHIC", out_counter, t, mesh.elements + 1, 3, restartNames, restartFields);
+    }
+
+    // adapts the mesh to the solution and the length of the next window
+    if (options.refine > 0) {
+      TRACE_SCOPE("refine");
+      double window = N * kappa * tau * (adaptive ? control.h / dt : 1.0);
+      TubeMesh adapted;
+      if (fluid_refine_mesh(mesh, state.previous, options.refine, options.refineTol, window, adapted)) {
+        remesh(mesh, adapted, state, workspace, options, adaptive ? &control : NULL);
+        if (options.log)
+          cout << "Mesh adapted to " << mesh.elements << " elements" << endl;
+      }
+    }
+  }
+
+  TRACE_END();
+
+  if (adaptive) {
+    cout << "Time steps: " << control.accepted << " accepted, " << control.rejected << " repeated" << endl;
+    fluid_step_free(control);
+  }
+  if (options.refine > 0 && out_counter > 0)
+    cout << "Mesh elements: " << (double)elementWindows / out_counter << " on average, at most " << maxElements << endl;
+  if (workspace.profile.unconverged > 0)
+    cout << "Nonlinear Solver not converged in " << workspace.profile.unconverged << " of "
+         << workspace.profile.calls << " time steps" << endl;
+
+  fluid_output_close(output);
+  fluid_workspace_free(workspace);
+  tube_state_free(state);
+  delete [] grid;
+  delete [] interpolated;
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include "../FluidSolver_Serial/fluid_nl.h"
+#include "../FluidSolver_Serial/fluid_output.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+/*
+   Network of elastic tubes in one process, e.g. a bifurcation or an arterial tree, see
+   fluid_network.h. Every segment is a tube of the MonolithicSolver with the tube law, the
+   segments are coupled at the junctions in every Newton iteration of fluid_nl_network().
+   The time stepping matches the MonolithicSolver, the output lists the nodes of all
+   segments one after the other.
+*/
+int main(int argc, char** argv)
+{
+  cout << "Starting Network Solver..." << endl;
+
+  FluidOptions options;
+  if (argc < 4 || !fluid_options_parse(options, argc, argv, 4)) {
+    cout << endl;
+    cout << "Usage: " << argv[0] << " topology tau kappa [options]" << endl;
+    cout << endl;
+    cout << "topology: File of the segments, one \"from to length elements\" per line." << endl;
+    cout << "tau:      Dimensionless time step size." << endl;
+    cout << "kappa:    Dimensionless structural stiffness." << endl;
+    fluid_options_usage();
+    return -1;
+  }
+
+  if (options.engine != FLUID_ENGINE_NEWTON || options.chord || options.predictor != FLUID_PREDICTOR_NONE) {
+    cout << "The network is only solved by the Newton engine without --chord and --predictor." << endl;
+    return -1;
+  }
+  if (options.dtTol > 0.0 || !options.mesh.empty() || options.refine > 0 ||
+      options.restart.window >= 0 || options.restart.interval > 0) {
+    cout << "--dt-tol, --mesh, --refine and restart files are not available for networks." << endl;
+    return -1;
+  }
+
+  double tau = atof(argv[2]);
+  double kappa = atof(argv[3]);
+
+  FluidNetwork network;
+  if (!fluid_network_read(network, argv[1]))
+    return -1;
+
+  std::cout << "Segments: " << network.segments.size() << " junctions: " << network.junctions.size()
+            << " inlets: " << network.inlets << " outlets: " << network.outlets << std::endl;
+  std::cout << "tau: " << tau << " kappa: " << kappa << std::endl;
+
+  TRACE_BEGIN("NETWORK", 0);
+
+  std::string outputFilePrefix = "Postproc/out_network";
+
+  int dimensions = 2;
+
+  // init data values and mesh, all segments start at the initial state of the single tube
+  fluid_network_allocate(network, options, 1.0 / (kappa * 1.0));
+  int points = network.elements + (int)network.segments.size();
+  std::cout << "Elements: " << network.elements << " on " << network.teams.size() << " threads" << std::endl;
+
+  double* grid;
+  grid = new double[dimensions * points];
+  std::vector<int> first;
+  fluid_network_grid(network, grid, first);
+
+  // the fields of all segments one after the other
+  double* fields = new double[3 * points];
+
+  double t = 0.0;          // time
+  double dt = 0.01;        // time step size, time-window-size of precice-config.xml
+  int timeSteps = 100;     // max-time of precice-config.xml is 1.0
+  int out_counter = 0;
+
+  // time steps are written by a background thread
+  FluidOutput output;
+  fluid_output_open(output, outputFilePrefix.c_str(), options.output, points - 1, grid, &first);
+
+  while (out_counter < timeSteps) {
+    TRACE_WINDOW(out_counter, 0);
+    {
+      TRACE_SCOPE("fluid_nl_network");
+      fluid_nl_network(network, t + dt, kappa, tau, options);
+    }
+
+    t += dt;
+    fluid_network_advance(network);
+    {
+      TRACE_SCOPE("fluid_output_write");
+      for (size_t s = 0; s < network.segments.size(); s++) {
+        const TubeFields& solution = network.segments[s].state.previous;
+        for (int i = 0; i <= network.segments[s].elements; i++) {
+          fields[first[s] + i] = solution.velocity[i];
+          fields[points + first[s] + i] = solution.pressure[i];
+          fields[2 * points + first[s] + i] = solution.crossSectionLength[i];
+        }
+      }
+      fluid_output_write(output, t, out_counter, fields, fields + points, fields + 2 * points);
+    }
+    out_counter++;
+  }
+
+  TRACE_END();
+
+  const FluidProfile& profile = network.profile;
+  if (profile.calls > 0)
+    cout << "Newton iterations: " << (double)profile.iterations / profile.calls << " per time step" << endl;
+  if (profile.unconverged > 0)
+    cout << "Nonlinear Solver not converged in " << profile.unconverged << " of " << profile.calls << " time steps" << endl;
+
+  fluid_output_close(output);
+  fluid_network_free(network);
+  delete [] grid;
+  delete [] fields;
+
+  return 0;
+}
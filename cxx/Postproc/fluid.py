@@ -1,63 +1,89 @@
 #!/usr/bin/python
 
-import vtk
 import numpy as np
 import os
 import sys
 import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D
 
-T = 100  # number of timesteps performed
-
 arrayname = sys.argv[1]  # Which dataset should be plotted?
 data_path = sys.argv[2]  # Where is the data?
 
-file_name_generator = lambda id: data_path+str(id)+".vtk"
 
-print("reading data from array with name = %s" % arrayname)
-print("parsing datasets named %s*.vtk" % data_path)
+def read_series_history(path):
+    """ History of a time series file <prefix>.tube (--output=series), read through mmap """
+    from fluid_series import read_series, FIELDS
 
-values_for_all_t = T * [None]
+    if arrayname not in FIELDS:
+        print("array with name %s does not exist!" % arrayname)
+        print("exiting.")
+        quit()
+    grid, records = read_series(path)
+    return grid[:, 0], np.abs(records[arrayname])
 
 
-for t in range(T):
+def read_vtk_history(prefix):
+    """ History of the files <prefix><k>.vtu or the ASCII legacy files <prefix><k>.vtk (--output=vtk) """
+    import vtk
 
-    # read the vtk file as an unstructured grid
-    reader = vtk.vtkUnstructuredGridReader()
-    reader.SetFileName(file_name_generator(t))
-    reader.ReadAllVectorsOn()
-    reader.ReadAllScalarsOn()
-    reader.Update()
+    # binary XML files of the serial solvers or ASCII legacy files (--output=vtk)
+    extension = ".vtu" if os.path.exists(prefix+"0.vtu") else ".vtk"
+    file_name_generator = lambda id: prefix+str(id)+extension
 
-    # parse the data
-    grid = reader.GetOutput()
-    point_data = grid.GetPointData().GetArray(arrayname)
-    points = grid.GetPoints()
-    N = grid.GetNumberOfPoints()  # How many gridpoints do exist?
+    print("parsing datasets named %s*%s" % (prefix, extension))
 
-    if point_data is None:  # check if array exists in dataset
-        print("array with name %s does not exist!" % arrayname)
-        print("exiting.")
-        quit()
+    values_for_all_t = []
+    t = 0
+    while os.path.exists(file_name_generator(t)):
+
+        # read the vtk file as an unstructured grid
+        if extension == ".vtu":
+            reader = vtk.vtkXMLUnstructuredGridReader()
+            reader.SetFileName(file_name_generator(t))
+        else:
+            reader = vtk.vtkUnstructuredGridReader()
+            reader.SetFileName(file_name_generator(t))
+            reader.ReadAllVectorsOn()
+            reader.ReadAllScalarsOn()
+        reader.Update()
+
+        # parse the data
+        grid = reader.GetOutput()
+        point_data = grid.GetPointData().GetArray(arrayname)
+        points = grid.GetPoints()
+        N = grid.GetNumberOfPoints()  # How many gridpoints do exist?
 
-    value_at_t = []
-    spatial_mesh = []
+        if point_data is None:  # check if array exists in dataset
+            print("array with name %s does not exist!" % arrayname)
+            print("exiting.")
+            quit()
 
-    n = point_data.GetNumberOfComponents()
+        value_at_t = []
+        spatial_mesh = []
 
-    for i in range(N):  # parse data from vtk array into list
+        n = point_data.GetNumberOfComponents()
 
-        x, y, z = grid.GetPoint(i)  # read coordinates of point
-        spatial_mesh += [x]  # only store x component
+        for i in range(N):  # parse data from vtk array into list
 
-        v = np.zeros(n)  # initialize empty butter array
-        point_data.GetTuple(i, v)  # read value into v
-        value_at_t += [np.linalg.norm(v)]
+            x, y, z = grid.GetPoint(i)  # read coordinates of point
+            spatial_mesh += [x]  # only store x component
 
-    values_for_all_t[t] = value_at_t
+            v = np.zeros(n)  # initialize empty butter array
+            point_data.GetTuple(i, v)  # read value into v
+            value_at_t += [np.linalg.norm(v)]
 
+        values_for_all_t += [value_at_t]
+        t += 1
 
-values_for_all_t = np.array(values_for_all_t)
+    return np.array(spatial_mesh), np.array(values_for_all_t)
+
+
+print("reading data from array with name = %s" % arrayname)
+if data_path.endswith(".tube"):
+    spatial_mesh, values_for_all_t = read_series_history(data_path)
+else:
+    spatial_mesh, values_for_all_t = read_vtk_history(data_path)
+T = len(values_for_all_t)  # number of timesteps performed
 
 fig = plt.figure()
 ax = fig.add_subplot(111, projection='3d')
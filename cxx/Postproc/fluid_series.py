@@ -0,0 +1,38 @@
+#!/usr/bin/python
+
+# Reader of the time series files <prefix>.tube of the serial fluid solvers (--output=series),
+# the layout is described in FluidSolver_Serial/fluid_series.h.
+
+import os
+import numpy as np
+
+FIELDS = ["velocity", "pressure", "diameter"]
+
+header_dtype = np.dtype([("magic", "S8"),
+                         ("version", "<u4"),
+                         ("fields", "<u4"),
+                         ("points", "<u8"),
+                         ("steps", "<u8"),
+                         ("names", "S16", (len(FIELDS),))])
+
+
+def read_series(path):
+    """ Maps a series file. Returns the grid as (points, 2) array and the records as
+        structured array with the fields t, velocity, pressure and diameter, e.g.
+        records["pressure"] is the (steps, points) history of the pressure. No data
+        is read until it is accessed. """
+    header = np.fromfile(path, dtype=header_dtype, count=1)[0]
+    if header["magic"] != b"TUBESERI" or header["version"] != 1:
+        raise ValueError("%s is not a tube series of version 1" % path)
+
+    points = int(header["points"])
+    grid = np.memmap(path, dtype="<f8", mode="r", offset=header_dtype.itemsize, shape=(points, 2))
+
+    record_dtype = np.dtype([("t", "<f8")] + [(name, "<f8", (points,)) for name in FIELDS])
+    offset = header_dtype.itemsize + grid.nbytes
+    complete = (os.path.getsize(path) - offset) // record_dtype.itemsize
+    steps = min(int(header["steps"]), complete)
+    if steps == 0:
+        return grid, np.zeros(0, dtype=record_dtype)
+    records = np.memmap(path, dtype=record_dtype, mode="r", offset=offset, shape=(steps,))
+    return grid, records
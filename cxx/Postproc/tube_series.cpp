@@ -0,0 +1,43 @@
+#include "../FluidSolver_Serial/fluid_series.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+   Prints the history of one field at one point of a time series file written with
+   --output=series, or a summary of the file if only the file is given.
+*/
+int main(int argc, char** argv)
+{
+  if (argc != 2 && argc != 4) {
+    printf("Usage: %s <prefix>.tube [<velocity|pressure|diameter> <point>]\n", argv[0]);
+    return -1;
+  }
+
+  FluidSeries series;
+  if (!fluid_series_open(series, argv[1]))
+    return -1;
+
+  if (argc == 2) {
+    printf("points: %ld\n", series.points);
+    printf("steps:  %ld\n", series.steps);
+    if (series.steps > 0)
+      printf("time:   %.6e .. %.6e\n", fluid_series_time(series, 0), fluid_series_time(series, series.steps - 1));
+    fluid_series_close(series);
+    return 0;
+  }
+
+  int field = fluid_series_field_index(argv[2]);
+  long point = atol(argv[3]);
+  if (field < 0 || point < 0 || point >= series.points) {
+    printf("Unknown field %s or point %s out of range [0, %ld]\n", argv[2], argv[3], series.points - 1);
+    fluid_series_close(series);
+    return -1;
+  }
+
+  printf("# t %s[%ld] at x=%.6e\n", argv[2], point, series.grid[2 * point]);
+  for (long step = 0; step < series.steps; step++)
+    printf("%.16e %.16e\n", fluid_series_time(series, step), fluid_series_field(series, step, field)[point]);
+
+  fluid_series_close(series);
+  return 0;
+}
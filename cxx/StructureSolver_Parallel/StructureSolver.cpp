@@ -1,8 +1,15 @@
 #include "StructureSolver.h"
+#include "../Common/elastictube_partition.h"
+#include "../Common/elastictube_restart.h"
+#include "../Common/elastictube_trace.h"
 #include "precice/SolverInterface.hpp"
 
+#include <cstdlib>
 #include <iostream>
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace precice;
 using namespace precice::constants;
@@ -10,32 +17,36 @@ using namespace precice::constants;
 int main(int argc, char** argv)
 {
   std::cout << "Starting Structure Solver..." << std::endl;
-  if (argc != 3) {
+  TubeRestartOptions restart;
+  if (argc < 3 || !tube_restart_parse(restart, argc, argv, 3)) {
     std::cout << std::endl;
-    std::cout << "Structure: Usage: mpiexec -np <#procs> " << argv[0] << " <configurationFileName> <N>" << std::endl;
+    std::cout << "Structure: Usage: mpiexec -np <#procs> " << argv[0] << " <configurationFileName> <N> [options]" << std::endl;
     std::cout << std::endl;
     std::cout << "N:     Number of mesh elements, needs to be equal for fluid and structure solver." << std::endl;
+    std::cout << "Options:" << std::endl;
+    tube_restart_usage();
     return -1;
   }
 
-  MPI_Init(&argc, &argv);
+  // Only the main thread calls MPI, the tube law may run on OMP_NUM_THREADS threads per rank
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+#ifdef _OPENMP
+  if (!getenv("OMP_NUM_THREADS") || provided < MPI_THREAD_FUNNELED)
+    omp_set_num_threads(1);
+#endif
 
   int domainSize, gridOffset, rank, size, chunkLength;
 
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
+  TRACE_BEGIN("STRUCTURE", rank);
 
   domainSize = atoi(argv[2]);
-  if ((domainSize + 1) % size == 0) {
-    chunkLength = (domainSize + 1) / size;
-    gridOffset = rank * chunkLength;
-  } else if (rank < (domainSize + 1) % size) {
-    chunkLength = (domainSize + 1) / size + 1;
-    gridOffset = rank * chunkLength;
-  } else {
-    chunkLength = (domainSize + 1) / size;
-    gridOffset = ((domainSize + 1) % size) * ((domainSize + 1) / size + 1) + (rank - ((domainSize + 1) % size)) * (domainSize + 1) / size;
-  }
+  TubePartition partition;
+  tube_partition_block(partition, domainSize + 1, size);
+  chunkLength = partition.counts[rank];
+  gridOffset = partition.offsets[rank];
 
   std::vector<double> pressure(chunkLength);
   std::vector<double> crossSectionLength(chunkLength);
@@ -64,10 +75,23 @@ int main(int argc, char** argv)
 
   interface.setMeshVertices(meshID, chunkLength, grid.data(), vertexIDs.data());
 
-  interface.initialize();
+  double dt = interface.initialize();
 
   double t = 0;
-  double dt = 0.01;
+  int window = 0, iteration = 0;
+
+  // resume after a completed time window, see elastictube_restart.h
+  const char* restartNames[2] = {"pressure", "crossSection"};
+  if (restart.window >= 0) {
+    std::string path = tube_restart_path(restart, "STRUCTURE", restart.window);
+    double* restartFields[2] = {pressure.data(), crossSectionLength.data()};
+    if (!tube_restart_read_partitioned(partition, path.c_str(), "STRUCTURE", 2, restartNames, restartFields, window, t)) {
+      MPI_Finalize();
+      return -1;
+    }
+    if (rank == 0)
+      std::cout << "Structure: Resuming after time window " << window << " at t = " << t << std::endl;
+  }
 
   if (interface.isActionRequired(actionWriteInitialData())) {
     interface.writeBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), crossSectionLength.data());
@@ -81,28 +105,52 @@ int main(int argc, char** argv)
   }
 
   while (interface.isCouplingOngoing()) {
+    TRACE_WINDOW(window, iteration);
     if (interface.isActionRequired(actionWriteIterationCheckpoint())) {
       interface.markActionFulfilled(actionWriteIterationCheckpoint());
     }
 
-    structureComputeSolution(rank, size, chunkLength, pressure.data(), crossSectionLength.data()); // Call Solver
-                                                                                                   //structureDataDisplay(crossSectionLength, chunkLength);
-                                                                                                   //structureDataDisplay(pressure, chunkLength);
+    {
+      TRACE_SCOPE("structureComputeSolution");
+      structureComputeSolution(rank, size, chunkLength, pressure.data(), crossSectionLength.data()); // Call Solver
+    }
+    //structureDataDisplay(crossSectionLength, chunkLength);
+    //structureDataDisplay(pressure, chunkLength);
 
-    interface.writeBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), crossSectionLength.data());
+    {
+      TRACE_SCOPE("writeBlockScalarData");
+      interface.writeBlockScalarData(crossSectionLengthID, chunkLength, vertexIDs.data(), crossSectionLength.data());
+    }
 
-    interface.advance(dt);
+    {
+      TRACE_SCOPE("advance");
+      interface.advance(dt);
+    }
 
-    interface.readBlockScalarData(pressureID, chunkLength, vertexIDs.data(), pressure.data());
+    {
+      TRACE_SCOPE("readBlockScalarData");
+      interface.readBlockScalarData(pressureID, chunkLength, vertexIDs.data(), pressure.data());
+    }
 
     if (interface.isActionRequired(actionReadIterationCheckpoint())) { // i.e. fluid not yet converged
       interface.markActionFulfilled(actionReadIterationCheckpoint());
+      iteration++;
     } else {
       t += dt;
+      window++;
+      iteration = 0;
+
+      if (tube_restart_due(restart, window)) {
+        TRACE_SCOPE("restart");
+        std::string path = tube_restart_path(restart, "STRUCTURE", window);
+        const double* restartFields[2] = {pressure.data(), crossSectionLength.data()};
+        tube_restart_write_partitioned(partition, path.c_str(), "STRUCTURE", window, t, 2, restartNames, restartFields);
+      }
     }
   }
 
   interface.finalize();
+  TRACE_END();
   MPI_Finalize();
 
   return 0;
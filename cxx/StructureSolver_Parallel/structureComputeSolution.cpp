@@ -6,6 +6,7 @@ void structureComputeSolution(int rank, int size, int chunkLength, double* press
    * Update displacement of membrane based on pressure data from the fluid solver
    */
 
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < chunkLength; i++) {
     crossSectionLength[i] = 4.0 / ((2.0 - pressure[i]) * (2.0 - pressure[i]));
     ;
@@ -1,3 +1,6 @@
+#include "../Common/elastictube_mesh.h"
+#include "../Common/elastictube_restart.h"
+#include "../Common/elastictube_trace.h"
 #include "precice/SolverInterface.hpp"
 #include <iostream>
 #include <stdlib.h>
@@ -15,17 +18,50 @@ void printData(const std::vector<double>& data)
   cout << endl;
 }
 
+/* Parses the restart options and --mesh from argv[first..argc-1]. Prints a message and returns false on error. */
+static bool parseOptions(TubeRestartOptions& restart, std::string& meshPath, int argc, char** argv, int first)
+{
+  for (int i = first; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string::size_type pos = arg.find('=');
+
+    if (arg.compare(0, 2, "--") != 0 || pos == std::string::npos) {
+      cout << "Invalid argument " << arg << ", expected --name=value" << endl;
+      return false;
+    }
+
+    std::string name = arg.substr(2, pos - 2);
+    std::string value = arg.substr(pos + 1);
+    bool valid;
+
+    if (!tube_restart_option(restart, name, value, valid) && !tube_mesh_option(meshPath, name, value, valid)) {
+      cout << "Unknown option --" << name << endl;
+      return false;
+    }
+    if (!valid) {
+      cout << "Invalid value " << value << " for option --" << name << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
 int main(int argc, char** argv)
 {
   cout << "Starting Structure Solver..." << endl;
   using namespace precice;
   using namespace precice::constants;
 
-  if (argc != 3) {
+  TubeRestartOptions restart;
+  std::string meshPath;
+  if (argc < 3 || !parseOptions(restart, meshPath, argc, argv, 3)) {
     cout << endl;
-    cout << "Usage: " << argv[0] << " configurationFileName N" << endl;
+    cout << "Usage: " << argv[0] << " configurationFileName N [options]" << endl;
     cout << endl;
-    cout << "N:     Number of mesh elements, needs to be equal for fluid and structure solver." << endl;
+    cout << "N:     Number of mesh elements, N and --mesh need to be equal for fluid and structure solver." << endl;
+    cout << "Options:" << endl;
+    tube_mesh_usage();
+    tube_restart_usage();
     return -1;
   }
 
@@ -34,6 +70,17 @@ int main(int argc, char** argv)
 
   std::cout << "N: " << N << std::endl;
 
+  // node positions, see elastictube_mesh.h, from here on N counts the elements of the mesh
+  TubeMesh mesh;
+  tube_mesh_uniform(mesh, N);
+  if (!meshPath.empty()) {
+    if (!tube_mesh_read(mesh, meshPath.c_str(), N))
+      return -1;
+    N = mesh.elements;
+    std::cout << "Mesh: " << N << " elements from " << meshPath << std::endl;
+  }
+  TRACE_BEGIN("STRUCTURE", 0);
+
   std::string solverName = "STRUCTURE";
 
   SolverInterface interface(solverName, configFileName, 0, 1);
@@ -47,8 +94,7 @@ int main(int argc, char** argv)
   double* grid;
   grid = new double[dimensions * (N + 1)];
   
-  double dt = 0.01; // solver timestep size
-  double precice_dt; // maximum precice timestep size
+  double precice_dt; // time to the end of the time window, set by preCICE
 
   //precice stuff
   int meshID = interface.getMeshID("Structure_Nodes");
@@ -60,23 +106,29 @@ int main(int argc, char** argv)
   for (int i = 0; i <= N; i++) {
     crossSectionLength[i] = 1.0;
     pressure[i] = 0.0;
-    for (int dim = 0; dim < dimensions; dim++)
-      grid[i * dimensions + dim] = i * (1 - dim); // Define the y-component of each grid point as zero
   }
+  tube_mesh_grid(mesh, grid, dimensions); // the y-component of each grid point is zero
 
-  int tstep_counter = 0; // number of time steps (only coupling iteration time steps)
-  int t = 0;             // number of time steps (including subcycling time steps)
-  int tsub = 0;          // number of current subcycling time steps
-  int n_subcycles = 0;   // number of subcycles
-  //int t_steps_total = 0; // number of total timesteps, i.e., t_steps*n_subcycles
+  int tstep_counter = 0; // number of time windows
   
   interface.setMeshVertices(meshID, N + 1, grid, vertexIDs);
 
   cout << "Structure: init precice..." << endl;
   precice_dt = interface.initialize();
-  
-  n_subcycles = (int)(precice_dt/dt);
-  //t_steps_total = 100*n_subcycles;
+  double windowSize = precice_dt;
+
+  // resume after a completed time window, see elastictube_restart.h
+  int window = 0; // completed time windows
+  const char* restartNames[2] = {"pressure", "crossSection"};
+  if (restart.window >= 0) {
+    std::string path = tube_restart_path(restart, "STRUCTURE", restart.window);
+    double* restartFields[2] = {pressure, crossSectionLength};
+    double time;
+    if (!tube_restart_read(path.c_str(), "STRUCTURE", N + 1, 2, restartNames, restartFields, window, time))
+      return -1;
+    tstep_counter = window; // the checkpoint of the next window counts it as finished
+    cout << "Resuming after time window " << window << " at t = " << time << endl;
+  }
 
   if (interface.isActionRequired(actionWriteInitialData())) {
     interface.writeBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength);
@@ -90,49 +142,68 @@ int main(int argc, char** argv)
     interface.readBlockScalarData(pressureID, N + 1, vertexIDs, pressure);
   }
 
+  int iteration = 0; // coupling iteration within the time window
   while (interface.isCouplingOngoing()) {
     // When an implicit coupling scheme is used, checkpointing is required
     if (interface.isActionRequired(actionWriteIterationCheckpoint())) {
       
       if(tstep_counter > 0){
         cout << "Advancing in time, finished timestep: " << tstep_counter << endl;
-        t += n_subcycles;        
-        tsub = 0;
       }
       tstep_counter++;
+      iteration = 0;
       
       // write checkpoint, save state variables (not needed here, stationary solver)       
       interface.markActionFulfilled(actionWriteIterationCheckpoint());
     }
 
-    // choose smalles time step (sub-cycling if dt is smaller than precice_dt)
-    dt = std::min(precice_dt, dt);
-    
-    // advance in time for subcycling
-    tsub++;
-    
-    for (int i = 0; i <= N; i++) {
-      crossSectionLength[i] = 4.0 / ((2.0 - pressure[i]) * (2.0 - pressure[i]));
+    TRACE_WINDOW(tstep_counter - 1, iteration);
+
+    // The tube law has no time derivative, every call advances to the end of the time window, while the
+    // fluid solver may subcycle it (--dt-tol)
+    {
+      TRACE_SCOPE("tube law");
+      for (int i = 0; i <= N; i++) {
+        crossSectionLength[i] = 4.0 / ((2.0 - pressure[i]) * (2.0 - pressure[i]));
+      }
     }
 
     // send crossSectionLength data to precice
-    interface.writeBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength);
-    
+    {
+      TRACE_SCOPE("writeBlockScalarData");
+      interface.writeBlockScalarData(crossSectionLengthID, N + 1, vertexIDs, crossSectionLength);
+    }
+
     // advance
-    precice_dt = interface.advance(dt);
-    
+    {
+      TRACE_SCOPE("advance");
+      precice_dt = interface.advance(precice_dt);
+    }
+
     // receive pressure data from precice
-    interface.readBlockScalarData(pressureID, N + 1, vertexIDs, pressure);
+    {
+      TRACE_SCOPE("readBlockScalarData");
+      interface.readBlockScalarData(pressureID, N + 1, vertexIDs, pressure);
+    }
 
     if (interface.isActionRequired(actionReadIterationCheckpoint())) {
       cout << "Iterate" << endl;
-      tsub = 0;
+      iteration++;
       
       interface.markActionFulfilled(actionReadIterationCheckpoint());
+    } else if (interface.isTimeWindowComplete()) {
+      window++;
+      if (tube_restart_due(restart, window)) {
+        TRACE_SCOPE("restart");
+        std::string path = tube_restart_path(restart, "STRUCTURE", window);
+        const double* restartFields[2] = {pressure, crossSectionLength};
+        tube_restart_write(path.c_str(), "STRUCTURE", window, window * windowSize, N + 1, 2, restartNames, restartFields);
+      }
     }
   }
 
   interface.finalize();
+  TRACE_END();
 
   delete [] crossSectionLength;
   delete [] pressure;
@@ -0,0 +1,69 @@
+#include "tube_pool.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TubePoolQueue {
+  std::mutex mutex;
+  std::deque<int> tasks; // decreasing cost
+};
+
+/* Own tasks are taken from the front, stolen tasks from the back */
+static bool takeTask(std::vector<TubePoolQueue>& queues, int worker, int& task)
+{
+  int threads = (int)queues.size();
+  for (int k = 0; k < threads; k++) {
+    TubePoolQueue& queue = queues[(worker + k) % threads];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+    if (k == 0) {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+    } else {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+    }
+    return true;
+  }
+  return false;
+}
+
+void tube_pool_run(int tasks, int threads, const double* cost, const std::function<void(int, int)>& task)
+{
+  if (threads > tasks)
+    threads = tasks;
+  if (threads < 1)
+    threads = 1;
+
+  std::vector<int> order(tasks);
+  for (int i = 0; i < tasks; i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [cost](int a, int b) { return cost[a] > cost[b]; });
+
+  std::vector<TubePoolQueue> queues(threads);
+  for (int i = 0; i < tasks; i++)
+    queues[i % threads].tasks.push_back(order[i]);
+
+  auto work = [&queues, &task](int worker) {
+    int index;
+    while (takeTask(queues, worker, index))
+      task(index, worker);
+  };
+
+  // The calling thread is worker 0
+  std::vector<std::thread> workers;
+  for (int w = 1; w < threads; w++)
+    workers.emplace_back(work, w);
+  work(0);
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+int tube_pool_threads()
+{
+  int threads = (int)std::thread::hardware_concurrency();
+  return threads > 0 ? threads : 1;
+}
@@ -0,0 +1,22 @@
+#ifndef TUBE_POOL_H_
+#define TUBE_POOL_H_
+
+#include <functional>
+
+/*
+   Work-stealing pool for independent tasks whose cost is known in advance, e.g. the cases
+   of a parameter sweep. The tasks are sorted by decreasing cost and dealt round-robin to
+   one queue per worker thread. Every worker runs the tasks of its own queue from the
+   expensive end; when it is empty, it steals the cheapest task from the queue of another
+   worker, so the cheap tasks fill the gaps at the end. Tasks do not spawn new tasks, the
+   pool is finished when all queues are empty.
+
+   task(index, worker) is called for every index in 0..tasks-1 exactly once, worker is
+   the number of the calling thread in 0..threads-1.
+*/
+void tube_pool_run(int tasks, int threads, const double* cost, const std::function<void(int, int)>& task);
+
+/* Number of hardware threads, at least 1 */
+int tube_pool_threads();
+
+#endif
@@ -0,0 +1,353 @@
+#include "../FluidSolver_Serial/fluid_nl.h"
+#include "tube_pool.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+   Parameter sweep of the monolithic tube. Every line of the parameter table is one case,
+   an independent tube that is solved like the MonolithicSolver does it: the tube law
+   A = 4/(2-p)^2 is substituted into the Newton iteration of the fluid, see
+   fluid_nl_monolithic(). The cases are spread over the cores by a work-stealing pool
+   (see tube_pool.h), every case has its own state and workspace. One line of results
+   per case is written to a CSV file in the order of the table.
+
+   The table is a text file with whitespace separated columns. The first line that is
+   neither empty nor a comment (#) names the columns, any of N, tau, kappa, ampl and
+   steps; columns that are not given take the value of the command line for all cases.
+
+     # N  kappa  ampl
+       100  10    100
+       100  100   100
+       1000 100   50
+*/
+
+/* Parameters of one case */
+enum SweepColumn {
+  SWEEP_N,
+  SWEEP_TAU,
+  SWEEP_KAPPA,
+  SWEEP_AMPL,
+  SWEEP_STEPS,
+  SWEEP_COLUMN_COUNT
+};
+
+static const char* columnNames[SWEEP_COLUMN_COUNT] = {"N", "tau", "kappa", "ampl", "steps"};
+
+struct SweepOptions {
+  std::string table;
+  double defaults[SWEEP_COLUMN_COUNT] = {100, 0.01, 100, 100, 100};
+  int threads = tube_pool_threads();
+  std::string output = "tube_sweep.csv";
+  std::string series; // prefix of the .tube file of every case, none if empty
+  FluidOptions fluid;
+};
+
+struct SweepResult {
+  double wall;
+  long iterations;    // Newton iterations of all time steps
+  int maxIterations;  // of a single time step
+  bool converged;     // every time step
+  bool seriesFailed;  // --series file of the case could not be created
+  double pressureMin, pressureMax;
+  double crossSectionMin, crossSectionMax;
+};
+
+static bool parseNumber(const std::string& value, double& result)
+{
+  char* end;
+  result = strtod(value.c_str(), &end);
+  return !value.empty() && *end == '\0' && result > 0.0;
+}
+
+static int columnIndex(const std::string& name)
+{
+  for (int c = 0; c < SWEEP_COLUMN_COUNT; c++)
+    if (name == columnNames[c])
+      return c;
+  return -1;
+}
+
+/* Sweep options, all other arguments are passed to fluid_options_parse() */
+static bool parseArguments(SweepOptions& options, int argc, char** argv)
+{
+  std::vector<char*> fluidArguments;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    std::string::size_type pos = arg.find('=');
+    std::string name = pos == std::string::npos ? arg : arg.substr(0, pos);
+    std::string value = pos == std::string::npos ? "" : arg.substr(pos + 1);
+    bool valid = true;
+
+    if (name == "--help")
+      return false;
+    else if (arg.compare(0, 2, "--") != 0 && options.table.empty())
+      options.table = arg;
+    else if (name == "--N")
+      valid = parseNumber(value, options.defaults[SWEEP_N]);
+    else if (name == "--tau")
+      valid = parseNumber(value, options.defaults[SWEEP_TAU]);
+    else if (name == "--kappa")
+      valid = parseNumber(value, options.defaults[SWEEP_KAPPA]);
+    else if (name == "--steps")
+      valid = parseNumber(value, options.defaults[SWEEP_STEPS]);
+    else if (name == "--threads")
+      valid = (options.threads = atoi(value.c_str())) > 0;
+    else if (name == "--output")
+      valid = !(options.output = value).empty();
+    else if (name == "--series")
+      valid = !(options.series = value).empty();
+    else
+      fluidArguments.push_back(argv[i]);
+
+    if (!valid) {
+      std::cout << "Invalid value " << value << " for option " << name << std::endl;
+      return false;
+    }
+  }
+
+  if (options.table.empty())
+    return false;
+
+  // Many cases at once, the Newton iterations are only counted
+  options.fluid.log = false;
+  if (!fluid_options_parse(options.fluid, (int)fluidArguments.size(), fluidArguments.data(), 0))
+    return false;
+  options.defaults[SWEEP_AMPL] = options.fluid.ampl;
+
+  if (options.fluid.engine == FLUID_ENGINE_JFNK) {
+    std::cout << "--engine=jfnk is only available in the partitioned fluid solver." << std::endl;
+    return false;
+  }
+
+  // Every case runs the fixed time windows of the MonolithicSolver
+  if (options.fluid.dtTol > 0.0) {
+    std::cout << "--dt-tol is only available in the MonolithicSolver and the serial fluid solver." << std::endl;
+    return false;
+  }
+
+  // The cases differ in N, the uniform mesh follows it
+  if (!options.fluid.mesh.empty() || options.fluid.refine > 0) {
+    std::cout << "--mesh and --refine are only available in the MonolithicSolver." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+static void usage(const char* program)
+{
+  std::cout << std::endl;
+  std::cout << "Usage: " << program << " <table> [options]" << std::endl;
+  std::cout << std::endl;
+  std::cout << "table: Parameters of the cases, one case per line. The first line names the columns," << std::endl;
+  std::cout << "       any of N, tau, kappa, ampl and steps." << std::endl;
+  std::cout << std::endl;
+  std::cout << "  --N=<N>               Number of mesh elements if there is no column N (default 100)." << std::endl;
+  std::cout << "  --tau=<tau>           Dimensionless time step size if there is no column tau (default 0.01)." << std::endl;
+  std::cout << "  --kappa=<kappa>       Dimensionless structural stiffness if there is no column kappa (default 100)." << std::endl;
+  std::cout << "  --steps=<n>           Time steps of dt = 0.01 if there is no column steps (default 100)." << std::endl;
+  std::cout << "  --threads=<t>         Cases solved at the same time, one thread each (default: hardware threads)." << std::endl;
+  std::cout << "  --output=<file>       Result file (default tube_sweep.csv)." << std::endl;
+  std::cout << "  --series=<prefix>     Also write all time steps of case i to <prefix>_<i>.tube, see fluid_series.h." << std::endl;
+  std::cout << "The value of --ampl is used if there is no column ampl." << std::endl;
+  std::cout << std::endl;
+  fluid_options_usage();
+}
+
+/* Reads the parameter table, prints a message and returns false on error */
+static bool readTable(const SweepOptions& options, std::vector<std::vector<double> >& cases)
+{
+  std::ifstream file(options.table.c_str());
+  if (!file) {
+    std::cout << "Cannot open " << options.table << std::endl;
+    return false;
+  }
+
+  std::vector<int> columns;
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    std::string::size_type comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+    std::stringstream stream(line);
+    std::string item;
+    std::vector<std::string> items;
+    while (stream >> item)
+      items.push_back(item);
+    if (items.empty())
+      continue;
+
+    if (columns.empty()) {
+      for (const std::string& name : items) {
+        int c = columnIndex(name);
+        if (c < 0) {
+          std::cout << options.table << ":" << lineNumber << ": unknown column " << name << std::endl;
+          return false;
+        }
+        columns.push_back(c);
+      }
+      continue;
+    }
+
+    if (items.size() != columns.size()) {
+      std::cout << options.table << ":" << lineNumber << ": expected " << columns.size() << " values" << std::endl;
+      return false;
+    }
+    std::vector<double> parameters(options.defaults, options.defaults + SWEEP_COLUMN_COUNT);
+    for (size_t k = 0; k < items.size(); k++) {
+      if (!parseNumber(items[k], parameters[columns[k]])) {
+        std::cout << options.table << ":" << lineNumber << ": invalid value " << items[k] << std::endl;
+        return false;
+      }
+    }
+    if ((int)parameters[SWEEP_N] < 4) {
+      std::cout << options.table << ":" << lineNumber << ": N has to be at least 4" << std::endl;
+      return false;
+    }
+    cases.push_back(parameters);
+  }
+
+  if (cases.empty()) {
+    std::cout << options.table << ": no cases" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/* Time steps of one case, see monolithic_solver.cpp */
+static void runCase(const SweepOptions& options, const std::vector<double>& parameters, int index, SweepResult& result)
+{
+  int N = (int)parameters[SWEEP_N];
+  double tau = parameters[SWEEP_TAU];
+  double kappa = parameters[SWEEP_KAPPA];
+  int steps = (int)parameters[SWEEP_STEPS];
+  FluidOptions fluidOptions = options.fluid;
+  fluidOptions.ampl = parameters[SWEEP_AMPL];
+
+  TubeState state;
+  tube_state_allocate(state, N + 1);
+  tube_state_fill(state, 1.0 / kappa, 0.0, 1.0);
+
+  FluidWorkspace workspace;
+  fluid_workspace_allocate(workspace, N, fluidOptions);
+
+  FluidSeriesWriter series;
+  series.file = NULL;
+  result.seriesFailed = false;
+  if (!options.series.empty()) {
+    std::vector<double> grid(2 * (N + 1), 0.0);
+    for (int i = 0; i <= N; i++)
+      grid[2 * i] = i;
+    std::string path = options.series + "_" + std::to_string(index) + ".tube";
+    result.seriesFailed = !fluid_series_create(series, path.c_str(), N, grid.data());
+  }
+
+  result.iterations = 0;
+  result.maxIterations = 0;
+  result.converged = true;
+  result.pressureMin = result.crossSectionMin = DBL_MAX;
+  result.pressureMax = result.crossSectionMax = -DBL_MAX;
+
+  double t = 0.0, dt = 0.01;
+  double start = fluid_clock();
+  for (int step = 0; step < steps; step++) {
+    fluid_nl_monolithic(state, t + dt, N, kappa, tau, workspace, fluidOptions);
+    t += dt;
+    tube_state_advance(state);
+
+    const FluidCallStats& last = workspace.last;
+    result.iterations += last.iterations;
+    if (last.iterations > result.maxIterations)
+      result.maxIterations = last.iterations;
+    result.converged = result.converged && last.converged;
+
+    const TubeFields& fields = state.previous;
+    for (int i = 0; i <= N; i++) {
+      if (fields.pressure[i] < result.pressureMin)
+        result.pressureMin = fields.pressure[i];
+      if (fields.pressure[i] > result.pressureMax)
+        result.pressureMax = fields.pressure[i];
+      if (fields.crossSectionLength[i] < result.crossSectionMin)
+        result.crossSectionMin = fields.crossSectionLength[i];
+      if (fields.crossSectionLength[i] > result.crossSectionMax)
+        result.crossSectionMax = fields.crossSectionLength[i];
+    }
+    if (series.file)
+      fluid_series_append(series, t, fields.velocity, fields.pressure, fields.crossSectionLength);
+  }
+  result.wall = fluid_clock() - start;
+
+  fluid_series_finish(series);
+  fluid_workspace_free(workspace);
+  tube_state_free(state);
+}
+
+static bool writeResults(const SweepOptions& options, const std::vector<std::vector<double> >& cases,
+                         const std::vector<SweepResult>& results)
+{
+  FILE* file = fopen(options.output.c_str(), "w");
+  if (!file) {
+    std::cout << "Cannot write " << options.output << std::endl;
+    return false;
+  }
+  fprintf(file, "case,N,tau,kappa,ampl,steps,iterations,max_iterations,converged,"
+                "pressure_min,pressure_max,cross_section_min,cross_section_max,wall\n");
+  for (size_t c = 0; c < cases.size(); c++) {
+    const std::vector<double>& p = cases[c];
+    const SweepResult& r = results[c];
+    fprintf(file, "%zu,%d,%.17g,%.17g,%.17g,%d,%ld,%d,%d,%.17g,%.17g,%.17g,%.17g,%e\n",
+            c, (int)p[SWEEP_N], p[SWEEP_TAU], p[SWEEP_KAPPA], p[SWEEP_AMPL], (int)p[SWEEP_STEPS],
+            r.iterations, r.maxIterations, r.converged ? 1 : 0,
+            r.pressureMin, r.pressureMax, r.crossSectionMin, r.crossSectionMax, r.wall);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  SweepOptions options;
+  if (!parseArguments(options, argc, argv)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  std::vector<std::vector<double> > cases;
+  if (!readTable(options, cases))
+    return -1;
+
+  // The time of a case is proportional to the number of unknowns and time steps
+  int count = (int)cases.size();
+  std::vector<double> cost(count);
+  for (int c = 0; c < count; c++)
+    cost[c] = cases[c][SWEEP_N] * cases[c][SWEEP_STEPS];
+
+  std::cout << "Sweep of " << count << " cases on " << (options.threads < count ? options.threads : count)
+            << " threads, assembly kernel: " << fluid_kernel_isa() << std::endl;
+
+  std::vector<SweepResult> results(count);
+  std::mutex progress;
+  int finished = 0;
+  double start = fluid_clock();
+  tube_pool_run(count, options.threads, cost.data(), [&](int c, int worker) {
+    runCase(options, cases[c], c, results[c]);
+    std::lock_guard<std::mutex> lock(progress);
+    finished++;
+    printf("Case %d finished (%d/%d), thread %d, %.3f s%s%s\n", c, finished, count, worker, results[c].wall,
+           results[c].converged ? "" : ", Newton iteration not converged",
+           results[c].seriesFailed ? ", series not written" : "");
+  });
+  double wall = fluid_clock() - start;
+
+  std::cout << "Sweep finished in " << wall << " s, " << count / wall << " cases/s" << std::endl;
+
+  return writeResults(options, cases, results) ? 0 : -1;
+}